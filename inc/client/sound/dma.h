@@ -45,6 +45,11 @@ typedef struct snddmaAPI_s {
 
 void WAVE_FillAPI(snddmaAPI_t *api);
 
+// backends report problems from BeginPainting and Submit through these,
+// which may be running on the mixer thread
+void DMA_Overrun(const char *msg);
+void DMA_DeviceError(const char *fmt, ...) q_printf(1, 2);
+
 #if USE_DSOUND
 void DS_FillAPI(snddmaAPI_t *api);
 #endif
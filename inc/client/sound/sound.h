@@ -42,6 +42,11 @@ void S_EndRegistration(void);
 void S_RawSamples(int samples, int rate, int width,
 		int channels, byte *data, float volume);
 
+#if USE_TESTS && USE_SNDDMA
+void S_MixTest_f(void);
+void S_MixerTest_f(void);
+#endif
+
 extern  vec3_t  listener_origin;
 extern  vec3_t  listener_forward;
 extern  vec3_t  listener_right;
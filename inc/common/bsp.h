@@ -150,6 +150,7 @@ typedef struct {
     int                 numsides;
     mbrushside_t        *firstbrushside;
     int                 checkcount;        // to avoid repeated testings
+    unsigned            checkmask;         // batched moves tested at checkcount
 } mbrush_t;
 
 typedef struct {
@@ -59,6 +59,12 @@ int         CM_TransformedPointContents(vec3_t p, mnode_t *headnode,
 void        CM_BoxTrace(trace_t *trace, vec3_t start, vec3_t end,
                         vec3_t mins, vec3_t maxs,
                         mnode_t *headnode, int brushmask);
+// traces multiple moves of the same box, sorted in chunks of this size
+#define CM_MAX_TRACEBATCH       256
+
+void        CM_BoxTraceN(trace_t *traces, vec3_t *starts, vec3_t *ends, int count,
+                         vec3_t mins, vec3_t maxs,
+                         mnode_t *headnode, int brushmask);
 void        CM_TransformedBoxTrace(trace_t *trace, vec3_t start, vec3_t end,
                                    vec3_t mins, vec3_t maxs,
                                    mnode_t * headnode, int brushmask,
@@ -174,6 +174,7 @@ extern unsigned     time_before_game;
 extern unsigned     time_after_game;
 extern unsigned     time_before_ref;
 extern unsigned     time_after_ref;
+extern unsigned     time_predict;
 #endif
 
 extern const char   com_version_string[];
@@ -0,0 +1,71 @@
+/*
+Copyright (C) 2003-2008 Andrey Nazarov
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef DEMOPARSE_H
+#define DEMOPARSE_H
+
+#include "common/error.h"
+
+//
+// reentrant demo parser, all state is kept in the context so that
+// multiple demos can be parsed in parallel without touching cl/cls
+//
+
+typedef struct {
+    qboolean    mvd;
+    int         protocol;
+    int         servercount;
+    int         clientnum;
+    int         maxclients;
+    char        gamedir[MAX_QPATH];
+    char        map[MAX_QPATH];
+    char        pov[MAX_CLIENT_NAME];
+
+    size_t      bytes;          // uncompressed demo data
+    unsigned    messages;
+    unsigned    frames;
+    unsigned    levels;         // number of serverdata messages
+    unsigned    configstrings;
+    unsigned    baselines;
+    unsigned    entities;       // entity state deltas
+    unsigned    players;        // player state deltas
+    unsigned    prints;
+    unsigned    chats;
+    unsigned    sounds;
+    unsigned    effects;        // temp entities and muzzle flashes
+    unsigned    multicasts;
+    unsigned    unicasts;
+
+    qboolean    complete;       // end of demo marker was found
+    qerror_t    error;
+    const char  *reason;        // what was being parsed when error occured
+    size_t      erroffset;      // offset of the bad message in demo data
+    unsigned    usec;           // parsing time
+} demosummary_t;
+
+typedef struct demoparse_s demoparse_t;
+
+// contexts must be created and freed by the main thread, but parsing
+// doesn't call into the engine and may run in any thread
+demoparse_t *DP_CreateContext(void);
+void        DP_FreeContext(demoparse_t *dp);
+qerror_t    DP_ParseFile(demoparse_t *dp, const char *path, demosummary_t *summary);
+
+void        DP_Init(void);
+
+#endif // DEMOPARSE_H
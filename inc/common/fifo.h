@@ -44,6 +44,30 @@ static inline void *FIFO_Reserve(fifo_t *fifo, size_t *len)
     return fifo->data;
 }
 
+// returns up to two free regions, second one is at the start of buffer
+static inline int FIFO_ReserveV(fifo_t *fifo, void **data, size_t *len)
+{
+    if (fifo->bs) {
+        data[0] = fifo->data + fifo->bs;
+        len[0] = fifo->ax - fifo->bs;
+        return len[0] ? 1 : 0;
+    }
+
+    data[0] = fifo->data + fifo->ay;
+    len[0] = fifo->size - fifo->ay;
+    data[1] = fifo->data;
+    len[1] = fifo->ax;
+
+    if (!len[0]) {
+        data[0] = data[1];
+        len[0] = len[1];
+        return len[0] ? 1 : 0;
+    }
+
+    return len[1] ? 2 : 1;
+}
+
+// len may span both regions returned by FIFO_ReserveV
 static inline void FIFO_Commit(fifo_t *fifo, size_t len)
 {
     size_t tail;
@@ -54,12 +78,14 @@ static inline void FIFO_Commit(fifo_t *fifo, size_t len)
     }
 
     tail = fifo->size - fifo->ay;
-    if (tail) {
-        fifo->ay += len;
+    if (len > tail) {
+        // wrapped to the start of buffer
+        fifo->ay = fifo->size;
+        fifo->bs = len - tail;
         return;
     }
 
-    fifo->bs = len;
+    fifo->ay += len;
 }
 
 static inline void *FIFO_Peek(fifo_t *fifo, size_t *len)
@@ -68,15 +94,38 @@ static inline void *FIFO_Peek(fifo_t *fifo, size_t *len)
     return fifo->data + fifo->ax;
 }
 
+// returns up to two regions of queued data, in order
+static inline int FIFO_PeekV(fifo_t *fifo, void **data, size_t *len)
+{
+    data[0] = fifo->data + fifo->ax;
+    len[0] = fifo->ay - fifo->ax;
+    data[1] = fifo->data;
+    len[1] = fifo->bs;
+
+    if (!len[0]) {
+        return 0;
+    }
+
+    return len[1] ? 2 : 1;
+}
+
+// len may span both regions returned by FIFO_PeekV
 static inline void FIFO_Decommit(fifo_t *fifo, size_t len)
 {
-    if (fifo->ax + len < fifo->ay) {
+    size_t head = fifo->ay - fifo->ax;
+
+    if (len < head) {
         fifo->ax += len;
         return;
     }
 
+    fifo->ax = len - head;
     fifo->ay = fifo->bs;
-    fifo->ax = fifo->bs = 0;
+    fifo->bs = 0;
+
+    if (fifo->ax == fifo->ay) {
+        fifo->ax = fifo->ay = 0;
+    }
 }
 
 static inline size_t FIFO_Usage(fifo_t *fifo)
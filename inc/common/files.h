@@ -68,11 +68,13 @@ typedef struct file_info_s {
 #define FS_SEARCH_DIRSONLY      0x00001000
 #define FS_SEARCH_MASK          0x00001f00
 
-// bits 8 - 11, flag
+// bits 8 - 12, flag
 #define FS_FLAG_GZIP            0x00000100
 #define FS_FLAG_EXCL            0x00000200
 #define FS_FLAG_TEXT            0x00000400
 #define FS_FLAG_DEFLATE         0x00000800
+#define FS_FLAG_VIEW            0x00001000  // FS_LoadFileEx may return read-only,
+                                            // unaligned, not NUL terminated data
 
 //
 // Limit the maximum file size FS_LoadFile can handle, as a protection from
@@ -88,7 +90,6 @@ typedef struct file_info_s {
 #define FS_Mallocz(size)        Z_TagMallocz(size, TAG_FILESYSTEM)
 #define FS_CopyString(string)   Z_TagCopyString(string, TAG_FILESYSTEM)
 #define FS_LoadFile(path, buf)  FS_LoadFileEx(path, buf, 0, TAG_FILESYSTEM)
-#define FS_FreeFile(buf)        Z_Free(buf)
 
 // just regular malloc for now
 #define FS_AllocTempMem(size)   FS_Malloc(size)
@@ -105,9 +106,8 @@ void    FS_Init(void);
 void    FS_Shutdown(void);
 void    FS_Restart(qboolean total);
 
-#if USE_CLIENT
 qerror_t FS_RenameFile(const char *from, const char *to);
-#endif
+void    FS_IndexFile(const char *path);
 
 qerror_t FS_CreatePath(char *path);
 
@@ -133,6 +133,15 @@ qerror_t FS_FilterFile(qhandle_t f);
     FS_FileExistsEx(path, 0)
 
 ssize_t FS_LoadFileEx(const char *path, void **buffer, unsigned flags, memtag_t tag);
+void    FS_FreeFile(void *buf);
+
+// buf is NULL and len is error code if load failed
+typedef void (*fs_loaddone_t)(const char *path, void *buf, ssize_t len, void *arg);
+
+qerror_t FS_LoadFileAsync(const char *path, memtag_t tag, fs_loaddone_t done, void *arg);
+void    FS_RunAsync(void);
+
+#define FS_PrefetchFile(path)   FS_LoadFileAsync(path, TAG_FILESYSTEM, NULL, NULL)
 // a NULL buffer will just return the file length without loading
 // length < 0 indicates error
 
@@ -83,6 +83,10 @@ extern byte         msg_write_buffer[MAX_MSGLEN];
 extern sizebuf_t    msg_read;
 extern byte         msg_read_buffer[MAX_MSGLEN];
 
+#if USE_TESTS
+extern qboolean     msg_scalar_diff;    // disable SIMD change mask for testing
+#endif
+
 extern const entity_packed_t    nullEntityState;
 extern const player_packed_t    nullPlayerState;
 extern const usercmd_t          nullUserCmd;
@@ -109,6 +109,12 @@ typedef struct netstream_s {
     netstate_t  state;
     fifo_t      recv;
     fifo_t      send;
+
+    // statistics
+    size_t      bytes_rcvd;
+    size_t      bytes_sent;
+    unsigned    num_recvs;  // system calls
+    unsigned    num_sends;
 } netstream_t;
 
 static inline qboolean NET_IsEqualAdr(const netadr_t *a, const netadr_t *b)
@@ -238,6 +244,8 @@ qboolean    NET_GetAddress(netsrc_t sock, netadr_t *adr);
 void        NET_GetPackets(netsrc_t sock, void (*packet_cb)(void));
 qboolean    NET_SendPacket(netsrc_t sock, const void *data,
                            size_t len, const netadr_t *to);
+qboolean    NET_SendPacketV(netsrc_t sock, void **data, size_t *len,
+                            int count, const netadr_t *to);
 
 char        *NET_AdrToString(const netadr_t *a);
 qboolean    NET_StringToAdr(const char *s, netadr_t *a, int default_port);
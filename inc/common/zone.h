@@ -63,4 +63,25 @@ char    *Z_ReservedCopyString(const char *in) q_malloc;
 // may return pointer to static memory
 char    *Z_CvarCopyString(const char *in);
 
+// fixed size block pool, carved out of zone allocated slabs that are only
+// released by Z_PoolShutdown
+typedef struct zpool_s {
+    struct zpool_s  *next;
+    const char      *name;
+    memtag_t        tag;
+    size_t          size;       // block size
+    size_t          perslab;    // blocks per slab
+    void            *free;      // free blocks
+    void            *slabs;     // allocated slabs
+    size_t          numslabs;
+    size_t          numused;
+    size_t          peakused;
+    size_t          numallocs;
+} zpool_t;
+
+void    Z_PoolInit(zpool_t *pool, const char *name, size_t size, memtag_t tag);
+void    Z_PoolShutdown(zpool_t *pool);
+void    *Z_PoolAlloc(zpool_t *pool) q_malloc;
+void    Z_PoolFree(zpool_t *pool, void *ptr);
+
 #endif // ZONE_H
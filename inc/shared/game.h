@@ -53,6 +53,8 @@ typedef enum {
 #define GMF_VARIABLE_FPS            0x00000800
 #define GMF_EXTRA_USERINFO          0x00001000
 #define GMF_IPV6_ADDRESS_AWARE      0x00002000
+#define GMF_TRACEBATCH              0x00004000
+#define GMF_LAGCOMP                 0x00008000
 
 //===============================================================
 
@@ -182,6 +184,17 @@ typedef struct {
     void (*AddCommandString)(const char *text);
 
     void (*DebugGraph)(float value, int color);
+
+    // extensions below are only valid if advertised in sv_features
+
+    // GMF_TRACEBATCH: performs count traces of the same box at once
+    void (*tracebatch)(trace_t *traces, vec3_t *starts, vec3_t *ends, int count,
+                       vec3_t mins, vec3_t maxs, edict_t *passent, int contentmask);
+
+    // GMF_LAGCOMP: traces against entity positions as seen by the shooter
+    // client, falls back to normal trace if disabled or shooter is not a client
+    trace_t (* q_gameabi tracelagged)(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end,
+                                      edict_t *passent, int contentmask, edict_t *shooter);
 } game_import_t;
 
 //
@@ -83,6 +83,23 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define Q_STATBUF           struct stat
 #endif
 
+// SIMD code paths, may be disabled from the build configuration
+#ifndef USE_SSE2
+#if (defined __SSE2__) || (defined _M_X64) || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#define USE_SSE2    1
+#else
+#define USE_SSE2    0
+#endif
+#endif
+
+#ifndef USE_AVX2
+#ifdef __AVX2__
+#define USE_AVX2    1
+#else
+#define USE_AVX2    0
+#endif
+#endif
+
 #ifndef F_OK
 #define F_OK    0
 #define X_OK    1
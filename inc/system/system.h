@@ -27,8 +27,17 @@ void    Sys_FreeLibrary(void *handle);
 void    *Sys_GetProcAddress(void *handle, const char *sym);
 
 unsigned    Sys_Milliseconds(void);
+unsigned    Sys_Microseconds(void);
 void    Sys_Sleep(int msec);
 
+// threads may only run self-contained jobs, most of the engine (zone,
+// filesystem, console) is not reentrant
+typedef struct systhread_s systhread_t;
+
+systhread_t *Sys_CreateThread(void (*func)(void *), void *arg);
+void    Sys_JoinThread(systhread_t *thread);
+int     Sys_NumProcessors(void);
+
 void    Sys_Init(void);
 void    Sys_AddDefaultConfig(void);
 
@@ -52,6 +61,15 @@ void    Sys_Quit(void) q_noreturn;
 void    Sys_ListFiles_r(const char *path, const char *filter,
                         unsigned flags, size_t baselen, int *count_p, void **files, int depth);
 
+// calls func for every regular file below path with name relative to baselen,
+// returns false if some directory couldn't be read or was nested too deep
+qboolean Sys_WalkFiles_r(const char *path, size_t baselen,
+                         void (*func)(const char *, void *), void *arg, int depth);
+
+// maps the whole file read-only, returns NULL if mapping is not possible
+void    *Sys_MapFile(FILE *fp, size_t size);
+void    Sys_UnmapFile(void *base, size_t size);
+
 void    Sys_DebugBreak(void);
 
 #if USE_AC_CLIENT
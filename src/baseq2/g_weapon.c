@@ -18,6 +18,22 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "g_local.h"
 
 
+/*
+=================
+fire_trace
+
+Traces a hitscan shot. If the server supports it, clients hit other
+entities where they saw them, not where they are now.
+=================
+*/
+static trace_t fire_trace(edict_t *self, vec3_t start, vec3_t end, edict_t *ignore, int mask)
+{
+    if (self->client && sv_features && (sv_features->integer & GMF_LAGCOMP))
+        return gi.tracelagged(start, NULL, NULL, end, ignore, mask, self);
+
+    return gi.trace(start, NULL, NULL, end, ignore, mask);
+}
+
 /*
 =================
 check_dodge
@@ -152,7 +168,7 @@ static void fire_lead(edict_t *self, vec3_t start, vec3_t aimdir, int damage, in
             content_mask &= ~MASK_WATER;
         }
 
-        tr = gi.trace(start, NULL, NULL, end, self, content_mask);
+        tr = fire_trace(self, start, end, self, content_mask);
 
         // see if we hit water
         if (tr.contents & MASK_WATER) {
@@ -196,7 +212,7 @@ static void fire_lead(edict_t *self, vec3_t start, vec3_t aimdir, int damage, in
             }
 
             // re-trace ignoring water this time
-            tr = gi.trace(water_start, NULL, NULL, end, self, MASK_SHOT);
+            tr = fire_trace(self, water_start, end, self, MASK_SHOT);
         }
     }
 
@@ -627,7 +643,7 @@ void fire_rail(edict_t *self, vec3_t start, vec3_t aimdir, int damage, int kick)
     water = qfalse;
     mask = MASK_SHOT | CONTENTS_SLIME | CONTENTS_LAVA;
     while (ignore) {
-        tr = gi.trace(from, NULL, NULL, end, ignore, mask);
+        tr = fire_trace(self, from, end, ignore, mask);
 
         if (tr.contents & (CONTENTS_SLIME | CONTENTS_LAVA)) {
             mask &= ~(CONTENTS_SLIME | CONTENTS_LAVA);
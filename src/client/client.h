@@ -436,8 +436,14 @@ typedef struct client_static_s {
         int         file_size;
         int         file_offset;
         int         file_percent;
+        int         index_servercount;  // first gamestate identifies the demo
+        int         index_offset;
+        int         index_size;
         sizebuf_t   buffer;
-        list_t      snapshots;
+        struct demosnap_s   **snapshots;    // sorted by frame number
+        int         numsnapshots;
+        char        path[MAX_OSPATH];   // for locating sidecar index
+        qboolean    indexed;            // snapshots were loaded from index
         qboolean    paused;
         qboolean    seeking;
         qboolean    eof;
@@ -731,6 +737,7 @@ void CL_InitTEnts(void);
 void CL_PredictAngles(void);
 void CL_PredictMovement(void);
 void CL_CheckPredictionError(void);
+void CL_BuildSolidList(void);
 
 
 //
@@ -27,6 +27,9 @@ static byte     demo_buffer[MAX_PACKETLEN];
 static cvar_t   *cl_demosnaps;
 static cvar_t   *cl_demomsglen;
 static cvar_t   *cl_demowait;
+static cvar_t   *cl_demoindex;
+
+static void finish_demo_index(void);
 
 // =========================================================================
 
@@ -657,6 +660,9 @@ static int parse_next_message(int wait)
     int ret;
 
     ret = read_next_message(cls.demo.playback);
+    if (ret == 0) {
+        finish_demo_index();
+    }
     if (ret < 0 || (ret == 0 && wait == 0)) {
         finish_demo(ret);
         return -1;
@@ -730,6 +736,7 @@ static void CL_PlayDemo_f(void)
     CL_Disconnect(ERR_RECONNECT);
 
     cls.demo.playback = f;
+    Q_strlcpy(cls.demo.path, name, sizeof(cls.demo.path));
     cls.state = ca_connected;
     Q_strlcpy(cls.servername, COM_SkipPath(name), sizeof(cls.servername));
     cls.serverAddress.type = NA_LOOPBACK;
@@ -754,14 +761,64 @@ static void CL_Demo_c(genctx_t *ctx, int argnum)
     }
 }
 
-typedef struct {
-    list_t entry;
+typedef struct demosnap_s {
     int framenum;
     off_t filepos;
     size_t msglen;
     byte data[1];
 } demosnap_t;
 
+#define SNAPSHOT_CHUNK  64
+
+// keeps snapshot array sorted by frame number
+static void insert_snapshot(demosnap_t *snap)
+{
+    int lo = 0, hi = cls.demo.numsnapshots, mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) >> 1;
+        if (cls.demo.snapshots[mid]->framenum < snap->framenum)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo < cls.demo.numsnapshots && cls.demo.snapshots[lo]->framenum == snap->framenum) {
+        Z_Free(cls.demo.snapshots[lo]);
+        cls.demo.snapshots[lo] = snap;
+        return;
+    }
+
+    if (cls.demo.numsnapshots % SNAPSHOT_CHUNK == 0) {
+        cls.demo.snapshots = Z_Realloc(cls.demo.snapshots,
+                                       sizeof(cls.demo.snapshots[0]) *
+                                       (cls.demo.numsnapshots + SNAPSHOT_CHUNK));
+    }
+
+    memmove(cls.demo.snapshots + lo + 1, cls.demo.snapshots + lo,
+            sizeof(cls.demo.snapshots[0]) * (cls.demo.numsnapshots - lo));
+    cls.demo.snapshots[lo] = snap;
+    cls.demo.numsnapshots++;
+}
+
+static size_t free_snapshots(void)
+{
+    size_t total = 0;
+    int i;
+
+    for (i = 0; i < cls.demo.numsnapshots; i++) {
+        total += cls.demo.snapshots[i]->msglen;
+        Z_Free(cls.demo.snapshots[i]);
+    }
+
+    Z_Free(cls.demo.snapshots);
+    cls.demo.snapshots = NULL;
+    cls.demo.numsnapshots = 0;
+    cls.demo.indexed = qfalse;
+
+    return total;
+}
+
 /*
 ====================
 CL_EmitDemoSnapshot
@@ -839,7 +896,7 @@ void CL_EmitDemoSnapshot(void)
     snap->filepos = pos;
     snap->msglen = msg_write.cursize;
     memcpy(snap->data, msg_write.data, msg_write.cursize);
-    List_Append(&cls.demo.snapshots, &snap->entry);
+    insert_snapshot(snap);
 
     Com_DPrintf("[%d] snaplen %"PRIz"\n", cls.demo.frames_read, msg_write.cursize);
 
@@ -848,22 +905,230 @@ void CL_EmitDemoSnapshot(void)
     cls.demo.last_snapshot = cls.demo.frames_read;
 }
 
+// returns the most recent snapshot at or before the given frame,
+// or the first snapshot if there is none
 static demosnap_t *find_snapshot(int framenum)
 {
-    demosnap_t *snap, *prev;
+    int lo = 0, hi = cls.demo.numsnapshots, mid;
 
-    if (LIST_EMPTY(&cls.demo.snapshots))
+    if (!cls.demo.numsnapshots)
         return NULL;
 
-    prev = LIST_FIRST(demosnap_t, &cls.demo.snapshots, entry);
+    while (lo < hi) {
+        mid = (lo + hi) >> 1;
+        if (cls.demo.snapshots[mid]->framenum > framenum)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
 
-    LIST_FOR_EACH(demosnap_t, snap, &cls.demo.snapshots, entry) {
-        if (snap->framenum > framenum)
-            break;
-        prev = snap;
+    return cls.demo.snapshots[lo ? lo - 1 : 0];
+}
+
+/*
+===============================================================================
+
+DEMO INDEX
+
+Snapshots can be saved into a sidecar file next to the demo, so that seeking
+in a demo played for the first time doesn't require parsing it from the
+beginning. Index file is a header followed by snapshots in frame order.
+
+===============================================================================
+*/
+
+#define DEMO_INDEX_MAGIC    MakeRawLong('D','I','D','X')
+#define DEMO_INDEX_VERSION  1
+
+typedef struct {
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    servercount;    // identifies the demo together with sizes
+    uint32_t    file_offset;
+    uint32_t    file_size;
+    uint32_t    numsnapshots;
+} dindexheader_t;
+
+typedef struct {
+    uint32_t    framenum;
+    uint32_t    filepos;
+    uint32_t    msglen;
+} dindexsnap_t;
+
+static void fill_index_header(dindexheader_t *header)
+{
+    header->magic = DEMO_INDEX_MAGIC;
+    header->version = LittleLong(DEMO_INDEX_VERSION);
+    header->servercount = LittleLong(cls.demo.index_servercount);
+    header->file_offset = LittleLong(cls.demo.index_offset);
+    header->file_size = LittleLong(cls.demo.index_size);
+    header->numsnapshots = LittleLong(cls.demo.numsnapshots);
+}
+
+static qerror_t write_index(qhandle_t f)
+{
+    dindexheader_t header;
+    dindexsnap_t disnap;
+    demosnap_t *snap;
+    ssize_t ret;
+    int i;
+
+    fill_index_header(&header);
+    ret = FS_Write(&header, sizeof(header), f);
+    if (ret != sizeof(header))
+        return ret < 0 ? ret : Q_ERR_FAILURE;
+
+    for (i = 0; i < cls.demo.numsnapshots; i++) {
+        snap = cls.demo.snapshots[i];
+        disnap.framenum = LittleLong(snap->framenum);
+        disnap.filepos = LittleLong(snap->filepos);
+        disnap.msglen = LittleLong(snap->msglen);
+
+        ret = FS_Write(&disnap, sizeof(disnap), f);
+        if (ret != sizeof(disnap))
+            return ret < 0 ? ret : Q_ERR_FAILURE;
+
+        ret = FS_Write(snap->data, snap->msglen, f);
+        if (ret != snap->msglen)
+            return ret < 0 ? ret : Q_ERR_FAILURE;
     }
 
-    return prev;
+    return Q_ERR_SUCCESS;
+}
+
+static void save_demo_index(void)
+{
+    char buffer[MAX_OSPATH];
+    qhandle_t f;
+    qerror_t ret;
+
+    if (Q_concat(buffer, sizeof(buffer), cls.demo.path, ".idx", NULL) >= sizeof(buffer)) {
+        Com_EPrintf("Couldn't write demo index: %s\n", Q_ErrorString(Q_ERR_NAMETOOLONG));
+        return;
+    }
+
+    ret = FS_FOpenFile(buffer, &f, FS_MODE_WRITE);
+    if (!f) {
+        Com_EPrintf("Couldn't open %s for writing: %s\n", buffer, Q_ErrorString(ret));
+        return;
+    }
+
+    ret = write_index(f);
+    FS_FCloseFile(f);
+
+    if (ret) {
+        Com_EPrintf("Couldn't write %s: %s\n", buffer, Q_ErrorString(ret));
+        return;
+    }
+
+    Com_Printf("Wrote %d snapshots to %s.\n", cls.demo.numsnapshots, buffer);
+
+    cls.demo.indexed = qtrue;
+}
+
+static qerror_t read_index(qhandle_t f)
+{
+    dindexheader_t header, check;
+    dindexsnap_t disnap;
+    demosnap_t *snap;
+    size_t msglen;
+    ssize_t ret;
+    int i, framenum, filepos, lastnum, count;
+
+    ret = FS_Read(&header, sizeof(header), f);
+    if (ret != sizeof(header))
+        return ret < 0 ? ret : Q_ERR_UNEXPECTED_EOF;
+
+    if (header.magic != DEMO_INDEX_MAGIC)
+        return Q_ERR_UNKNOWN_FORMAT;
+
+    if (LittleLong(header.version) != DEMO_INDEX_VERSION)
+        return Q_ERR_UNKNOWN_FORMAT;
+
+    // index of a different or modified demo is useless
+    fill_index_header(&check);
+    if (header.servercount != check.servercount ||
+        header.file_offset != check.file_offset ||
+        header.file_size != check.file_size)
+        return Q_ERR_INVALID_FORMAT;
+
+    count = LittleLong(header.numsnapshots);
+    lastnum = INT_MIN;
+    for (i = 0; i < count; i++) {
+        ret = FS_Read(&disnap, sizeof(disnap), f);
+        if (ret != sizeof(disnap))
+            return ret < 0 ? ret : Q_ERR_UNEXPECTED_EOF;
+
+        framenum = LittleLong(disnap.framenum);
+        filepos = LittleLong(disnap.filepos);
+        msglen = LittleLong(disnap.msglen);
+
+        if (framenum <= lastnum || msglen > MAX_MSGLEN)
+            return Q_ERR_INVALID_FORMAT;
+
+        if (filepos < cls.demo.index_offset ||
+            filepos > cls.demo.index_offset + cls.demo.index_size)
+            return Q_ERR_INVALID_FORMAT;
+
+        snap = Z_Malloc(sizeof(*snap) + msglen - 1);
+        snap->framenum = framenum;
+        snap->filepos = filepos;
+        snap->msglen = msglen;
+        insert_snapshot(snap);
+
+        ret = FS_Read(snap->data, msglen, f);
+        if (ret != msglen)
+            return ret < 0 ? ret : Q_ERR_UNEXPECTED_EOF;
+
+        lastnum = framenum;
+    }
+
+    return Q_ERR_SUCCESS;
+}
+
+static void load_demo_index(void)
+{
+    char buffer[MAX_OSPATH];
+    qhandle_t f;
+    qerror_t ret;
+
+    if (Q_concat(buffer, sizeof(buffer), cls.demo.path, ".idx", NULL) >= sizeof(buffer))
+        return;
+
+    FS_FOpenFile(buffer, &f, FS_MODE_READ);
+    if (!f)
+        return;
+
+    ret = read_index(f);
+    FS_FCloseFile(f);
+
+    if (ret) {
+        Com_WPrintf("Ignoring demo index %s: %s\n", buffer, Q_ErrorString(ret));
+        free_snapshots();
+        return;
+    }
+
+    if (!cls.demo.numsnapshots)
+        return;
+
+    Com_DPrintf("Loaded %d snapshots from %s\n", cls.demo.numsnapshots, buffer);
+
+    // don't emit snapshots the index already covers
+    cls.demo.last_snapshot = cls.demo.snapshots[cls.demo.numsnapshots - 1]->framenum;
+    cls.demo.indexed = qtrue;
+}
+
+// called when playback reaches end of file. if the demo was played through
+// without an index, snapshots now cover the entire file, so save them.
+static void finish_demo_index(void)
+{
+    if (!cl_demoindex->integer)
+        return;
+
+    if (cls.demo.indexed || !cls.demo.numsnapshots)
+        return;
+
+    save_demo_index();
 }
 
 /*
@@ -896,60 +1161,33 @@ void CL_FirstDemoFrame(void)
         cls.demo.time_start = Sys_Milliseconds();
     }
 
+    // later gamestates of multi-map demos keep the index and snapshots
+    // already built, which cover them as well
+    if (cls.demo.index_offset) {
+        if (!cls.demo.indexed)
+            cls.demo.last_snapshot = INT_MIN;
+        return;
+    }
+
+    cls.demo.index_servercount = cl.servercount;
+    cls.demo.index_offset = cls.demo.file_offset;
+    cls.demo.index_size = cls.demo.file_size;
+
     // force initial snapshot
     cls.demo.last_snapshot = INT_MIN;
+
+    // pick up snapshots saved by previous playback
+    if (cl_demosnaps->integer > 0 && cls.demo.file_size && !cls.demo.numsnapshots)
+        load_demo_index();
 }
 
-static void CL_Seek_f(void)
+static void seek_demo(int dest, qboolean wait)
 {
     demosnap_t *snap;
-    int i, j, ret, index, frames, dest, prev;
+    int i, j, ret, index, frames, prev;
     char *from, *to;
 
-    if (Cmd_Argc() < 2) {
-        Com_Printf("Usage: %s [+-]<timespec>\n", Cmd_Argv(0));
-        return;
-    }
-
-#if USE_MVD_CLIENT
-    if (sv_running->integer == ss_broadcast) {
-        Cbuf_InsertText(&cmd_buffer, va("mvdseek \"%s\" @@\n", Cmd_Argv(1)));
-        return;
-    }
-#endif
-
-    if (!cls.demo.playback) {
-        Com_Printf("Not playing a demo.\n");
-        return;
-    }
-
-    to = Cmd_Argv(1);
-
-    if (*to == '-' || *to == '+') {
-        // relative to current frame
-        if (!Com_ParseTimespec(to + 1, &frames)) {
-            Com_Printf("Invalid relative timespec.\n");
-            return;
-        }
-        if (*to == '-')
-            frames = -frames;
-        dest = cls.demo.frames_read + frames;
-    } else {
-        // relative to first frame
-        if (!Com_ParseTimespec(to, &dest)) {
-            Com_Printf("Invalid absolute timespec.\n");
-            return;
-        }
-        frames = dest - cls.demo.frames_read;
-    }
-
-    if (!frames)
-        // already there
-        return;
-
-    if (frames > 0 && cls.demo.eof && cl_demowait->integer)
-        // already at end
-        return;
+    frames = dest - cls.demo.frames_read;
 
     // disable effects processing
     cls.demo.seeking = qtrue;
@@ -969,6 +1207,10 @@ static void CL_Seek_f(void)
     if (frames < 0 || cls.demo.last_snapshot > cls.demo.frames_read) {
         snap = find_snapshot(dest);
 
+        // parsing forward from current position is cheaper
+        if (snap && frames > 0 && snap->framenum <= cls.demo.frames_read)
+            snap = NULL;
+
         if (snap) {
             Com_DPrintf("found snap at %d\n", snap->framenum);
             ret = FS_Seek(cls.demo.playback, snap->filepos);
@@ -1007,7 +1249,9 @@ static void CL_Seek_f(void)
     // skip forward to destination frame
     while (cls.demo.frames_read < dest) {
         ret = read_next_message(cls.demo.playback);
-        if (ret == 0 && cl_demowait->integer) {
+        if (ret == 0)
+            finish_demo_index();
+        if (ret == 0 && wait) {
             cls.demo.eof = qtrue;
             break;
         }
@@ -1061,6 +1305,104 @@ done:
     cls.demo.seeking = qfalse;
 }
 
+static void CL_Seek_f(void)
+{
+    int frames, dest;
+    char *to;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s [+-]<timespec>\n", Cmd_Argv(0));
+        return;
+    }
+
+#if USE_MVD_CLIENT
+    if (sv_running->integer == ss_broadcast) {
+        Cbuf_InsertText(&cmd_buffer, va("mvdseek \"%s\" @@\n", Cmd_Argv(1)));
+        return;
+    }
+#endif
+
+    if (!cls.demo.playback) {
+        Com_Printf("Not playing a demo.\n");
+        return;
+    }
+
+    to = Cmd_Argv(1);
+
+    if (*to == '-' || *to == '+') {
+        // relative to current frame
+        if (!Com_ParseTimespec(to + 1, &frames)) {
+            Com_Printf("Invalid relative timespec.\n");
+            return;
+        }
+        if (*to == '-')
+            frames = -frames;
+        dest = cls.demo.frames_read + frames;
+    } else {
+        // relative to first frame
+        if (!Com_ParseTimespec(to, &dest)) {
+            Com_Printf("Invalid absolute timespec.\n");
+            return;
+        }
+        frames = dest - cls.demo.frames_read;
+    }
+
+    if (!frames)
+        // already there
+        return;
+
+    if (frames > 0 && cls.demo.eof && cl_demowait->integer)
+        // already at end
+        return;
+
+    seek_demo(dest, cl_demowait->integer);
+}
+
+/*
+====================
+CL_IndexDemo_f
+
+Parses the rest of the demo in one pass to build snapshots for the entire
+file, saves them into index and returns to the current position.
+====================
+*/
+static void CL_IndexDemo_f(void)
+{
+    int start;
+
+    if (!cls.demo.playback) {
+        Com_Printf("Not playing a demo.\n");
+        return;
+    }
+
+    if (cl_demosnaps->integer <= 0) {
+        Com_Printf("Demo snapshots are disabled.\n");
+        return;
+    }
+
+    if (!cls.demo.file_size || cls.state != ca_active) {
+        Com_Printf("Demo can't be indexed yet.\n");
+        return;
+    }
+
+    if (cls.demo.indexed) {
+        Com_Printf("Demo is already indexed.\n");
+        return;
+    }
+
+    start = cls.demo.frames_read;
+
+    if (!cls.demo.eof)
+        seek_demo(INT_MAX, qtrue);
+
+    // may have been saved already when end of file was reached
+    if (!cls.demo.indexed)
+        save_demo_index();
+
+    if (cls.demo.frames_read != start)
+        seek_demo(start, qtrue);
+}
+
 static void parse_info_string(demoInfo_t *info, int clientNum, int index, const char *string)
 {
     size_t len;
@@ -1178,7 +1520,6 @@ fail:
 
 void CL_CleanupDemos(void)
 {
-    demosnap_t *snap, *next;
     size_t total;
 
     if (cls.demo.recording) {
@@ -1201,18 +1542,11 @@ void CL_CleanupDemos(void)
         }
     }
 
-    total = 0;
-    LIST_FOR_EACH_SAFE(demosnap_t, snap, next, &cls.demo.snapshots, entry) {
-        total += snap->msglen;
-        Z_Free(snap);
-    }
-
+    total = free_snapshots();
     if (total)
         Com_DPrintf("Freed %"PRIz" bytes of snaps\n", total);
 
     memset(&cls.demo, 0, sizeof(cls.demo));
-
-    List_Init(&cls.demo.snapshots);
 }
 
 /*
@@ -1261,6 +1595,7 @@ static const cmdreg_t c_demo[] = {
     { "stop", CL_Stop_f },
     { "suspend", CL_Suspend_f },
     { "seek", CL_Seek_f },
+    { "demoindex", CL_IndexDemo_f },
 
     { NULL }
 };
@@ -1275,9 +1610,9 @@ void CL_InitDemos(void)
     cl_demosnaps = Cvar_Get("cl_demosnaps", "10", 0);
     cl_demomsglen = Cvar_Get("cl_demomsglen", va("%d", MAX_PACKETLEN_WRITABLE_DEFAULT), 0);
     cl_demowait = Cvar_Get("cl_demowait", "0", 0);
+    cl_demoindex = Cvar_Get("cl_demoindex", "0", 0);
 
     Cmd_Register(c_demo);
-    List_Init(&cls.demo.snapshots);
 }
 
 
@@ -392,6 +392,9 @@ void CL_DeltaFrame(void)
         entity_event(state->number);
     }
 
+    // sort solid entities for prediction
+    CL_BuildSolidList();
+
     if (cls.demo.recording && !cls.demo.paused && !cls.demo.seeking && CL_FRAMESYNC) {
         CL_EmitDemoFrame();
     }
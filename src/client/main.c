@@ -3236,7 +3236,13 @@ unsigned CL_Frame(unsigned msec)
     CL_SendCmd();
 
     // predict all unacknowledged movements
-    CL_PredictMovement();
+    if (host_speeds->integer) {
+        time_predict = Sys_Microseconds();
+        CL_PredictMovement();
+        time_predict = Sys_Microseconds() - time_predict;
+    } else {
+        CL_PredictMovement();
+    }
 
     Con_RunConsole();
 
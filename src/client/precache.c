@@ -317,6 +317,47 @@ void CL_SetSky(void)
     R_SetSky(cl.configstrings[CS_SKY], rotate, axis);
 }
 
+/*
+=================
+CL_PrefetchMedia
+
+Queues model and sound files of the level for background loading, so that
+reading and decompressing them overlaps with registration.
+=================
+*/
+static void CL_PrefetchMedia(void)
+{
+    char    buffer[MAX_QPATH];
+    char    *name;
+    int     i;
+
+    for (i = 2; i < MAX_MODELS; i++) {
+        name = cl.configstrings[CS_MODELS + i];
+        if (!name[0]) {
+            break;
+        }
+        if (name[0] == '*' || name[0] == '#') {
+            continue;
+        }
+        FS_PrefetchFile(name);
+    }
+
+    for (i = 1; i < MAX_SOUNDS; i++) {
+        name = cl.configstrings[CS_SOUNDS + i];
+        if (!name[0]) {
+            break;
+        }
+        if (name[0] == '*') {
+            continue;
+        }
+        if (name[0] == '#') {
+            FS_PrefetchFile(name + 1);
+        } else if (Q_concat(buffer, sizeof(buffer), "sound/", name, NULL) < sizeof(buffer)) {
+            FS_PrefetchFile(buffer);
+        }
+    }
+}
+
 /*
 =================
 CL_PrepRefresh
@@ -334,6 +375,9 @@ void CL_PrepRefresh(void)
     if (!cl.mapname[0])
         return;     // no map loaded
 
+    // sounds are registered after refresh, in the same frame
+    CL_PrefetchMedia();
+
     // register models, pics, and skins
     R_BeginRegistration(cl.mapname);
 
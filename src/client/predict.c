@@ -72,18 +72,57 @@ void CL_CheckPredictionError(void)
 }
 
 /*
-====================
-CL_ClipMoveToEntities
+===============================================================================
 
-====================
+SOLID ENTITY BROADPHASE
+
+Absolute bounds of solid entities are computed once per server frame and
+kept sorted by their minimum X coordinate. Traces and point queries only
+clip against the range of entities that can overlap their bounds along X,
+instead of every solid entity. All unacknowledged commands are replayed
+against the same list, so inline model headnodes are looked up only once.
+===============================================================================
 */
-static void CL_ClipMoveToEntities(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, trace_t *tr)
+
+typedef struct {
+    centity_t   *ent;
+    mnode_t     *headnode;      // NULL for bounding boxes
+    vec3_t      absmin, absmax;
+} clipent_t;
+
+static clipent_t    cl_clipents[MAX_PACKET_ENTITIES];
+static int          cl_numclipents;
+static float        cl_clipwidth;   // widest entity along X
+
+static int clipent_cmp(const void *p1, const void *p2)
 {
-    int         i;
-    trace_t     trace;
-    mnode_t     *headnode;
+    const clipent_t *c1 = p1;
+    const clipent_t *c2 = p2;
+
+    if (c1->absmin[0] < c2->absmin[0])
+        return -1;
+    if (c1->absmin[0] > c2->absmin[0])
+        return 1;
+    return 0;
+}
+
+/*
+===================
+CL_BuildSolidList
+
+Called after the list of solid entities has been rebuilt for a new frame.
+===================
+*/
+void CL_BuildSolidList(void)
+{
+    clipent_t   *clip;
     centity_t   *ent;
     mmodel_t    *cmodel;
+    float       radius;
+    int         i, j;
+
+    clip = cl_clipents;
+    cl_clipwidth = 0;
 
     for (i = 0; i < cl.numSolidEntities; i++) {
         ent = cl.solidEntities[i];
@@ -93,19 +132,112 @@ static void CL_ClipMoveToEntities(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t
             cmodel = cl.model_clip[ent->current.modelindex];
             if (!cmodel)
                 continue;
-            headnode = cmodel->headnode;
+            clip->headnode = cmodel->headnode;
+            if (ent->current.angles[0] || ent->current.angles[1] ||
+                ent->current.angles[2]) {
+                // expand for rotation
+                radius = RadiusFromBounds(cmodel->mins, cmodel->maxs);
+                for (j = 0; j < 3; j++) {
+                    clip->absmin[j] = ent->current.origin[j] - radius;
+                    clip->absmax[j] = ent->current.origin[j] + radius;
+                }
+            } else {
+                VectorAdd(ent->current.origin, cmodel->mins, clip->absmin);
+                VectorAdd(ent->current.origin, cmodel->maxs, clip->absmax);
+            }
         } else {
-            headnode = CM_HeadnodeForBox(ent->mins, ent->maxs);
+            clip->headnode = NULL;
+            VectorAdd(ent->current.origin, ent->mins, clip->absmin);
+            VectorAdd(ent->current.origin, ent->maxs, clip->absmax);
+        }
+
+        // same epsilon the server uses when linking entities
+        for (j = 0; j < 3; j++) {
+            clip->absmin[j] -= 1;
+            clip->absmax[j] += 1;
         }
 
+        if (clip->absmax[0] - clip->absmin[0] > cl_clipwidth)
+            cl_clipwidth = clip->absmax[0] - clip->absmin[0];
+
+        clip->ent = ent;
+        clip++;
+    }
+
+    cl_numclipents = clip - cl_clipents;
+    qsort(cl_clipents, cl_numclipents, sizeof(cl_clipents[0]), clipent_cmp);
+}
+
+// returns index of the first entity that may overlap the given X coordinate
+static int CL_FirstClipEntity(float mins)
+{
+    int     lo, hi, mid;
+
+    mins -= cl_clipwidth;
+
+    lo = 0;
+    hi = cl_numclipents;
+    while (lo < hi) {
+        mid = (lo + hi) >> 1;
+        if (cl_clipents[mid].absmin[0] < mins)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/*
+====================
+CL_ClipMoveToEntities
+
+====================
+*/
+static void CL_ClipMoveToEntities(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, trace_t *tr)
+{
+    int         i;
+    trace_t     trace;
+    mnode_t     *headnode;
+    clipent_t   *clip;
+    vec3_t      boxmins, boxmaxs;
+
+    // create the bounding box of the entire move
+    for (i = 0; i < 3; i++) {
+        if (end[i] > start[i]) {
+            boxmins[i] = start[i] + mins[i] - 1;
+            boxmaxs[i] = end[i] + maxs[i] + 1;
+        } else {
+            boxmins[i] = end[i] + mins[i] - 1;
+            boxmaxs[i] = start[i] + maxs[i] + 1;
+        }
+    }
+
+    for (i = CL_FirstClipEntity(boxmins[0]); i < cl_numclipents; i++) {
+        clip = &cl_clipents[i];
+
+        if (clip->absmin[0] > boxmaxs[0])
+            break;      // sorted, nothing else can touch
+
+        if (clip->absmax[0] < boxmins[0]
+            || clip->absmin[1] > boxmaxs[1]
+            || clip->absmin[2] > boxmaxs[2]
+            || clip->absmax[1] < boxmins[1]
+            || clip->absmax[2] < boxmins[2])
+            continue;   // not touching
+
         if (tr->allsolid)
             return;
 
+        headnode = clip->headnode;
+        if (!headnode)
+            headnode = CM_HeadnodeForBox(clip->ent->mins, clip->ent->maxs);
+
         CM_TransformedBoxTrace(&trace, start, end,
                                mins, maxs, headnode,  MASK_PLAYERSOLID,
-                               ent->current.origin, ent->current.angles);
+                               clip->ent->current.origin, clip->ent->current.angles);
 
-        CM_ClipEntity(tr, &trace, (struct edict_s *)ent);
+        CM_ClipEntity(tr, &trace, (struct edict_s *)clip->ent);
     }
 }
 
@@ -133,26 +265,31 @@ static trace_t q_gameabi CL_Trace(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t
 static int CL_PointContents(vec3_t point)
 {
     int         i;
-    centity_t   *ent;
-    mmodel_t    *cmodel;
+    clipent_t   *clip;
     int         contents;
 
     contents = CM_PointContents(point, cl.bsp->nodes);
 
-    for (i = 0; i < cl.numSolidEntities; i++) {
-        ent = cl.solidEntities[i];
+    for (i = CL_FirstClipEntity(point[0]); i < cl_numclipents; i++) {
+        clip = &cl_clipents[i];
+
+        if (clip->absmin[0] > point[0])
+            break;
 
-        if (ent->current.solid != PACKED_BSP) // special value for bmodel
+        if (!clip->headnode) // only inline models have contents
             continue;
 
-        cmodel = cl.model_clip[ent->current.modelindex];
-        if (!cmodel)
+        if (clip->absmax[0] < point[0]
+            || clip->absmin[1] > point[1]
+            || clip->absmin[2] > point[2]
+            || clip->absmax[1] < point[1]
+            || clip->absmax[2] < point[2])
             continue;
 
         contents |= CM_TransformedPointContents(
-                        point, cmodel->headnode,
-                        ent->current.origin,
-                        ent->current.angles);
+                        point, clip->headnode,
+                        clip->ent->current.origin,
+                        clip->ent->current.angles);
     }
 
     return contents;
@@ -18,6 +18,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // snd_dma.c -- main control for any streaming sound output device
 
 #include "sound.h"
+#include "system/system.h"
 
 dma_t       dma;
 
@@ -27,9 +28,490 @@ cvar_t      *s_testsound;
 static cvar_t       *s_direct;
 #endif
 static cvar_t       *s_mixahead;
+static cvar_t       *s_mixthread;
+static cvar_t       *s_null;
 
 static snddmaAPI_t snddma;
 
+/*
+===============================================================================
+
+MIXER THREAD
+
+The main thread keeps spatializing and picking channels and sends changes
+to the mixer thread through a single producer, single consumer command
+queue. Commands are published in batches by DMA_FlushCommands, so that
+the mixer never sees a half updated frame. The mixer thread paints its own
+copy of channels ahead of the playback cursor and owns the DMA buffer.
+
+The mixer thread never prints or shuts down the device by itself. Overruns
+and device errors are recorded and reported by the main thread from
+DMA_CheckMixer.
+
+===============================================================================
+*/
+
+#define MIXER_COMMANDS  4096    // must be power of two
+#define MIXER_MSEC      5
+
+typedef struct {
+    mixcmd_t    cmd;
+    int         index;
+    int         value;
+    channel_t   ch;
+} mixcommand_t;
+
+static struct {
+    systhread_t         *thread;
+    volatile qboolean   quit;
+    qboolean            active;     // DMA_Update runs on mixer thread
+
+    mixcommand_t        cmds[MIXER_COMMANDS];
+    volatile unsigned   head;       // published by main thread
+    volatile unsigned   tail;       // consumed by mixer thread
+    unsigned            write;      // main thread private
+
+    volatile unsigned   fence;
+    unsigned            nextfence;
+
+    channel_t           channels[MAX_CHANNELS];
+
+    // problems for main thread to report
+    volatile unsigned   overruns;
+    volatile qboolean   failed;
+    char                error[MAX_STRING_CHARS];
+
+    // statistics
+    unsigned            paints;
+    unsigned            usec;
+    unsigned            peakusec;
+} mixer;
+
+qboolean DMA_Threaded(void)
+{
+    return mixer.thread != NULL;
+}
+
+// queues command without publishing it
+void DMA_PostCommand(mixcmd_t cmd, const channel_t *ch, int value)
+{
+    mixcommand_t *c;
+
+    if (!mixer.thread)
+        return;
+
+    // wait for the mixer to make room, this only happens if it is stalled
+    while (mixer.write - mixer.tail >= MIXER_COMMANDS) {
+        DMA_FlushCommands();
+        Sys_Sleep(1);
+    }
+
+    c = &mixer.cmds[mixer.write & (MIXER_COMMANDS - 1)];
+    c->cmd = cmd;
+    c->index = ch ? ch - channels : 0;
+    c->value = value;
+    if (ch)
+        c->ch = *ch;
+    mixer.write++;
+}
+
+void DMA_FlushCommands(void)
+{
+    if (!mixer.thread)
+        return;
+
+    // make command contents visible before the new head
+    __sync_synchronize();
+    mixer.head = mixer.write;
+}
+
+// waits until mixer thread has executed all previous commands
+void DMA_SyncMixer(void)
+{
+    unsigned fence;
+
+    if (!mixer.thread)
+        return;
+
+    fence = ++mixer.nextfence;
+    DMA_PostCommand(MIX_FENCE, NULL, fence);
+    DMA_FlushCommands();
+
+    while (mixer.fence != fence)
+        Sys_Sleep(1);
+}
+
+static void MixerClearBuffer(void)
+{
+    snddma.BeginPainting();
+    if (dma.buffer)
+        memset(dma.buffer, dma.samplebits == 8 ? 0x80 : 0, dma.samples * dma.samplebits / 8);
+    snddma.Submit();
+}
+
+// starting time may be already painted over if command arrived late,
+// skip the missed samples to keep looping sounds in phase
+static void MixerStartChannel(channel_t *ch)
+{
+    sfxcache_t *sc = ch->sfx ? ch->sfx->cache : NULL;
+    int skip;
+
+    if (!sc) {
+        memset(ch, 0, sizeof(*ch));
+        return;
+    }
+
+    skip = paintedtime - ch->begin;
+    if (skip > 0) {
+        ch->begin = paintedtime;
+        ch->pos = min(ch->pos + skip, sc->length);
+    }
+}
+
+static void MixerRunCommands(void)
+{
+    mixcommand_t *c;
+    channel_t *ch;
+    unsigned head;
+
+    head = mixer.head;
+    __sync_synchronize();
+
+    while (mixer.tail != head) {
+        c = &mixer.cmds[mixer.tail & (MIXER_COMMANDS - 1)];
+        ch = &mixer.channels[c->index];
+
+        switch (c->cmd) {
+        case MIX_START:
+            *ch = c->ch;
+            MixerStartChannel(ch);
+            break;
+        case MIX_UPDATE:
+            ch->leftvol = c->ch.leftvol;
+            ch->rightvol = c->ch.rightvol;
+            break;
+        case MIX_STOP:
+            memset(ch, 0, sizeof(*ch));
+            break;
+        case MIX_STOPALL:
+            memset(mixer.channels, 0, sizeof(mixer.channels));
+            MixerClearBuffer();
+            break;
+        case MIX_VOLUME:
+            S_BuildScaletable(c->value);
+            break;
+        case MIX_FENCE:
+            mixer.fence = c->value;
+            break;
+        }
+
+        // release the slot after reading it
+        __sync_synchronize();
+        mixer.tail++;
+    }
+}
+
+static void MixerThread(void *arg)
+{
+    unsigned start, usec;
+
+    while (!mixer.quit) {
+        MixerRunCommands();
+
+        // keep running fences until main thread stops us
+        if (mixer.failed) {
+            Sys_Sleep(MIXER_MSEC);
+            continue;
+        }
+
+        start = Sys_Microseconds();
+        DMA_Update();
+        usec = Sys_Microseconds() - start;
+
+        mixer.paints++;
+        mixer.usec += usec;
+        mixer.peakusec = max(mixer.peakusec, usec);
+
+        Sys_Sleep(MIXER_MSEC);
+    }
+
+    // run any pending fences
+    MixerRunCommands();
+}
+
+static void MixerStart(void)
+{
+    if (mixer.thread || !s_mixthread->integer)
+        return;
+
+    memset(mixer.channels, 0, sizeof(mixer.channels));
+    mixer.head = mixer.tail = mixer.write = 0;
+    mixer.fence = mixer.nextfence = 0;
+    mixer.quit = qfalse;
+    mixer.overruns = 0;
+    mixer.failed = qfalse;
+
+    // set before the thread starts painting
+    mixer.active = qtrue;
+    __sync_synchronize();
+
+    mixer.thread = Sys_CreateThread(MixerThread, NULL);
+    if (!mixer.thread) {
+        Com_WPrintf("Couldn't create sound mixer thread\n");
+        mixer.active = qfalse;
+    }
+}
+
+static void MixerStop(void)
+{
+    if (!mixer.thread)
+        return;
+
+    mixer.quit = qtrue;
+    Sys_JoinThread(mixer.thread);
+    mixer.thread = NULL;
+    mixer.active = qfalse;
+}
+
+void DMA_Overrun(const char *msg)
+{
+    if (mixer.active)
+        __sync_fetch_and_add(&mixer.overruns, 1);
+    else
+        Com_DPrintf("%s\n", msg);
+}
+
+// shuts down the device, or leaves it to the main thread
+void DMA_DeviceError(const char *fmt, ...)
+{
+    va_list     argptr;
+
+    if (mixer.active && mixer.failed)
+        return;
+
+    va_start(argptr, fmt);
+    Q_vsnprintf(mixer.error, sizeof(mixer.error), fmt, argptr);
+    va_end(argptr);
+
+    if (mixer.active) {
+        // make the message visible before the flag
+        __sync_synchronize();
+        mixer.failed = qtrue;
+        return;
+    }
+
+    Com_EPrintf("%s", mixer.error);
+    snddma.Shutdown();
+}
+
+/*
+==================
+DMA_CheckMixer
+
+Reports overruns and device errors of the mixer thread. On device error
+the thread is stopped and the main thread continues painting to the shut
+down device, same as without the mixer thread. Called by the main thread
+each frame.
+==================
+*/
+void DMA_CheckMixer(void)
+{
+    unsigned overruns;
+
+    if (!mixer.thread)
+        return;
+
+    overruns = __sync_lock_test_and_set(&mixer.overruns, 0);
+    if (overruns)
+        Com_DPrintf("Sound mixer: %u overruns\n", overruns);
+
+    if (mixer.failed) {
+        MixerStop();
+        Com_EPrintf("%s", mixer.error);
+        snddma.Shutdown();
+    }
+}
+
+#if USE_TESTS
+
+#define MIXERTEST_SAMPLES   (1 << 14)
+
+/*
+================
+S_MixerTest_f
+
+Starts, updates and stops sounds on all channels through the mixer thread
+command queue, fencing the mixer every 10 frames. Meant to be run with
+s_null 1, which needs no sound device. Checks that the mixer keeps painting
+and ends up with all channels stopped.
+================
+*/
+void S_MixerTest_f(void)
+{
+    sfx_t       sfx;
+    sfxcache_t  *sc;
+    channel_t   *ch;
+    int         i, j, frames, errors;
+    unsigned    paints, commands;
+
+    if (!mixer.thread) {
+        Com_Printf("Sound mixer thread is not running.\n");
+        return;
+    }
+
+    frames = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 100;
+    frames = max(frames, 1);
+
+    // test sound is not registered, get rid of anything playing
+    S_StopAllSounds();
+
+    sc = Z_Malloc(sizeof(*sc) + MIXERTEST_SAMPLES * 2);
+    sc->length = MIXERTEST_SAMPLES;
+    sc->loopstart = 0;
+    sc->width = 2;
+    for (i = 0; i < MIXERTEST_SAMPLES * 2; i++)
+        sc->data[i] = rand();
+
+    memset(&sfx, 0, sizeof(sfx));
+    Q_strlcpy(sfx.name, "*mixertest", sizeof(sfx.name));
+    sfx.cache = sc;
+
+    paints = mixer.paints;
+    commands = mixer.write;
+
+    for (i = 0; i < frames; i++) {
+        for (j = 0, ch = channels; j < s_numchannels; j++, ch++) {
+            switch ((i + j) & 3) {
+            case 0:
+                memset(ch, 0, sizeof(*ch));
+                ch->sfx = &sfx;
+                ch->leftvol = j * 7 & 255;
+                ch->rightvol = 255 - ch->leftvol;
+                ch->begin = paintedtime;
+                ch->end = paintedtime + sc->length;
+                DMA_PostCommand(MIX_START, ch, 0);
+                break;
+            case 3:
+                memset(ch, 0, sizeof(*ch));
+                DMA_PostCommand(MIX_STOP, ch, 0);
+                break;
+            default:
+                ch->leftvol = (ch->leftvol + 17) & 255;
+                DMA_PostCommand(MIX_UPDATE, ch, 0);
+                break;
+            }
+        }
+        DMA_FlushCommands();
+
+        if (i % 10 == 9)
+            DMA_SyncMixer();
+
+        Sys_Sleep(1);
+    }
+
+    // waits for the mixer to drop the test sound
+    S_StopAllSounds();
+
+    errors = 0;
+    for (i = 0; i < MAX_CHANNELS; i++) {
+        if (mixer.channels[i].sfx) {
+            Com_EPrintf("Channel %d still playing\n", i);
+            errors++;
+        }
+    }
+    if (mixer.fence != mixer.nextfence) {
+        Com_EPrintf("Fence %u not acknowledged\n", mixer.nextfence);
+        errors++;
+    }
+    if (mixer.failed || mixer.paints == paints) {
+        Com_EPrintf("Mixer didn't paint\n");
+        errors++;
+    }
+
+    Z_Free(sc);
+
+    Com_Printf("%d frames, %u commands, %u paints, %d failures\n",
+               frames, mixer.write - commands, mixer.paints - paints, errors);
+}
+
+#endif // USE_TESTS
+
+/*
+===============================================================================
+
+NULL OUTPUT
+
+Mixes into memory at real time rate without any sound device.
+
+===============================================================================
+*/
+
+static unsigned null_start;
+
+static sndinitstat_t Null_Init(void)
+{
+    switch (s_khz->integer) {
+    case 48:
+        dma.speed = 48000;
+        break;
+    case 44:
+        dma.speed = 44100;
+        break;
+    case 22:
+        dma.speed = 22050;
+        break;
+    default:
+        dma.speed = 11025;
+        break;
+    }
+
+    dma.channels = 2;
+    dma.samples = 0x8000 * dma.channels;
+    dma.submission_chunk = 1;
+    dma.samplebits = 16;
+    dma.buffer = Z_Mallocz(dma.samples * 2);
+    dma.samplepos = 0;
+
+    null_start = Sys_Milliseconds();
+
+    Com_Printf("Using null sound output\n");
+    return SIS_SUCCESS;
+}
+
+static void Null_Shutdown(void)
+{
+    Z_Free(dma.buffer);
+    dma.buffer = NULL;
+}
+
+static void Null_BeginPainting(void)
+{
+    unsigned msec = Sys_Milliseconds() - null_start;
+
+    dma.samplepos = (int)((uint64_t)msec * dma.speed / 1000 * dma.channels) & (dma.samples - 1);
+}
+
+static void Null_Submit(void)
+{
+}
+
+static void Null_FillAPI(snddmaAPI_t *api)
+{
+    api->Init = Null_Init;
+    api->Shutdown = Null_Shutdown;
+    api->BeginPainting = Null_BeginPainting;
+    api->Submit = Null_Submit;
+    api->Activate = NULL;
+}
+
+/*
+===============================================================================
+
+DMA OUTPUT
+
+===============================================================================
+*/
+
 void DMA_SoundInfo(void)
 {
     Com_Printf("%5d channels\n", dma.channels);
@@ -39,6 +521,11 @@ void DMA_SoundInfo(void)
     Com_Printf("%5d submission_chunk\n", dma.submission_chunk);
     Com_Printf("%5d speed\n", dma.speed);
     Com_Printf("%p dma buffer\n", dma.buffer);
+    Com_Printf("%5d painted\n", paintedtime);
+    if (mixer.thread) {
+        Com_Printf("mixer thread: %u paints, %u usec avg, %u usec peak\n",
+                   mixer.paints, mixer.usec / max(mixer.paints, 1), mixer.peakusec);
+    }
 }
 
 qboolean DMA_Init(void)
@@ -48,10 +535,17 @@ qboolean DMA_Init(void)
     s_khz = Cvar_Get("s_khz", "22", CVAR_ARCHIVE | CVAR_SOUND);
     s_mixahead = Cvar_Get("s_mixahead", "0.2", CVAR_ARCHIVE);
     s_testsound = Cvar_Get("s_testsound", "0", 0);
+    s_mixthread = Cvar_Get("s_mixthread", "1", CVAR_SOUND);
+    s_null = Cvar_Get("s_null", "0", CVAR_SOUND);
+
+    if (s_null->integer) {
+        Null_FillAPI(&snddma);
+        ret = snddma.Init();
+    }
 
 #if USE_DSOUND
     s_direct = Cvar_Get("s_direct", "1", CVAR_SOUND);
-    if (s_direct->integer) {
+    if (ret != SIS_SUCCESS && s_direct->integer) {
         DS_FillAPI(&snddma);
         ret = snddma.Init();
         if (ret != SIS_SUCCESS) {
@@ -73,11 +567,14 @@ qboolean DMA_Init(void)
 
     Com_Printf("sound sampling rate: %i\n", dma.speed);
 
+    MixerStart();
+
     return qtrue;
 }
 
 void DMA_Shutdown(void)
 {
+    MixerStop();
     snddma.Shutdown();
     s_numchannels = 0;
 }
@@ -85,8 +582,11 @@ void DMA_Shutdown(void)
 void DMA_Activate(void)
 {
     if (snddma.Activate) {
+        // device buffers may be recreated, keep mixer thread out
+        MixerStop();
         S_StopAllSounds();
         snddma.Activate(s_active);
+        MixerStart();
     }
 }
 
@@ -112,17 +612,14 @@ int DMA_DriftBeginofs(float timeofs)
 
 void DMA_ClearBuffer(void)
 {
-    int     clear;
-
-    if (dma.samplebits == 8)
-        clear = 0x80;
-    else
-        clear = 0;
+    if (mixer.thread) {
+        // wait for it, callers free sounds after stopping them
+        DMA_PostCommand(MIX_STOPALL, NULL, 0);
+        DMA_SyncMixer();
+        return;
+    }
 
-    snddma.BeginPainting();
-    if (dma.buffer)
-        memset(dma.buffer, clear, dma.samples * dma.samplebits / 8);
-    snddma.Submit();
+    MixerClearBuffer();
 }
 
 static int DMA_GetTime(void)
@@ -139,7 +636,13 @@ static int DMA_GetTime(void)
             // time to chop things off to avoid 32 bit limits
             buffers = 0;
             paintedtime = fullsamples;
-            S_StopAllSounds();
+            if (mixer.active) {
+                // main thread notices time going backwards
+                memset(mixer.channels, 0, sizeof(mixer.channels));
+                MixerClearBuffer();
+            } else {
+                S_StopAllSounds();
+            }
         }
     }
     oldsamplepos = dma.samplepos;
@@ -147,6 +650,14 @@ static int DMA_GetTime(void)
     return buffers * fullsamples + dma.samplepos / dma.channels;
 }
 
+/*
+==================
+DMA_Update
+
+Paints ahead of the playback cursor. Called by the main thread each frame,
+or continuously by the mixer thread.
+==================
+*/
 void DMA_Update(void)
 {
     int soundtime, endtime;
@@ -154,7 +665,7 @@ void DMA_Update(void)
 
     snddma.BeginPainting();
 
-    if (!dma.buffer)
+    if (!dma.buffer || mixer.failed)
         return;
 
 // Updates DMA time
@@ -162,7 +673,7 @@ void DMA_Update(void)
 
 // check to make sure that we haven't overshot
     if (paintedtime < soundtime) {
-        Com_DPrintf("S_Update_ : overflow\n");
+        DMA_Overrun("S_Update_ : overflow");
         paintedtime = soundtime;
     }
 
@@ -177,7 +688,7 @@ void DMA_Update(void)
     if (endtime - soundtime > samps)
         endtime = soundtime + samps;
 
-    S_PaintChannels(endtime);
+    S_PaintChannels(mixer.active ? mixer.channels : channels, endtime);
 
     snddma.Submit();
 }
@@ -617,6 +617,10 @@ channel_t *S_PickChannel(int entnum, int entchannel)
 #if USE_OPENAL
     if (s_started == SS_OAL && ch->sfx)
         AL_StopChannel(ch);
+#endif
+#if USE_SNDDMA
+    if (s_started == SS_DMA && ch->sfx)
+        DMA_PostCommand(MIX_STOP, ch, 0);
 #endif
     memset(ch, 0, sizeof(*ch));
 
@@ -800,8 +804,15 @@ void S_IssuePlaysound(playsound_t *ps)
         S_Spatialize(ch);
 #endif
 
+    // mixer thread gets sounds ahead of time and starts them itself
     ch->pos = 0;
-    ch->end = paintedtime + sc->length;
+    ch->begin = max(ps->begin, paintedtime);
+    ch->end = ch->begin + sc->length;
+
+#if USE_SNDDMA
+    if (s_started == SS_DMA)
+        DMA_PostCommand(MIX_START, ch, 0);
+#endif
 
     // free the playsound
     S_FreePlaysound(ps);
@@ -1063,7 +1074,56 @@ static void S_AddLoopSounds(void)
         ch->autosound = qtrue;  // remove next frame
         ch->sfx = sfx;
         ch->pos = paintedtime % sc->length;
+        ch->begin = paintedtime;
         ch->end = paintedtime + sc->length - ch->pos;
+
+        DMA_PostCommand(MIX_START, ch, 0);
+    }
+}
+
+/*
+==================
+S_UpdateThreaded
+
+Mirrors what mixer thread does to the channels, so that S_PickChannel
+sees which ones are still playing, and issues all pending playsounds.
+==================
+*/
+static void S_UpdateThreaded(void)
+{
+    static int  oldpaintedtime;
+    int         i, time = paintedtime;
+    channel_t   *ch;
+    sfxcache_t  *sc;
+    playsound_t *ps;
+
+    DMA_CheckMixer();
+
+    // mixer thread has wrapped the time around and dropped everything
+    if (time < oldpaintedtime)
+        S_StopAllSounds();
+    oldpaintedtime = time;
+
+    ch = channels;
+    for (i = 0; i < s_numchannels; i++, ch++) {
+        if (!ch->sfx || ch->autosound || ch->end > time)
+            continue;
+        sc = ch->sfx->cache;
+        if (sc && sc->loopstart >= 0 && sc->length > sc->loopstart) {
+            while (ch->end <= time) {
+                ch->pos = sc->loopstart;
+                ch->end += sc->length - sc->loopstart;
+            }
+        } else {
+            memset(ch, 0, sizeof(*ch));
+        }
+    }
+
+    while (1) {
+        ps = s_pendingplays.next;
+        if (ps == &s_pendingplays)
+            break;
+        S_IssuePlaysound(ps);
     }
 }
 
@@ -1079,7 +1139,7 @@ Called once each time through the main loop
 void S_Update(void)
 {
 #if USE_SNDDMA
-    int         i;
+    int         i, left, right;
     channel_t   *ch;
 #endif
 
@@ -1120,6 +1180,9 @@ void S_Update(void)
     if (s_volume->modified)
         S_InitScaletable();
 
+    if (DMA_Threaded())
+        S_UpdateThreaded();
+
     // update spatialization for dynamic sounds
     ch = channels;
     for (i = 0; i < s_numchannels; i++, ch++) {
@@ -1127,14 +1190,20 @@ void S_Update(void)
             continue;
         if (ch->autosound) {
             // autosounds are regenerated fresh each frame
+            DMA_PostCommand(MIX_STOP, ch, 0);
             memset(ch, 0, sizeof(*ch));
             continue;
         }
+        left = ch->leftvol;
+        right = ch->rightvol;
         S_Spatialize(ch);         // respatialize channel
         if (!ch->leftvol && !ch->rightvol) {
+            DMA_PostCommand(MIX_STOP, ch, 0);
             memset(ch, 0, sizeof(*ch));
             continue;
         }
+        if (ch->leftvol != left || ch->rightvol != right)
+            DMA_PostCommand(MIX_UPDATE, ch, 0);
     }
 
     // add loopsounds
@@ -1164,7 +1233,10 @@ void S_Update(void)
 #endif
 
 // mix some sound
-    DMA_Update();
+    if (DMA_Threaded())
+        DMA_FlushCommands();
+    else
+        DMA_Update();
 #endif
 }
 
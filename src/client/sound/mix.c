@@ -19,6 +19,12 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "sound.h"
 
+#if USE_AVX2
+#include <immintrin.h>
+#elif USE_SSE2
+#include <emmintrin.h>
+#endif
+
 #define    PAINTBUFFER_SIZE    2048
 
 static int snd_scaletable[32][256];
@@ -27,7 +33,244 @@ static int snd_vol;
 samplepair_t s_rawsamples[S_MAX_RAW_SAMPLES];
 int          s_rawend = 0;
 
-static void WriteLinearBlast(int16_t *out, samplepair_t *samp, int count)
+/*
+===============================================================================
+
+SIMD KERNELS
+
+All kernels produce results bit exact with the scalar code. They return
+number of samples processed, caller finishes the tail with scalar code.
+
+===============================================================================
+*/
+
+#if USE_AVX2
+
+// mixes 8 samples of 32-bit mono data into 8 stereo pairs
+static inline void MixPairs_AVX2(samplepair_t *samp, __m256i data, __m256i vol, int shift)
+{
+    const __m256i idx0 = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+    const __m256i idx1 = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+    __m256i *p = (__m256i *)samp;
+    __m256i v0, v1;
+
+    v0 = _mm256_mullo_epi32(_mm256_permutevar8x32_epi32(data, idx0), vol);
+    v1 = _mm256_mullo_epi32(_mm256_permutevar8x32_epi32(data, idx1), vol);
+    if (shift) {
+        v0 = _mm256_srai_epi32(v0, 8);
+        v1 = _mm256_srai_epi32(v1, 8);
+    }
+    _mm256_storeu_si256(p + 0, _mm256_add_epi32(_mm256_loadu_si256(p + 0), v0));
+    _mm256_storeu_si256(p + 1, _mm256_add_epi32(_mm256_loadu_si256(p + 1), v1));
+}
+
+static int Mix16_SIMD(samplepair_t *samp, const int16_t *sfx, int count,
+                      int leftvol, int rightvol)
+{
+    __m256i vol = _mm256_setr_epi32(leftvol, rightvol, leftvol, rightvol,
+                                    leftvol, rightvol, leftvol, rightvol);
+    __m256i data;
+    int i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        data = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(sfx + i)));
+        MixPairs_AVX2(samp + i, data, vol, 1);
+    }
+
+    return i;
+}
+
+static int Mix8_SIMD(samplepair_t *samp, const uint8_t *sfx, int count,
+                     int leftscale, int rightscale)
+{
+    __m256i vol = _mm256_setr_epi32(leftscale, rightscale, leftscale, rightscale,
+                                    leftscale, rightscale, leftscale, rightscale);
+    __m256i bias = _mm256_set1_epi32(128);
+    __m256i data;
+    int i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        data = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(sfx + i)));
+        MixPairs_AVX2(samp + i, _mm256_sub_epi32(data, bias), vol, 0);
+    }
+
+    return i;
+}
+
+static int Clip16_SIMD(int16_t *out, const samplepair_t *samp, int count)
+{
+    const __m256i *p = (const __m256i *)samp;
+    __m256i a, b;
+    int i;
+
+    for (i = 0; i + 8 <= count; i += 8, p += 2, out += 16) {
+        a = _mm256_srai_epi32(_mm256_loadu_si256(p + 0), 8);
+        b = _mm256_srai_epi32(_mm256_loadu_si256(p + 1), 8);
+        // packs works within 128-bit lanes, restore sample order
+        a = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xd8);
+        _mm256_storeu_si256((__m256i *)out, a);
+    }
+
+    return i;
+}
+
+#elif USE_SSE2
+
+// full 32-bit products of signed 16-bit lanes, in lane order
+static inline void MulWide_SSE2(__m128i a, __m128i b, __m128i *p0, __m128i *p1)
+{
+    __m128i lo = _mm_mullo_epi16(a, b);
+    __m128i hi = _mm_mulhi_epi16(a, b);
+
+    *p0 = _mm_unpacklo_epi16(lo, hi);
+    *p1 = _mm_unpackhi_epi16(lo, hi);
+}
+
+static inline void AddPairs_SSE2(samplepair_t *samp, __m128i v0, __m128i v1)
+{
+    __m128i *p = (__m128i *)samp;
+
+    _mm_storeu_si128(p + 0, _mm_add_epi32(_mm_loadu_si128(p + 0), v0));
+    _mm_storeu_si128(p + 1, _mm_add_epi32(_mm_loadu_si128(p + 1), v1));
+}
+
+// there is no 32-bit multiply in SSE2, so volume is split into bytes:
+// (data * (hi << 8 | lo)) >> 8 == data * hi + ((data * lo) >> 8)
+static inline void MixPairs_SSE2(samplepair_t *samp, __m128i data, __m128i hi, __m128i lo)
+{
+    __m128i h0, h1, l0, l1;
+
+    MulWide_SSE2(data, hi, &h0, &h1);
+    MulWide_SSE2(data, lo, &l0, &l1);
+    AddPairs_SSE2(samp, _mm_add_epi32(h0, _mm_srai_epi32(l0, 8)),
+                        _mm_add_epi32(h1, _mm_srai_epi32(l1, 8)));
+}
+
+static int Mix16_SIMD(samplepair_t *samp, const int16_t *sfx, int count,
+                      int leftvol, int rightvol)
+{
+    __m128i hi = _mm_set_epi16(rightvol >> 8, leftvol >> 8, rightvol >> 8, leftvol >> 8,
+                               rightvol >> 8, leftvol >> 8, rightvol >> 8, leftvol >> 8);
+    __m128i lo = _mm_set_epi16(rightvol & 255, leftvol & 255, rightvol & 255, leftvol & 255,
+                               rightvol & 255, leftvol & 255, rightvol & 255, leftvol & 255);
+    __m128i data;
+    int i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        data = _mm_loadu_si128((const __m128i *)(sfx + i));
+        MixPairs_SSE2(samp + i + 0, _mm_unpacklo_epi16(data, data), hi, lo);
+        MixPairs_SSE2(samp + i + 4, _mm_unpackhi_epi16(data, data), hi, lo);
+    }
+
+    return i;
+}
+
+// scale is (vol >> 3) * 8 * snd_vol, the first factor times (data - 128)
+// always fits into 16 bits, the second one is applied with full precision
+static int Mix8_SIMD(samplepair_t *samp, const uint8_t *sfx, int count,
+                     int leftscale, int rightscale)
+{
+    int lk = leftscale / snd_vol, rk = rightscale / snd_vol;
+    __m128i k = _mm_set_epi16(rk, lk, rk, lk, rk, lk, rk, lk);
+    __m128i vol = _mm_set1_epi16(snd_vol);
+    __m128i bias = _mm_set1_epi16(128);
+    __m128i zero = _mm_setzero_si128();
+    __m128i data, half, v0, v1;
+    int i, j;
+
+    for (i = 0; i + 16 <= count; i += 16) {
+        data = _mm_loadu_si128((const __m128i *)(sfx + i));
+        for (j = 0; j < 2; j++) {
+            half = j ? _mm_unpackhi_epi8(data, zero) : _mm_unpacklo_epi8(data, zero);
+            half = _mm_sub_epi16(half, bias);
+
+            MulWide_SSE2(_mm_mullo_epi16(_mm_unpacklo_epi16(half, half), k), vol, &v0, &v1);
+            AddPairs_SSE2(samp + i + j * 8 + 0, v0, v1);
+
+            MulWide_SSE2(_mm_mullo_epi16(_mm_unpackhi_epi16(half, half), k), vol, &v0, &v1);
+            AddPairs_SSE2(samp + i + j * 8 + 4, v0, v1);
+        }
+    }
+
+    return i;
+}
+
+static int Clip16_SIMD(int16_t *out, const samplepair_t *samp, int count)
+{
+    const __m128i *p = (const __m128i *)samp;
+    __m128i a, b;
+    int i;
+
+    for (i = 0; i + 4 <= count; i += 4, p += 2, out += 8) {
+        a = _mm_srai_epi32(_mm_loadu_si128(p + 0), 8);
+        b = _mm_srai_epi32(_mm_loadu_si128(p + 1), 8);
+        _mm_storeu_si128((__m128i *)out, _mm_packs_epi32(a, b));
+    }
+
+    return i;
+}
+
+#else
+
+#define Mix16_SIMD(samp, sfx, count, leftvol, rightvol)         0
+#define Mix8_SIMD(samp, sfx, count, leftscale, rightscale)      0
+#define Clip16_SIMD(out, samp, count)                           0
+
+#endif
+
+#if USE_SSE2
+
+// resamples 16-bit raw samples into stereo pairs, 4 output samples at once.
+// source positions are computed in float just like the scalar code does,
+// so that rounding is the same.
+static int Resample16_SIMD(samplepair_t *out, const int16_t *data, int channels,
+                           int first, int count, float scale, int volume)
+{
+    __m128i idx = _mm_setr_epi32(first, first + 1, first + 2, first + 3);
+    __m128i four = _mm_set1_epi32(4);
+    __m128 step = _mm_set1_ps(scale);
+    __m128i vol = _mm_set1_epi16(volume);
+    __m128i src, frames, lo, hi;
+    int32_t s[4];
+    int i;
+
+    if (volume < 0 || volume > INT16_MAX)
+        return 0;
+
+    for (i = 0; i + 4 <= count; i += 4, out += 4) {
+        src = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(idx), step));
+        idx = _mm_add_epi32(idx, four);
+
+        if (channels == 2) {
+#if USE_AVX2
+            frames = _mm_i32gather_epi32((const int *)data, src, 4);
+#else
+            _mm_storeu_si128((__m128i *)s, src);
+            frames = _mm_setr_epi32(((const int32_t *)data)[s[0]], ((const int32_t *)data)[s[1]],
+                                    ((const int32_t *)data)[s[2]], ((const int32_t *)data)[s[3]]);
+#endif
+        } else {
+            _mm_storeu_si128((__m128i *)s, src);
+            frames = _mm_setr_epi16(data[s[0]], data[s[0]], data[s[1]], data[s[1]],
+                                    data[s[2]], data[s[2]], data[s[3]], data[s[3]]);
+        }
+
+        lo = _mm_mullo_epi16(frames, vol);
+        hi = _mm_mulhi_epi16(frames, vol);
+        _mm_storeu_si128((__m128i *)out + 0, _mm_unpacklo_epi16(lo, hi));
+        _mm_storeu_si128((__m128i *)out + 1, _mm_unpackhi_epi16(lo, hi));
+    }
+
+    return i;
+}
+
+#else
+
+#define Resample16_SIMD(out, data, channels, first, count, scale, volume)   0
+
+#endif
+
+static void Clip16_C(int16_t *out, const samplepair_t *samp, int count)
 {
     int i, val;
 
@@ -40,6 +283,76 @@ static void WriteLinearBlast(int16_t *out, samplepair_t *samp, int count)
     }
 }
 
+static void Mix16_C(samplepair_t *samp, const int16_t *sfx, int count,
+                    int leftvol, int rightvol)
+{
+    int i, data;
+
+    for (i = 0; i < count; i++, samp++) {
+        data = *sfx++;
+        samp->left += (data * leftvol) >> 8;
+        samp->right += (data * rightvol) >> 8;
+    }
+}
+
+static void Mix8_C(samplepair_t *samp, const uint8_t *sfx, int count,
+                   const int *lscale, const int *rscale)
+{
+    int i, data;
+
+    for (i = 0; i < count; i++, samp++) {
+        data = *sfx++;
+        samp->left += lscale[data];
+        samp->right += rscale[data];
+    }
+}
+
+static void Resample16_C(samplepair_t *out, const int16_t *data, int channels,
+                        int first, int count, float scale, int volume)
+{
+    int i, src;
+
+    for (i = first; i < first + count; i++, out++) {
+        src = (int)(i * scale);
+        if (channels == 2) {
+            out->left = data[src * 2] * volume;
+            out->right = data[src * 2 + 1] * volume;
+        } else {
+            out->left = out->right = data[src] * volume;
+        }
+    }
+}
+
+static void Resample8_C(samplepair_t *out, const uint8_t *data, int channels,
+                        int first, int count, float scale, int volume)
+{
+    int i, src;
+
+    for (i = first; i < first + count; i++, out++) {
+        src = (int)(i * scale);
+        if (channels == 2) {
+            out->left = (data[src * 2] - 128) * volume;
+            out->right = (data[src * 2 + 1] - 128) * volume;
+        } else {
+            out->left = out->right = (data[src] - 128) * volume;
+        }
+    }
+}
+
+static void Resample16(samplepair_t *out, const int16_t *data, int channels,
+                       int first, int count, float scale, int volume)
+{
+    int n = Resample16_SIMD(out, data, channels, first, count, scale, volume);
+    Resample16_C(out + n, data, channels, first + n, count - n, scale, volume);
+}
+
+static void WriteLinearBlast(int16_t *out, samplepair_t *samp, int count)
+{
+    int n = Clip16_SIMD(out, samp, count);
+
+    Clip16_C(out + n * 2, samp + n, count - n);
+}
+
 static void TransferStereo16(samplepair_t *samp, int endtime)
 {
     int lpos;
@@ -130,10 +443,9 @@ CHANNEL MIXING
 
 static void Paint8(channel_t *ch, sfxcache_t *sc, int count, samplepair_t *samp)
 {
-    int data;
     int *lscale, *rscale;
     uint8_t *sfx;
-    int i;
+    int n = 0;
 
     if (ch->leftvol > 255)
         ch->leftvol = 255;
@@ -144,47 +456,49 @@ static void Paint8(channel_t *ch, sfxcache_t *sc, int count, samplepair_t *samp)
     rscale = snd_scaletable[ch->rightvol >> 3];
     sfx = (uint8_t *)sc->data + ch->pos;
 
-    for (i = 0; i < count; i++, samp++) {
-        data = *sfx++;
-        samp->left += lscale[data];
-        samp->right += rscale[data];
-    }
+    // table entries are (data - 128) * scale
+    if (snd_vol)
+        n = Mix8_SIMD(samp, sfx, count, lscale[129], rscale[129]);
+    Mix8_C(samp + n, sfx + n, count - n, lscale, rscale);
 
     ch->pos += count;
 }
 
 static void Paint16(channel_t *ch, sfxcache_t *sc, int count, samplepair_t *samp)
 {
-    int data;
-    int left, right;
     int leftvol, rightvol;
     int16_t *sfx;
-    int i;
+    int n;
 
     leftvol = ch->leftvol * snd_vol;
     rightvol = ch->rightvol * snd_vol;
     sfx = (int16_t *)sc->data + ch->pos;
 
-    for (i = 0; i < count; i++, samp++) {
-        data = *sfx++;
-        left = (data * leftvol) >> 8;
-        right = (data * rightvol) >> 8;
-        samp->left += left;
-        samp->right += right;
-    }
+    n = Mix16_SIMD(samp, sfx, count, leftvol, rightvol);
+    Mix16_C(samp + n, sfx + n, count - n, leftvol, rightvol);
 
     ch->pos += count;
 }
 
-void S_PaintChannels(int endtime)
+/*
+================
+S_PaintChannels
+
+Mixes given channels up to endtime and transfers them to DMA buffer. The
+mixer thread paints its own copy of channels, playsounds are then issued by
+the main thread and channels must not load any sounds.
+================
+*/
+void S_PaintChannels(channel_t *chans, int endtime)
 {
     samplepair_t paintbuffer[PAINTBUFFER_SIZE];
     int i;
     int end;
     channel_t *ch;
     sfxcache_t *sc;
-    int ltime, count;
+    int ltime, count, rawend;
     playsound_t *ps;
+    qboolean threaded = chans != channels;
 
     while (paintedtime < endtime) {
         // if paintbuffer is smaller than DMA buffer
@@ -193,7 +507,7 @@ void S_PaintChannels(int endtime)
             end = paintedtime + PAINTBUFFER_SIZE;
 
         // start any playsounds
-        while (1) {
+        while (!threaded) {
             ps = s_pendingplays.next;
             if (ps == &s_pendingplays)
                 break;    // no more pending sounds
@@ -211,9 +525,9 @@ void S_PaintChannels(int endtime)
         memset(paintbuffer, 0, (end - paintedtime) * sizeof(samplepair_t));
 
         // paint in the channels.
-        ch = channels;
+        ch = chans;
         for (i = 0; i < s_numchannels; i++, ch++) {
-            ltime = paintedtime;
+            ltime = max(paintedtime, ch->begin);
 
             while (ltime < end) {
                 if (!ch->sfx || (!ch->leftvol && !ch->rightvol))
@@ -226,7 +540,7 @@ void S_PaintChannels(int endtime)
                 if (ch->end - ltime < count)
                     count = ch->end - ltime;
 
-                sc = S_LoadSound(ch->sfx);
+                sc = threaded ? ch->sfx->cache : S_LoadSound(ch->sfx);
                 if (!sc)
                     break;
 
@@ -258,10 +572,13 @@ void S_PaintChannels(int endtime)
 
         }
 
-        if (s_rawend >= paintedtime)
+        // samples before the end are complete once it has been read
+        rawend = s_rawend;
+        __sync_synchronize();
+        if (rawend >= paintedtime)
         {
           /* add from the streaming sound source */
-          int stop = (end < s_rawend) ? end : s_rawend;
+          int stop = (end < rawend) ? end : rawend;
 
           for (int i = paintedtime; i < stop; i++)
           {
@@ -277,115 +594,216 @@ void S_PaintChannels(int endtime)
     }
 }
 
-void S_InitScaletable(void)
+void S_BuildScaletable(int vol)
 {
     int        i, j;
     int        scale;
 
-    Cvar_ClampValue(s_volume, 0, 1);
-
-    snd_vol = s_volume->value * 256;
+    snd_vol = vol;
     for (i = 0; i < 32; i++) {
         scale = i * 8 * snd_vol;
         for (j = 0; j < 256; j++) {
             snd_scaletable[i][j] = (j - 128) * scale;
         }
     }
+}
+
+void S_InitScaletable(void)
+{
+    Cvar_ClampValue(s_volume, 0, 1);
+
+    // scale tables are in use by the mixer thread
+    if (DMA_Threaded())
+        DMA_PostCommand(MIX_VOLUME, NULL, s_volume->value * 256);
+    else
+        S_BuildScaletable(s_volume->value * 256);
 
     s_volume->modified = qfalse;
 }
 
+#if USE_TESTS
+
+#define MIXTEST_SAMPLES     (1 << 16)
+
+static sfxcache_t *MixTestCache(int width)
+{
+    sfxcache_t *sc;
+    int i;
+
+    sc = Z_Malloc(sizeof(*sc) + MIXTEST_SAMPLES * width);
+    sc->length = MIXTEST_SAMPLES;
+    sc->loopstart = 0;
+    sc->width = width;
+
+    // white noise with occasional full scale peaks to exercise clipping
+    for (i = 0; i < MIXTEST_SAMPLES * width; i++)
+        sc->data[i] = i % 97 ? rand() : 0x7f;
+
+    return sc;
+}
+
 /*
- * Cinematic streaming and voice over network.
- * This could be used for chat over network, but
- * that would be terrible slow.
- */
-void
-S_RawSamples(int samples, int rate, int width,
-    int channels, byte *data, float volume)
+================
+S_MixTest_f
+
+Mixes noise on a number of channels into a paint buffer without touching
+the sound device. Checks SIMD kernels against scalar code and reports
+mixing, clipping and resampling throughput.
+================
+*/
+void S_MixTest_f(void)
 {
-  if (!s_started) return;
-
-  if (s_rawend < paintedtime)
-    s_rawend = paintedtime;
-
-  // rescale because ogg is always 44100 and dma is configurable via s_khz
-  float scale = (float)rate / dma.speed;
-  int intVolume = (int)(256 * volume);
-
-  if ((channels == 2) && (width == 2))
-  {
-    for (int i = 0; ; i++)
-    {
-      int src = (int)(i * scale);
-
-      if (src >= samples)
-      {
-        break;
-      }
-
-      int dst = s_rawend & (S_MAX_RAW_SAMPLES - 1);
-      s_rawend++;
-      s_rawsamples[dst].left = ((short *)data)[src * 2] * intVolume;
-      s_rawsamples[dst].right = ((short *)data)[src * 2 + 1] * intVolume;
+    static samplepair_t paintbuffer[PAINTBUFFER_SIZE], reference[PAINTBUFFER_SIZE];
+    static int16_t out[PAINTBUFFER_SIZE * 2], outref[PAINTBUFFER_SIZE * 2];
+    static const float rates[2] = { 44100.0f / 22050, 44100.0f / 48000 };
+    sfxcache_t *sc[2];
+    channel_t ch;
+    int numchannels, passes, oldvol, errors, i, j, vol[2];
+    unsigned start, time_mix, time_clip, time_resample;
+    double samples;
+
+    numchannels = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : MAX_CHANNELS;
+    passes = Cmd_Argc() > 2 ? atoi(Cmd_Argv(2)) : 1000;
+    numchannels = max(numchannels, 1);
+    passes = max(passes, 1);
+
+    // keep scale tables of running sound system
+    oldvol = snd_vol;
+    if (!oldvol)
+        S_BuildScaletable(179);
+
+    sc[0] = MixTestCache(2);
+    sc[1] = MixTestCache(1);
+
+    memset(&ch, 0, sizeof(ch));
+    start = Sys_Microseconds();
+    for (i = 0; i < passes; i++) {
+        memset(paintbuffer, 0, sizeof(paintbuffer));
+        for (j = 0; j < numchannels; j++) {
+            // odd channels are 8-bit, positions and volumes vary
+            ch.pos = (i * 977 + j * 131) % (MIXTEST_SAMPLES - PAINTBUFFER_SIZE);
+            ch.leftvol = (j * 53 + i) % 256;
+            ch.rightvol = 255 - ch.leftvol;
+            if (j & 1)
+                Paint8(&ch, sc[1], PAINTBUFFER_SIZE, paintbuffer);
+            else
+                Paint16(&ch, sc[0], PAINTBUFFER_SIZE, paintbuffer);
+        }
     }
-  }
-  else if ((channels == 1) && (width == 2))
-  {
-    for (int i = 0; ; i++)
-    {
-      int src = (int)(i * scale);
-
-      if (src >= samples)
-      {
-        break;
-      }
-
-      int dst = s_rawend & (S_MAX_RAW_SAMPLES - 1);
-      s_rawend++;
-      s_rawsamples[dst].left = ((short *)data)[src] * intVolume;
-      s_rawsamples[dst].right = ((short *)data)[src] * intVolume;
+    time_mix = Sys_Microseconds() - start;
+
+    start = Sys_Microseconds();
+    for (i = 0; i < passes; i++)
+        WriteLinearBlast(out, paintbuffer, PAINTBUFFER_SIZE);
+    time_clip = Sys_Microseconds() - start;
+
+    // repeat the last pass with scalar kernels only
+    memset(reference, 0, sizeof(reference));
+    for (j = 0, i = passes - 1; j < numchannels; j++) {
+        ch.pos = (i * 977 + j * 131) % (MIXTEST_SAMPLES - PAINTBUFFER_SIZE);
+        vol[0] = (j * 53 + i) % 256;
+        vol[1] = 255 - vol[0];
+        if (j & 1)
+            Mix8_C(reference, sc[1]->data + ch.pos, PAINTBUFFER_SIZE,
+                   snd_scaletable[vol[0] >> 3], snd_scaletable[vol[1] >> 3]);
+        else
+            Mix16_C(reference, (int16_t *)sc[0]->data + ch.pos, PAINTBUFFER_SIZE,
+                    vol[0] * snd_vol, vol[1] * snd_vol);
     }
-  }
-  else if ((channels == 2) && (width == 1))
-  {
-    intVolume *= 256;
-
-    for (int i = 0; ; i++)
-    {
-      int src = (int)(i * scale);
-
-      if (src >= samples)
-      {
-        break;
-      }
-
-      int dst = s_rawend & (S_MAX_RAW_SAMPLES - 1);
-      s_rawend++;
-      s_rawsamples[dst].left =
-        (((byte *)data)[src * 2] - 128) * intVolume;
-      s_rawsamples[dst].right =
-        (((byte *)data)[src * 2 + 1] - 128) * intVolume;
+    Clip16_C(outref, reference, PAINTBUFFER_SIZE);
+
+    errors = 0;
+    for (i = 0; i < PAINTBUFFER_SIZE; i++) {
+        if (paintbuffer[i].left != reference[i].left ||
+            paintbuffer[i].right != reference[i].right ||
+            out[i * 2] != outref[i * 2] || out[i * 2 + 1] != outref[i * 2 + 1])
+            errors++;
+    }
+
+    // resample stereo music down and up, mono on odd passes
+    start = Sys_Microseconds();
+    for (i = 0; i < passes; i++) {
+        Resample16(paintbuffer, (int16_t *)sc[0]->data, 2 - (i & 1),
+                   i * 977 % 8192, PAINTBUFFER_SIZE, rates[(i >> 1) & 1], 179);
     }
-  }
-  else if ((channels == 1) && (width == 1))
-  {
-    intVolume *= 256;
-
-    for (int i = 0; ; i++)
-    {
-      int src = (int)(i * scale);
-
-      if (src >= samples)
-      {
-        break;
-      }
-
-      int dst = s_rawend & (S_MAX_RAW_SAMPLES - 1);
-      s_rawend++;
-      s_rawsamples[dst].left = (((byte *)data)[src] - 128) * intVolume;
-      s_rawsamples[dst].right = (((byte *)data)[src] - 128) * intVolume;
+    time_resample = Sys_Microseconds() - start;
+
+    for (i = 0; i < 4; i++) {
+        Resample16(paintbuffer, (int16_t *)sc[0]->data, 2 - (i & 1),
+                   i * 977, PAINTBUFFER_SIZE, rates[i >> 1], 179);
+        Resample16_C(reference, (int16_t *)sc[0]->data, 2 - (i & 1),
+                     i * 977, PAINTBUFFER_SIZE, rates[i >> 1], 179);
+        for (j = 0; j < PAINTBUFFER_SIZE; j++) {
+            if (paintbuffer[j].left != reference[j].left ||
+                paintbuffer[j].right != reference[j].right)
+                errors++;
+        }
     }
-  }
+
+    Z_Free(sc[0]);
+    Z_Free(sc[1]);
+    if (!oldvol)
+        S_BuildScaletable(oldvol);
+
+    samples = (double)passes * PAINTBUFFER_SIZE;
+    Com_Printf("%s kernels, %d channels, %d samples\n",
+               USE_AVX2 ? "AVX2" : USE_SSE2 ? "SSE2" : "scalar",
+               numchannels, passes * PAINTBUFFER_SIZE);
+    Com_Printf("mix  %8.2f M channel samples/sec, %8.2f M output samples/sec\n",
+               samples * numchannels / max(time_mix, 1), samples / max(time_mix, 1));
+    Com_Printf("clip %8.2f M output samples/sec\n", samples / max(time_clip, 1));
+    Com_Printf("resample %4.2f M output samples/sec\n", samples / max(time_resample, 1));
+    Com_Printf("%d mismatches against scalar code\n", errors);
 }
 
+#endif // USE_TESTS
+
+/*
+================
+S_RawSamples
+
+Cinematic streaming and voice over network. Resamples data to the output
+rate and appends it to the raw sample ring, which is painted by
+S_PaintChannels, possibly in the mixer thread.
+================
+*/
+void S_RawSamples(int samples, int rate, int width, int channels, byte *data, float volume)
+{
+    float scale;
+    int i, n, count, end, dst, intVolume;
+
+    if (!s_started)
+        return;
+    if (samples <= 0 || width < 1 || width > 2 || channels < 1 || channels > 2)
+        return;
+
+    end = s_rawend;
+    if (end < paintedtime)
+        end = paintedtime;
+
+    // rescale because ogg is always 44100 and dma is configurable via s_khz
+    scale = (float)rate / dma.speed;
+    intVolume = (int)(256 * volume);
+    if (width == 1)
+        intVolume *= 256;
+
+    // number of output samples that map into the input
+    n = samples / scale;
+    while ((int)(n * scale) < samples)
+        n++;
+    while (n > 0 && (int)((n - 1) * scale) >= samples)
+        n--;
+
+    for (i = 0; i < n; i += count, end += count) {
+        dst = end & (S_MAX_RAW_SAMPLES - 1);
+        count = min(n - i, S_MAX_RAW_SAMPLES - dst);
+        if (width == 2)
+            Resample16(&s_rawsamples[dst], (int16_t *)data, channels, i, count, scale, intVolume);
+        else
+            Resample8_C(&s_rawsamples[dst], data, channels, i, count, scale, intVolume);
+    }
+
+    // publish samples only after they are written
+    __sync_synchronize();
+    s_rawend = end;
+}
@@ -43,8 +43,12 @@
 #include "client/client.h"
 #include "client/sound/sound.h"
 #include "client/sound/ogg.h"
+#include "system/system.h"
 #include "sound.h"
 
+#define OGG_DECODE_USEC 1000     /* Decoding time allowed per frame. */
+#define OGG_MIN_AHEAD 0.1f       /* Ignore the limit below this many seconds. */
+
 qboolean ogg_started = qfalse;   /* Initialization flag. */
 byte *ogg_buffer = 0;            /* File buffer. */
 char ovBuf[4096];                /* Buffer for sound. */
@@ -52,6 +56,7 @@ int ogg_curfile = -1;            /* Index of currently played file. */
 int ovSection = 0;               /* Position in Ogg Vorbis file. */
 ogg_status_t ogg_status = STOP;  /* Status indicator. */
 cvar_t *ogg_volume = 0;          /* Music volume. */
+cvar_t *ogg_readahead = 0;       /* Seconds of music decoded ahead. */
 OggVorbis_File ovFile;           /* Ogg Vorbis file. */
 vorbis_info *ogg_info = 0;       /* Ogg Vorbis file information */
 
@@ -73,6 +78,7 @@ OGG_Init(void)
 
     /* Cvars. */
     ogg_volume = Cvar_Get("ogg_volume", "0.7", CVAR_ARCHIVE);
+    ogg_readahead = Cvar_Get("ogg_readahead", "1", CVAR_ARCHIVE);
 
     /* Console commands. */
     Cmd_AddCommand("ogg_pause", OGG_PauseCmd);
@@ -275,18 +281,29 @@ OGG_Stop(void)
 void
 OGG_Stream(void)
 {
+    unsigned start;
+    int ahead, minahead;
+
     if (!ogg_started)
         return;
 
     if (ogg_status == PLAY)
     {
-        /* Read that number samples into the buffer, that
-           were played since the last call to this function.
-           This keeps the buffer at all times at an "optimal"
-           fill level. */
-        while (paintedtime + S_MAX_RAW_SAMPLES - 2048 > s_rawend)
+        /* Keep the given number of seconds decoded ahead of the
+           mixer, so that music keeps playing through long frames.
+           Decoding is spread over frames to avoid spikes when the
+           buffer is refilled, unless it is about to run dry. */
+        ahead = Cvar_ClampValue(ogg_readahead, 0.1f, 2.5f) * dma.speed;
+        ahead = min(ahead, S_MAX_RAW_SAMPLES - 4096);
+        minahead = OGG_MIN_AHEAD * dma.speed;
+        start = Sys_Microseconds();
+
+        while (paintedtime + ahead > s_rawend)
         {
             if(!ogg_info) return;
+            if (s_rawend - paintedtime > minahead &&
+                Sys_Microseconds() - start > OGG_DECODE_USEC)
+                return;
             OGG_Read();
         }
     }
@@ -69,6 +69,7 @@ typedef struct channel_s {
     sfx_t       *sfx;           // sfx number
     int         leftvol;        // 0-255 volume
     int         rightvol;       // 0-255 volume
+    int         begin;          // don't paint before this time
     int         end;            // end time in global paintsamples
     int         pos;            // sample position in sfx
     int         looping;        // where to loop, -1 = no looping OBSOLETE?
@@ -103,6 +104,16 @@ typedef struct {
 */
 
 #if USE_SNDDMA
+// commands sent from the main thread to the mixer thread
+typedef enum {
+    MIX_START,      // (re)start channel from given state
+    MIX_UPDATE,     // change channel volumes
+    MIX_STOP,       // stop channel
+    MIX_STOPALL,    // stop all channels and clear DMA buffer
+    MIX_VOLUME,     // rebuild scale tables for given volume
+    MIX_FENCE       // acknowledge all previous commands
+} mixcmd_t;
+
 void DMA_SoundInfo(void);
 qboolean DMA_Init(void);
 void DMA_Shutdown(void);
@@ -110,6 +121,11 @@ void DMA_Activate(void);
 int DMA_DriftBeginofs(float timeofs);
 void DMA_ClearBuffer(void);
 void DMA_Update(void);
+qboolean DMA_Threaded(void);
+void DMA_PostCommand(mixcmd_t cmd, const channel_t *ch, int value);
+void DMA_FlushCommands(void);
+void DMA_SyncMixer(void);
+void DMA_CheckMixer(void);
 #endif
 
 #if USE_OPENAL
@@ -157,7 +173,8 @@ extern  vec3_t      listener_right;
 extern  vec3_t      listener_up;
 extern  int         listener_entnum;
 
-#define S_MAX_RAW_SAMPLES 8192
+// big enough for a few seconds of music read ahead
+#define S_MAX_RAW_SAMPLES 0x20000
 extern samplepair_t s_rawsamples[S_MAX_RAW_SAMPLES];
 extern int          s_rawend;
 
@@ -180,7 +197,8 @@ channel_t *S_PickChannel(int entnum, int entchannel);
 void S_IssuePlaysound(playsound_t *ps);
 void S_BuildSoundList(int *sounds);
 #if USE_SNDDMA
+void S_BuildScaletable(int vol);
 void S_InitScaletable(void);
-void S_PaintChannels(int endtime);
+void S_PaintChannels(channel_t *chans, int endtime);
 #endif
 
@@ -243,6 +243,7 @@ LOAD(Brushes)
         out->numsides = numsides;
         out->contents = LittleLong(in->contents);
         out->checkcount = 0;
+        out->checkmask = 0;
     }
 
     return Q_ERR_SUCCESS;
@@ -981,7 +982,8 @@ qerror_t BSP_Load(const char *name, bsp_t **bsp_p)
     //
     // load the file
     //
-    filelen = FS_LoadFile(name, (void **)&buf);
+    // lumps are copied into the hunk, so the file can be read in place
+    filelen = FS_LoadFileEx(name, (void **)&buf, FS_FLAG_VIEW, TAG_FILESYSTEM);
     if (!buf) {
         return filelen;
     }
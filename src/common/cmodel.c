@@ -27,6 +27,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/zone.h"
 #include "system/hunk.h"
 
+#if USE_SSE2
+#include <emmintrin.h>
+#endif
+
 mtexinfo_t nulltexinfo;
 
 static mleaf_t      nullleaf;
@@ -359,40 +363,75 @@ static qboolean trace_ispoint;      // optimized case
 
 /*
 ================
-CM_ClipBoxToBrush
+CM_SideDistances
+
+Computes distances from p1 and p2 to up to 4 consecutive brush sides, with
+planes pushed out apropriately for mins/maxs unless tracing a point.
 ================
 */
-static void CM_ClipBoxToBrush(vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
-                              trace_t *trace, mbrush_t *brush)
+#if USE_SSE2
+static inline void CM_SideDistances(mbrushside_t *side, int count, qboolean ispoint,
+                                    vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
+                                    float *d1, float *d2)
 {
-    int         i, j;
-    cplane_t    *plane, *clipplane;
-    float       dist;
-    float       enterfrac, leavefrac;
-    vec3_t      ofs;
-    float       d1, d2;
-    qboolean    getout, startout;
-    float       f;
-    mbrushside_t    *side, *leadside;
+    __m128  nx, ny, nz, dist, ox, oy, oz, mask, zero;
 
-    enterfrac = -1;
-    leavefrac = 1;
-    clipplane = NULL;
+    // load (normal, dist) of each plane, repeating the last one if
+    // there are less than 4 sides left
+    nx = _mm_loadu_ps(side[0].plane->normal);
+    ny = count > 1 ? _mm_loadu_ps(side[1].plane->normal) : nx;
+    nz = count > 2 ? _mm_loadu_ps(side[2].plane->normal) : ny;
+    dist = count > 3 ? _mm_loadu_ps(side[3].plane->normal) : nz;
+    _MM_TRANSPOSE4_PS(nx, ny, nz, dist);
 
-    if (!brush->numsides)
-        return;
+    if (!ispoint) {
+        // general box case
+        zero = _mm_setzero_ps();
+
+        mask = _mm_cmplt_ps(nx, zero);
+        ox = _mm_or_ps(_mm_and_ps(mask, _mm_set1_ps(maxs[0])),
+                       _mm_andnot_ps(mask, _mm_set1_ps(mins[0])));
+        mask = _mm_cmplt_ps(ny, zero);
+        oy = _mm_or_ps(_mm_and_ps(mask, _mm_set1_ps(maxs[1])),
+                       _mm_andnot_ps(mask, _mm_set1_ps(mins[1])));
+        mask = _mm_cmplt_ps(nz, zero);
+        oz = _mm_or_ps(_mm_and_ps(mask, _mm_set1_ps(maxs[2])),
+                       _mm_andnot_ps(mask, _mm_set1_ps(mins[2])));
+
+        // same operation order as DotProduct for identical results
+        dist = _mm_sub_ps(dist, _mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, nx),
+                                                      _mm_mul_ps(oy, ny)),
+                                           _mm_mul_ps(oz, nz)));
+    }
 
-    getout = qfalse;
-    startout = qfalse;
-    leadside = NULL;
+    _mm_storeu_ps(d1, _mm_sub_ps(_mm_add_ps(_mm_add_ps(
+        _mm_mul_ps(_mm_set1_ps(p1[0]), nx),
+        _mm_mul_ps(_mm_set1_ps(p1[1]), ny)),
+        _mm_mul_ps(_mm_set1_ps(p1[2]), nz)), dist));
+    _mm_storeu_ps(d2, _mm_sub_ps(_mm_add_ps(_mm_add_ps(
+        _mm_mul_ps(_mm_set1_ps(p2[0]), nx),
+        _mm_mul_ps(_mm_set1_ps(p2[1]), ny)),
+        _mm_mul_ps(_mm_set1_ps(p2[2]), nz)), dist));
+}
+#else
+static inline void CM_SideDistances(mbrushside_t *side, int count, qboolean ispoint,
+                                    vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
+                                    float *d1, float *d2)
+{
+    cplane_t    *plane;
+    vec3_t      ofs;
+    float       dist;
+    int         i, j;
 
-    side = brush->firstbrushside;
-    for (i = 0; i < brush->numsides; i++, side++) {
+    if (count > 4)
+        count = 4;
+
+    for (i = 0; i < count; i++, side++) {
         plane = side->plane;
 
         // FIXME: special case for axial
 
-        if (!trace_ispoint) {
+        if (!ispoint) {
             // general box case
 
             // push the plane out apropriately for mins/maxs
@@ -411,8 +450,50 @@ static void CM_ClipBoxToBrush(vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
             dist = plane->dist;
         }
 
-        d1 = DotProduct(p1, plane->normal) - dist;
-        d2 = DotProduct(p2, plane->normal) - dist;
+        d1[i] = DotProduct(p1, plane->normal) - dist;
+        d2[i] = DotProduct(p2, plane->normal) - dist;
+    }
+}
+#endif
+
+/*
+================
+CM_ClipBoxToBrush
+================
+*/
+static void CM_ClipBoxToBrush(vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
+                              trace_t *trace, mbrush_t *brush)
+{
+    int         i;
+    cplane_t    *plane, *clipplane;
+    float       enterfrac, leavefrac;
+    float       dist1[4], dist2[4];
+    float       d1, d2;
+    qboolean    getout, startout;
+    float       f;
+    mbrushside_t    *side, *leadside;
+
+    enterfrac = -1;
+    leavefrac = 1;
+    clipplane = NULL;
+
+    if (!brush->numsides)
+        return;
+
+    getout = qfalse;
+    startout = qfalse;
+    leadside = NULL;
+
+    side = brush->firstbrushside;
+    for (i = 0; i < brush->numsides; i++, side++) {
+        if (!(i & 3)) {
+            CM_SideDistances(side, brush->numsides - i, trace_ispoint,
+                             mins, maxs, p1, p2, dist1, dist2);
+        }
+
+        plane = side->plane;
+        d1 = dist1[i & 3];
+        d2 = dist2[i & 3];
 
         if (d2 > 0)
             getout = qtrue; // endpoint is not in solid
@@ -476,11 +557,8 @@ CM_TestBoxInBrush
 static void CM_TestBoxInBrush(vec3_t mins, vec3_t maxs, vec3_t p1,
                               trace_t *trace, mbrush_t *brush)
 {
-    int         i, j;
-    cplane_t    *plane;
-    float       dist;
-    vec3_t      ofs;
-    float       d1;
+    int         i;
+    float       dist1[4], dist2[4];
     mbrushside_t    *side;
 
     if (!brush->numsides)
@@ -488,30 +566,14 @@ static void CM_TestBoxInBrush(vec3_t mins, vec3_t maxs, vec3_t p1,
 
     side = brush->firstbrushside;
     for (i = 0; i < brush->numsides; i++, side++) {
-        plane = side->plane;
-
-        // FIXME: special case for axial
-
-        // general box case
-
-        // push the plane out apropriately for mins/maxs
-
-        // FIXME: use signbits into 8 way lookup for each mins/maxs
-        for (j = 0; j < 3; j++) {
-            if (plane->normal[j] < 0)
-                ofs[j] = maxs[j];
-            else
-                ofs[j] = mins[j];
+        if (!(i & 3)) {
+            CM_SideDistances(side, brush->numsides - i, qfalse,
+                             mins, maxs, p1, p1, dist1, dist2);
         }
-        dist = DotProduct(ofs, plane->normal);
-        dist = plane->dist - dist;
-
-        d1 = DotProduct(p1, plane->normal) - dist;
 
         // if completely in front of face, no intersection
-        if (d1 > 0)
+        if (dist1[i & 3] > 0)
             return;
-
     }
 
     // inside this brush
@@ -753,6 +815,535 @@ void CM_BoxTrace(trace_t *trace, vec3_t start, vec3_t end,
 }
 
 
+/*
+===============================================================================
+
+BATCHED BOX TRACING
+
+Moves of the same box are traced in groups that walk the node tree together.
+Each move still visits nodes, leafs and brushes in exactly the same order as
+a single CM_BoxTrace would, so results are identical. Brush sides are tested
+against four moves at once.
+
+===============================================================================
+*/
+
+// moves walking the node tree together
+#define TRACE_GROUP     16
+
+// part of a move between two node planes
+typedef struct {
+    float   p1f, p2f;
+    vec3_t  p1, p2;
+    int     move;       // index into group
+} tracefrag_t;
+
+static trace_t  *group_traces[TRACE_GROUP];
+static float    *group_starts[TRACE_GROUP];
+static float    *group_ends[TRACE_GROUP];
+
+/*
+================
+CM_ClipBoxToBrush4
+
+Clips up to 4 moves of the group to the brush. Side distances are computed
+for all moves at once, with the same operation order as CM_ClipBoxToBrush.
+================
+*/
+#if USE_SSE2
+static void CM_ClipBoxToBrush4(mbrush_t *brush, const int *moves, int count)
+{
+    __m128      sx, sy, sz, ex, ey, ez;
+    __m128      nx, ny, nz, dist, d1, d2, zero, eps;
+    __m128      getout, startout, front, enter, leave, update;
+    __m128      enterfrac, leavefrac, f, den;
+    __m128d     lo, hi;
+    __m128i     lead, index;
+    float       *s[4], *e[4];
+    float       ofs[3], dist1;
+    float       enterfracs[4], leavefracs[4];
+    int         leads[4], getouts, startouts, fronts;
+    cplane_t    *plane;
+    mbrushside_t    *side, *leadside;
+    trace_t     *trace;
+    int         i, j;
+
+    if (!brush->numsides)
+        return;
+
+    // repeat the last move if there are less than 4
+    for (i = 0; i < 4; i++) {
+        j = moves[i < count ? i : count - 1];
+        s[i] = group_starts[j];
+        e[i] = group_ends[j];
+    }
+
+    sx = _mm_setr_ps(s[0][0], s[1][0], s[2][0], s[3][0]);
+    sy = _mm_setr_ps(s[0][1], s[1][1], s[2][1], s[3][1]);
+    sz = _mm_setr_ps(s[0][2], s[1][2], s[2][2], s[3][2]);
+    ex = _mm_setr_ps(e[0][0], e[1][0], e[2][0], e[3][0]);
+    ey = _mm_setr_ps(e[0][1], e[1][1], e[2][1], e[3][1]);
+    ez = _mm_setr_ps(e[0][2], e[1][2], e[2][2], e[3][2]);
+
+    zero = _mm_setzero_ps();
+    eps = _mm_castpd_ps(_mm_set1_pd(DIST_EPSILON));
+    getout = startout = front = zero;
+    enterfrac = _mm_set1_ps(-1);
+    leavefrac = _mm_set1_ps(1);
+    lead = _mm_setzero_si128();
+
+    side = brush->firstbrushside;
+    for (i = 0; i < brush->numsides; i++, side++) {
+        plane = side->plane;
+
+        if (!trace_ispoint) {
+            // push the plane out apropriately for mins/maxs
+            for (j = 0; j < 3; j++) {
+                if (plane->normal[j] < 0)
+                    ofs[j] = trace_maxs[j];
+                else
+                    ofs[j] = trace_mins[j];
+            }
+            dist1 = DotProduct(ofs, plane->normal);
+            dist1 = plane->dist - dist1;
+        } else {
+            dist1 = plane->dist;
+        }
+
+        nx = _mm_set1_ps(plane->normal[0]);
+        ny = _mm_set1_ps(plane->normal[1]);
+        nz = _mm_set1_ps(plane->normal[2]);
+        dist = _mm_set1_ps(dist1);
+
+        d1 = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, nx),
+                                              _mm_mul_ps(sy, ny)),
+                                   _mm_mul_ps(sz, nz)), dist);
+        d2 = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, nx),
+                                              _mm_mul_ps(ey, ny)),
+                                   _mm_mul_ps(ez, nz)), dist);
+
+        getout = _mm_or_ps(getout, _mm_cmpgt_ps(d2, zero));
+        startout = _mm_or_ps(startout, _mm_cmpgt_ps(d1, zero));
+
+        // if completely in front of face, no intersection
+        front = _mm_or_ps(front, _mm_and_ps(_mm_cmpgt_ps(d1, zero),
+                                            _mm_cmpge_ps(d2, d1)));
+        if (_mm_movemask_ps(front) == 15)
+            return;
+
+        // crosses face
+        enter = _mm_cmpgt_ps(d1, d2);
+        leave = _mm_andnot_ps(enter, _mm_cmpgt_ps(d2, zero));
+        enter = _mm_and_ps(enter, _mm_cmpgt_ps(d1, zero));
+
+        // fractions are computed in double precision like the scalar code
+        den = _mm_sub_ps(d1, d2);
+        lo = _mm_cvtps_pd(d1);
+        hi = _mm_cvtps_pd(_mm_movehl_ps(d1, d1));
+
+        f = _mm_movelh_ps(
+            _mm_cvtpd_ps(_mm_div_pd(_mm_sub_pd(lo, _mm_castps_pd(eps)),
+                                    _mm_cvtps_pd(den))),
+            _mm_cvtpd_ps(_mm_div_pd(_mm_sub_pd(hi, _mm_castps_pd(eps)),
+                                    _mm_cvtps_pd(_mm_movehl_ps(den, den)))));
+        update = _mm_and_ps(enter, _mm_cmpgt_ps(f, enterfrac));
+        enterfrac = _mm_or_ps(_mm_and_ps(update, f),
+                              _mm_andnot_ps(update, enterfrac));
+        index = _mm_set1_epi32(i);
+        lead = _mm_or_si128(_mm_and_si128(_mm_castps_si128(update), index),
+                            _mm_andnot_si128(_mm_castps_si128(update), lead));
+
+        f = _mm_movelh_ps(
+            _mm_cvtpd_ps(_mm_div_pd(_mm_add_pd(lo, _mm_castps_pd(eps)),
+                                    _mm_cvtps_pd(den))),
+            _mm_cvtpd_ps(_mm_div_pd(_mm_add_pd(hi, _mm_castps_pd(eps)),
+                                    _mm_cvtps_pd(_mm_movehl_ps(den, den)))));
+        update = _mm_and_ps(leave, _mm_cmplt_ps(f, leavefrac));
+        leavefrac = _mm_or_ps(_mm_and_ps(update, f),
+                              _mm_andnot_ps(update, leavefrac));
+    }
+
+    _mm_storeu_ps(enterfracs, enterfrac);
+    _mm_storeu_ps(leavefracs, leavefrac);
+    _mm_storeu_si128((__m128i *)leads, lead);
+    getouts = _mm_movemask_ps(getout);
+    startouts = _mm_movemask_ps(startout);
+    fronts = _mm_movemask_ps(front);
+
+    for (i = 0; i < count; i++) {
+        if (fronts & (1 << i))
+            continue;
+
+        trace = group_traces[moves[i]];
+        if (!(startouts & (1 << i))) {
+            // original point was inside brush
+            trace->startsolid = qtrue;
+            if (!(getouts & (1 << i))) {
+                trace->allsolid = qtrue;
+                if (!map_allsolid_bug->integer) {
+                    // original Q2 didn't set these
+                    trace->fraction = 0;
+                    trace->contents = brush->contents;
+                }
+            }
+            continue;
+        }
+        if (enterfracs[i] < leavefracs[i]) {
+            if (enterfracs[i] > -1 && enterfracs[i] < trace->fraction) {
+                if (enterfracs[i] < 0)
+                    enterfracs[i] = 0;
+                leadside = brush->firstbrushside + leads[i];
+                trace->fraction = enterfracs[i];
+                trace->plane = *leadside->plane;
+                trace->surface = &(leadside->texinfo->c);
+                trace->contents = brush->contents;
+            }
+        }
+    }
+}
+#else
+static void CM_ClipBoxToBrush4(mbrush_t *brush, const int *moves, int count)
+{
+    int     i;
+
+    for (i = 0; i < count; i++) {
+        CM_ClipBoxToBrush(trace_mins, trace_maxs, group_starts[moves[i]],
+                          group_ends[moves[i]], group_traces[moves[i]], brush);
+    }
+}
+#endif
+
+/*
+================
+CM_TraceToLeafN
+================
+*/
+static void CM_TraceToLeafN(mleaf_t *leaf, tracefrag_t *frags, int numfrags)
+{
+    int         i, k, count;
+    int         moves[TRACE_GROUP];
+    unsigned    active, mask;
+    mbrush_t    *b, **leafbrush;
+
+    if (!(leaf->contents & trace_contents))
+        return;
+
+    active = 0;
+    for (i = 0; i < numfrags; i++)
+        active |= 1U << frags[i].move;
+
+    // trace lines against all brushes in the leaf
+    leafbrush = leaf->firstleafbrush;
+    for (k = 0; k < leaf->numleafbrushes; k++, leafbrush++) {
+        b = *leafbrush;
+        if (b->checkcount != checkcount) {
+            b->checkcount = checkcount;
+            b->checkmask = 0;
+        }
+
+        // skip moves that already checked this brush in another leaf
+        mask = active & ~b->checkmask;
+        if (!mask)
+            continue;
+        b->checkmask |= mask;
+
+        if (!(b->contents & trace_contents))
+            continue;
+
+        for (i = count = 0; i < TRACE_GROUP; i++) {
+            if (mask & (1U << i))
+                moves[count++] = i;
+        }
+        for (i = 0; i < count; i += 4) {
+            if (count - i == 1) {
+                // single move is faster tested 4 sides at a time
+                CM_ClipBoxToBrush(trace_mins, trace_maxs, group_starts[moves[i]],
+                                  group_ends[moves[i]], group_traces[moves[i]], b);
+                break;
+            }
+            CM_ClipBoxToBrush4(b, moves + i, min(count - i, 4));
+        }
+
+        for (i = 0; i < count; i++) {
+            if (!group_traces[moves[i]]->fraction)
+                active &= ~(1U << moves[i]);
+        }
+        if (!active)
+            return;
+    }
+}
+
+/*
+==================
+CM_RecursiveHullCheckN
+
+Walks the node tree with all fragments at once. Moves that cross a node are
+split, near parts of all moves are visited before far parts, so that every
+move sees leafs in the same order as CM_RecursiveHullCheck.
+==================
+*/
+static void CM_RecursiveHullCheckN(mnode_t *node, tracefrag_t *frags, int numfrags)
+{
+    tracefrag_t sub[TRACE_GROUP], *frag, *out;
+    float       frac[TRACE_GROUP], frac2[TRACE_GROUP];
+    int         sides[TRACE_GROUP], counts[4];
+    cplane_t    *plane;
+    float       t1, t2, offset;
+    float       idist, midf;
+    int         i, j, n;
+
+    // drop moves that already hit something nearer
+    for (i = j = 0; i < numfrags; i++) {
+        if (group_traces[frags[i].move]->fraction > frags[i].p1f)
+            frags[j++] = frags[i];
+    }
+    numfrags = j;
+    if (!numfrags)
+        return;
+
+recheck:
+    // if plane is NULL, we are in a leaf node
+    plane = node->plane;
+    if (!plane) {
+        CM_TraceToLeafN((mleaf_t *)node, frags, numfrags);
+        return;
+    }
+
+    // offset for the size of the box is the same for all moves
+    if (plane->type < 3)
+        offset = trace_extents[plane->type];
+    else if (trace_ispoint)
+        offset = 0;
+    else
+        offset = fabs(trace_extents[0] * plane->normal[0]) +
+                 fabs(trace_extents[1] * plane->normal[1]) +
+                 fabs(trace_extents[2] * plane->normal[2]);
+
+    // see which sides we need to consider:
+    // 0 = front, 1 = back, 2 = front then back, 3 = back then front
+    counts[0] = counts[1] = counts[2] = counts[3] = 0;
+    for (i = 0, frag = frags; i < numfrags; i++, frag++) {
+        if (plane->type < 3) {
+            t1 = frag->p1[plane->type] - plane->dist;
+            t2 = frag->p2[plane->type] - plane->dist;
+        } else {
+            t1 = PlaneDiff(frag->p1, plane);
+            t2 = PlaneDiff(frag->p2, plane);
+        }
+
+        if (t1 >= offset && t2 >= offset) {
+            sides[i] = 0;
+        } else if (t1 < -offset && t2 < -offset) {
+            sides[i] = 1;
+        } else if (t1 < t2) {
+            // put the crosspoint DIST_EPSILON pixels on the near side
+            idist = 1.0 / (t1 - t2);
+            sides[i] = 3;
+            frac2[i] = (t1 + offset + DIST_EPSILON) * idist;
+            frac[i] = (t1 - offset + DIST_EPSILON) * idist;
+        } else if (t1 > t2) {
+            idist = 1.0 / (t1 - t2);
+            sides[i] = 2;
+            frac2[i] = (t1 - offset - DIST_EPSILON) * idist;
+            frac[i] = (t1 + offset + DIST_EPSILON) * idist;
+        } else {
+            sides[i] = 2;
+            frac[i] = 1;
+            frac2[i] = 0;
+        }
+        counts[sides[i]]++;
+    }
+
+    if (counts[0] == numfrags) {
+        node = node->children[0];
+        goto recheck;
+    }
+    if (counts[1] == numfrags) {
+        node = node->children[1];
+        goto recheck;
+    }
+
+    // move up to the node
+    for (j = 0; j < 2; j++) {
+        for (i = n = 0, frag = frags; i < numfrags; i++, frag++) {
+            if (sides[i] == j) {
+                sub[n++] = *frag;
+            } else if (sides[i] == j + 2) {
+                clamp(frac[i], 0, 1);
+                out = &sub[n++];
+                midf = frag->p1f + (frag->p2f - frag->p1f) * frac[i];
+                out->p1f = frag->p1f;
+                out->p2f = midf;
+                VectorCopy(frag->p1, out->p1);
+                LerpVector(frag->p1, frag->p2, frac[i], out->p2);
+                out->move = frag->move;
+            }
+        }
+        if (n)
+            CM_RecursiveHullCheckN(node->children[j], sub, n);
+    }
+
+    // go past the node
+    for (j = 0; j < 2; j++) {
+        for (i = n = 0, frag = frags; i < numfrags; i++, frag++) {
+            if (sides[i] == j + 2) {
+                clamp(frac2[i], 0, 1);
+                out = &sub[n++];
+                midf = frag->p1f + (frag->p2f - frag->p1f) * frac2[i];
+                out->p1f = midf;
+                out->p2f = frag->p2f;
+                LerpVector(frag->p1, frag->p2, frac2[i], out->p1);
+                VectorCopy(frag->p2, out->p2);
+                out->move = frag->move;
+            }
+        }
+        if (n)
+            CM_RecursiveHullCheckN(node->children[j ^ 1], sub, n);
+    }
+}
+
+/*
+==================
+CM_BoxTraceGroup
+==================
+*/
+static void CM_BoxTraceGroup(trace_t **traces, float **starts, float **ends,
+                             int count, mnode_t *headnode)
+{
+    tracefrag_t frags[TRACE_GROUP];
+    trace_t     *trace;
+    int         i;
+
+    checkcount++;       // for multi-check avoidance
+
+    for (i = 0; i < count; i++) {
+        // fill in a default trace
+        trace = group_traces[i] = traces[i];
+        memset(trace, 0, sizeof(*trace));
+        trace->fraction = 1;
+        trace->surface = &(nulltexinfo.c);
+
+        group_starts[i] = starts[i];
+        group_ends[i] = ends[i];
+
+        frags[i].p1f = 0;
+        frags[i].p2f = 1;
+        VectorCopy(starts[i], frags[i].p1);
+        VectorCopy(ends[i], frags[i].p2);
+        frags[i].move = i;
+    }
+
+    //
+    // general sweeping through world
+    //
+    CM_RecursiveHullCheckN(headnode, frags, count);
+
+    for (i = 0; i < count; i++) {
+        trace = traces[i];
+        if (trace->fraction == 1)
+            VectorCopy(ends[i], trace->endpos);
+        else
+            LerpVector(starts[i], ends[i], trace->fraction, trace->endpos);
+    }
+}
+
+typedef struct {
+    mleaf_t *leaf;
+    int     index;
+} traceorder_t;
+
+static int traceordercmp(const void *p1, const void *p2)
+{
+    const traceorder_t *a = p1, *b = p2;
+
+    if (a->leaf != b->leaf)
+        return a->leaf < b->leaf ? -1 : 1;
+
+    return a->index - b->index;
+}
+
+/*
+==================
+CM_BoxTraceN
+
+Traces multiple moves of the same box through the model. Moves are sorted by
+the leaf they start in and traced in groups that share the node walk.
+Results are identical to calling CM_BoxTrace for each move.
+==================
+*/
+void CM_BoxTraceN(trace_t *traces, vec3_t *starts, vec3_t *ends, int count,
+                  vec3_t mins, vec3_t maxs,
+                  mnode_t *headnode, int brushmask)
+{
+    traceorder_t    order[CM_MAX_TRACEBATCH];
+    trace_t         *gtraces[TRACE_GROUP];
+    float           *gstarts[TRACE_GROUP];
+    float           *gends[TRACE_GROUP];
+    int             i, j, k, n, numgroup;
+
+    if (!headnode) {
+        for (i = 0; i < count; i++)
+            CM_BoxTrace(&traces[i], starts[i], ends[i], mins, maxs, headnode, brushmask);
+        return;
+    }
+
+    for (i = 0; i < count; i += n) {
+        n = min(count - i, CM_MAX_TRACEBATCH);
+
+        for (j = 0; j < n; j++) {
+            // moves often share the start point
+            if (j && VectorCompare(starts[i + j], starts[i + j - 1]))
+                order[j].leaf = order[j - 1].leaf;
+            else
+                order[j].leaf = BSP_PointLeaf(headnode, starts[i + j]);
+            order[j].index = i + j;
+        }
+
+        qsort(order, n, sizeof(order[0]), traceordercmp);
+
+        // state shared by all groups
+        trace_contents = brushmask;
+        VectorCopy(mins, trace_mins);
+        VectorCopy(maxs, trace_maxs);
+
+        //
+        // check for point special case
+        //
+        if (mins[0] == 0 && mins[1] == 0 && mins[2] == 0
+            && maxs[0] == 0 && maxs[1] == 0 && maxs[2] == 0) {
+            trace_ispoint = qtrue;
+            VectorClear(trace_extents);
+        } else {
+            trace_ispoint = qfalse;
+            trace_extents[0] = -mins[0] > maxs[0] ? -mins[0] : maxs[0];
+            trace_extents[1] = -mins[1] > maxs[1] ? -mins[1] : maxs[1];
+            trace_extents[2] = -mins[2] > maxs[2] ? -mins[2] : maxs[2];
+        }
+
+        for (j = numgroup = 0; j < n; j++) {
+            k = order[j].index;
+            if (VectorCompare(starts[k], ends[k])) {
+                // position test special case
+                CM_BoxTrace(&traces[k], starts[k], ends[k], mins, maxs,
+                            headnode, brushmask);
+                continue;
+            }
+
+            gtraces[numgroup] = &traces[k];
+            gstarts[numgroup] = starts[k];
+            gends[numgroup] = ends[k];
+            if (++numgroup == TRACE_GROUP) {
+                CM_BoxTraceGroup(gtraces, gstarts, gends, numgroup, headnode);
+                numgroup = 0;
+            }
+        }
+
+        if (numgroup)
+            CM_BoxTraceGroup(gtraces, gstarts, gends, numgroup, headnode);
+    }
+}
+
+
 /*
 ==================
 CM_TransformedBoxTrace
@@ -27,6 +27,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/cmodel.h"
 #include "common/common.h"
 #include "common/cvar.h"
+#include "common/demoparse.h"
 #include "common/error.h"
 #include "common/field.h"
 #include "common/fifo.h"
@@ -124,6 +125,7 @@ unsigned    time_before_game;
 unsigned    time_after_game;
 unsigned    time_before_ref;
 unsigned    time_after_ref;
+unsigned    time_predict;   // in microseconds
 #endif
 
 /*
@@ -1011,6 +1013,7 @@ void Qcommon_Init(int argc, char **argv)
     CM_Init();
     SV_Init();
     CL_Init();
+    DP_Init();
     TST_Init();
 
     Sys_RunConsole();
@@ -1128,6 +1131,8 @@ void Qcommon_Frame(void)
 
     NET_UpdateStats();
 
+    FS_RunAsync();
+
     remaining = SV_Frame(msec);
 
 #if USE_CLIENT
@@ -1154,8 +1159,8 @@ void Qcommon_Frame(void)
         sv -= gm;
         cl -= rf;
 
-        Com_Printf("all:%3i ev:%3i sv:%3i gm:%3i cl:%3i rf:%3i\n",
-                   all, ev, sv, gm, cl, rf);
+        Com_Printf("all:%3i ev:%3i sv:%3i gm:%3i cl:%3i rf:%3i pr:%5.2f\n",
+                   all, ev, sv, gm, cl, rf, time_predict * 0.001f);
     }
 #endif
 }
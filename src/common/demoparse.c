@@ -0,0 +1,1078 @@
+/*
+Copyright (C) 2003-2008 Andrey Nazarov
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+//
+// demoparse.c -- reentrant .dm2 and .mvd2 parser and batch analysis
+//
+// Unlike the client and MVD parsers this one doesn't reconstruct the game
+// state, it only walks the messages and gathers statistics. It doesn't use
+// msg_read, zone or filesystem while parsing, so that many demos can be
+// processed in parallel.
+//
+
+#include "shared/shared.h"
+#include "common/cmd.h"
+#include "common/cmodel.h"
+#include "common/common.h"
+#include "common/demoparse.h"
+#include "common/files.h"
+#include "common/protocol.h"
+#include "common/zone.h"
+#include "system/system.h"
+
+#if USE_ZLIB
+#include <zlib.h>
+#endif
+
+#define MAX_SCAN_THREADS    64
+
+struct demoparse_s {
+#if USE_ZLIB
+    gzFile          file;
+#else
+    FILE            *file;
+#endif
+    demosummary_t   *sum;
+    byte            *data;
+    size_t          cursize;
+    size_t          readcount;
+    int             protocol;
+    byte            buffer[MAX_MSGLEN];
+};
+
+/*
+==============================================================================
+
+MESSAGE READING
+
+Reading past the end of message is sticky: readcount stays past cursize and
+is checked after each command.
+
+==============================================================================
+*/
+
+static inline const byte *dp_skip(demoparse_t *dp, size_t len)
+{
+    const byte *buf = dp->data + dp->readcount;
+
+    dp->readcount += len;
+    if (dp->readcount > dp->cursize) {
+        dp->readcount = dp->cursize + 1;
+        return NULL;
+    }
+
+    return buf;
+}
+
+static inline int dp_byte(demoparse_t *dp)
+{
+    const byte *buf = dp_skip(dp, 1);
+
+    return buf ? buf[0] : -1;
+}
+
+static inline int dp_short(demoparse_t *dp)
+{
+    const byte *buf = dp_skip(dp, 2);
+
+    return buf ? (int16_t)(buf[0] | (buf[1] << 8)) : -1;
+}
+
+static inline int dp_word(demoparse_t *dp)
+{
+    const byte *buf = dp_skip(dp, 2);
+
+    return buf ? (uint16_t)(buf[0] | (buf[1] << 8)) : -1;
+}
+
+static inline int dp_long(demoparse_t *dp)
+{
+    const byte *buf = dp_skip(dp, 4);
+
+    return buf ? (int32_t)(buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24)) : -1;
+}
+
+static size_t dp_string(demoparse_t *dp, char *dest, size_t size)
+{
+    size_t len = 0;
+    int c;
+
+    while (1) {
+        c = dp_byte(dp);
+        if (c <= 0)
+            break;
+        if (len + 1 < size)
+            dest[len] = c;
+        len++;
+    }
+
+    if (size)
+        dest[min(len, size - 1)] = 0;
+
+    return len;
+}
+
+static inline qboolean dp_overflowed(demoparse_t *dp)
+{
+    return dp->readcount > dp->cursize;
+}
+
+/*
+==============================================================================
+
+DELTA SKIPPING
+
+==============================================================================
+*/
+
+typedef struct {
+    int     bits;
+    int     size;
+} dfield_t;
+
+// protocol 34 and MVD entity fields, without any protocol extensions
+static const dfield_t entity_fields[] = {
+    { U_MODEL, 1 },
+    { U_MODEL2, 1 },
+    { U_MODEL3, 1 },
+    { U_MODEL4, 1 },
+    { U_FRAME8, 1 },
+    { U_FRAME16, 2 },
+    { U_SKIN8, 1 },
+    { U_SKIN16, 2 },
+    { U_EFFECTS8, 1 },
+    { U_EFFECTS16, 2 },
+    { U_RENDERFX8, 1 },
+    { U_RENDERFX16, 2 },
+    { U_ORIGIN1, 2 },
+    { U_ORIGIN2, 2 },
+    { U_ORIGIN3, 2 },
+    { U_ANGLE1, 1 },
+    { U_ANGLE2, 1 },
+    { U_ANGLE3, 1 },
+    { U_OLDORIGIN, 6 },
+    { U_SOUND, 1 },
+    { U_EVENT, 1 },
+    { U_SOLID, 2 }
+};
+
+// both bits of a pair set means a 32-bit value instead of 8 + 16 bits
+static const int entity_longs[] = {
+    U_SKIN8 | U_SKIN16,
+    U_EFFECTS8 | U_EFFECTS16,
+    U_RENDERFX8 | U_RENDERFX16
+};
+
+static const dfield_t player_fields[] = {
+    { PS_M_TYPE, 1 },
+    { PS_M_ORIGIN, 6 },
+    { PS_M_VELOCITY, 6 },
+    { PS_M_TIME, 1 },
+    { PS_M_FLAGS, 1 },
+    { PS_M_GRAVITY, 2 },
+    { PS_M_DELTA_ANGLES, 6 },
+    { PS_VIEWOFFSET, 3 },
+    { PS_VIEWANGLES, 6 },
+    { PS_KICKANGLES, 3 },
+    { PS_WEAPONINDEX, 1 },
+    { PS_WEAPONFRAME, 7 },
+    { PS_BLEND, 4 },
+    { PS_FOV, 1 },
+    { PS_RDFLAGS, 1 }
+};
+
+static const dfield_t packet_fields[] = {
+    { PPS_M_TYPE, 1 },
+    { PPS_M_ORIGIN, 4 },
+    { PPS_M_ORIGIN2, 2 },
+    { PPS_VIEWOFFSET, 3 },
+    { PPS_VIEWANGLES, 4 },
+    { PPS_VIEWANGLE2, 2 },
+    { PPS_KICKANGLES, 3 },
+    { PPS_WEAPONINDEX, 1 },
+    { PPS_WEAPONFRAME, 1 },
+    { PPS_GUNOFFSET, 3 },
+    { PPS_GUNANGLES, 3 },
+    { PPS_BLEND, 4 },
+    { PPS_FOV, 1 },
+    { PPS_RDFLAGS, 1 }
+};
+
+static void skip_fields(demoparse_t *dp, const dfield_t *fields, int count, int bits)
+{
+    size_t len = 0;
+    int i;
+
+    for (i = 0; i < count; i++)
+        if (bits & fields[i].bits)
+            len += fields[i].size;
+
+    dp_skip(dp, len);
+}
+
+static void skip_stats(demoparse_t *dp)
+{
+    int i, statbits = dp_long(dp);
+    size_t len = 0;
+
+    for (i = 0; i < MAX_STATS; i++)
+        if (statbits & (1 << i))
+            len += 2;
+
+    dp_skip(dp, len);
+}
+
+// returns entity number, -1 on error
+static int skip_entity(demoparse_t *dp)
+{
+    int bits, number, i;
+
+    bits = dp_byte(dp);
+    if (bits & U_MOREBITS1)
+        bits |= dp_byte(dp) << 8;
+    if (bits & U_MOREBITS2)
+        bits |= dp_byte(dp) << 16;
+    if (bits & U_MOREBITS3)
+        bits |= dp_byte(dp) << 24;
+
+    if (bits & U_NUMBER16)
+        number = dp_short(dp);
+    else
+        number = dp_byte(dp);
+
+    if (number < 0 || number >= MAX_EDICTS || dp_overflowed(dp))
+        return -1;
+
+    if (number) {
+        skip_fields(dp, entity_fields, q_countof(entity_fields), bits);
+        for (i = 0; i < q_countof(entity_longs); i++)
+            if ((bits & entity_longs[i]) == entity_longs[i])
+                dp_skip(dp, 1);
+    }
+
+    return number;
+}
+
+static qboolean skip_packet_entities(demoparse_t *dp)
+{
+    int number;
+
+    while (1) {
+        number = skip_entity(dp);
+        if (number < 0)
+            return qfalse;
+        if (!number)
+            return qtrue;
+        dp->sum->entities++;
+    }
+}
+
+static void skip_sound(demoparse_t *dp, qboolean mvd)
+{
+    int flags = dp_byte(dp);
+
+    dp_byte(dp);    // index
+    if (flags & SND_VOLUME)
+        dp_byte(dp);
+    if (flags & SND_ATTENUATION)
+        dp_byte(dp);
+    if (flags & SND_OFFSET)
+        dp_byte(dp);
+    if (mvd || (flags & SND_ENT))
+        dp_short(dp);
+    if (!mvd && (flags & SND_POS))
+        dp_skip(dp, 6);
+
+    dp->sum->sounds++;
+}
+
+static qboolean skip_temp_entity(demoparse_t *dp)
+{
+    switch (dp_byte(dp)) {
+    case TE_BLOOD:
+    case TE_GUNSHOT:
+    case TE_SPARKS:
+    case TE_BULLET_SPARKS:
+    case TE_SCREEN_SPARKS:
+    case TE_SHIELD_SPARKS:
+    case TE_SHOTGUN:
+    case TE_BLASTER:
+    case TE_GREENBLOOD:
+    case TE_BLASTER2:
+    case TE_FLECHETTE:
+    case TE_HEATBEAM_SPARKS:
+    case TE_HEATBEAM_STEAM:
+    case TE_MOREBLOOD:
+    case TE_ELECTRIC_SPARKS:
+        dp_skip(dp, 7);     // pos, dir
+        break;
+    case TE_SPLASH:
+    case TE_LASER_SPARKS:
+    case TE_WELDING_SPARKS:
+    case TE_TUNNEL_SPARKS:
+        dp_skip(dp, 9);     // count, pos, dir, color
+        break;
+    case TE_BLUEHYPERBLASTER:
+    case TE_RAILTRAIL:
+    case TE_BUBBLETRAIL:
+    case TE_DEBUGTRAIL:
+    case TE_BUBBLETRAIL2:
+    case TE_BFG_LASER:
+        dp_skip(dp, 12);    // pos, pos
+        break;
+    case TE_GRENADE_EXPLOSION:
+    case TE_GRENADE_EXPLOSION_WATER:
+    case TE_EXPLOSION2:
+    case TE_PLASMA_EXPLOSION:
+    case TE_ROCKET_EXPLOSION:
+    case TE_ROCKET_EXPLOSION_WATER:
+    case TE_EXPLOSION1:
+    case TE_EXPLOSION1_NP:
+    case TE_EXPLOSION1_BIG:
+    case TE_BFG_EXPLOSION:
+    case TE_BFG_BIGEXPLOSION:
+    case TE_BOSSTPORT:
+    case TE_PLAIN_EXPLOSION:
+    case TE_CHAINFIST_SMOKE:
+    case TE_TRACKER_EXPLOSION:
+    case TE_TELEPORT_EFFECT:
+    case TE_DBALL_GOAL:
+    case TE_WIDOWSPLASH:
+    case TE_NUKEBLAST:
+        dp_skip(dp, 6);     // pos
+        break;
+    case TE_PARASITE_ATTACK:
+    case TE_MEDIC_CABLE_ATTACK:
+    case TE_HEATBEAM:
+    case TE_MONSTER_HEATBEAM:
+        dp_skip(dp, 14);    // entity, pos, pos
+        break;
+    case TE_GRAPPLE_CABLE:
+        dp_skip(dp, 20);    // entity, pos, pos, offset
+        break;
+    case TE_LIGHTNING:
+        dp_skip(dp, 16);    // entity, entity, pos, pos
+        break;
+    case TE_FLASHLIGHT:
+    case TE_WIDOWBEAMOUT:
+        dp_skip(dp, 8);     // pos, entity
+        break;
+    case TE_FORCEWALL:
+        dp_skip(dp, 13);    // pos, pos, color
+        break;
+    case TE_STEAM:
+        if (dp_short(dp) != -1) {
+            dp_skip(dp, 15);    // count, pos, dir, color, entity, time
+        } else {
+            dp_skip(dp, 11);
+        }
+        break;
+    default:
+        return qfalse;
+    }
+
+    dp->sum->effects++;
+    return qtrue;
+}
+
+/*
+==============================================================================
+
+STATE TRACKING
+
+==============================================================================
+*/
+
+static void parse_configstring(demoparse_t *dp, int index, const char *s)
+{
+    demosummary_t *sum = dp->sum;
+    size_t len;
+    char *p;
+
+    sum->configstrings++;
+
+    if (index == CS_MODELS + 1) {
+        len = strlen(s);
+        if (len > 9 && len - 9 < sizeof(sum->map)) {
+            memcpy(sum->map, s + 5, len - 9);   // skip "maps/"
+            sum->map[len - 9] = 0;  // cut off ".bsp"
+        }
+    } else if (index == CS_MAXCLIENTS) {
+        sum->maxclients = atoi(s);
+    } else if (!sum->mvd && sum->clientnum >= 0 && index == CS_PLAYERSKINS + sum->clientnum) {
+        Q_strlcpy(sum->pov, s, sizeof(sum->pov));
+        p = strchr(sum->pov, '\\');
+        if (p)
+            *p = 0;
+    }
+}
+
+static void parse_serverdata(demoparse_t *dp, int protocol)
+{
+    demosummary_t *sum = dp->sum;
+
+    dp->protocol = protocol;
+    sum->protocol = protocol;
+    sum->servercount = dp_long(dp);
+    if (!sum->mvd)
+        dp_byte(dp);    // attractloop
+    dp_string(dp, sum->gamedir, sizeof(sum->gamedir));
+    sum->clientnum = dp_short(dp);
+    sum->levels++;
+}
+
+static void parse_print(demoparse_t *dp)
+{
+    char string[MAX_STRING_CHARS];
+    int level;
+
+    level = dp_byte(dp);
+    dp_string(dp, string, sizeof(string));
+
+    dp->sum->prints++;
+    if (level == PRINT_CHAT)
+        dp->sum->chats++;
+}
+
+/*
+==============================================================================
+
+CLIENT DEMOS
+
+==============================================================================
+*/
+
+static const char *parse_dm2_frame(demoparse_t *dp)
+{
+    int len;
+
+    dp_long(dp);    // current frame
+    dp_long(dp);    // delta frame
+    if (dp->protocol != PROTOCOL_VERSION_OLD)
+        dp_byte(dp);    // suppress count
+
+    len = dp_byte(dp);
+    if (len > MAX_MAP_AREA_BYTES)
+        return "bad areabits";
+    dp_skip(dp, len);
+
+    if (dp_byte(dp) != svc_playerinfo)
+        return "not playerinfo";
+    skip_fields(dp, player_fields, q_countof(player_fields), dp_word(dp));
+    skip_stats(dp);
+    dp->sum->players++;
+
+    if (dp_byte(dp) != svc_packetentities)
+        return "not packetentities";
+    if (!skip_packet_entities(dp))
+        return "bad packetentities";
+
+    dp->sum->frames++;
+    return NULL;
+}
+
+// returns NULL on success or a reason
+static const char *parse_dm2_message(demoparse_t *dp)
+{
+    char string[MAX_STRING_CHARS];
+    const char *err;
+    int cmd, index, len;
+
+    while (dp->readcount < dp->cursize) {
+        cmd = dp_byte(dp);
+
+        if (cmd != svc_serverdata && !dp->protocol)
+            return "no serverdata";
+
+        switch (cmd) {
+        case svc_nop:
+            break;
+        case svc_disconnect:
+        case svc_reconnect:
+            dp->readcount = dp->cursize;
+            return NULL;
+        case svc_print:
+            parse_print(dp);
+            break;
+        case svc_centerprint:
+        case svc_stufftext:
+        case svc_layout:
+            dp_string(dp, string, sizeof(string));
+            break;
+        case svc_serverdata:
+            index = dp_long(dp);
+            if (index < PROTOCOL_VERSION_OLD || index > PROTOCOL_VERSION_DEFAULT)
+                return "unsupported protocol";
+            parse_serverdata(dp, index);
+            dp_string(dp, string, sizeof(string));  // level name
+            break;
+        case svc_configstring:
+            index = dp_short(dp);
+            if (index < 0 || index >= MAX_CONFIGSTRINGS)
+                return "bad configstring index";
+            dp_string(dp, string, sizeof(string));
+            parse_configstring(dp, index, string);
+            break;
+        case svc_sound:
+            skip_sound(dp, qfalse);
+            break;
+        case svc_spawnbaseline:
+            if (skip_entity(dp) < 1)
+                return "bad baseline";
+            dp->sum->baselines++;
+            break;
+        case svc_temp_entity:
+            if (!skip_temp_entity(dp))
+                return "bad temp entity";
+            break;
+        case svc_muzzleflash:
+        case svc_muzzleflash2:
+            dp_skip(dp, 3);
+            dp->sum->effects++;
+            break;
+        case svc_download:
+            len = dp_short(dp);
+            dp_byte(dp);
+            if (len > 0)
+                dp_skip(dp, len);
+            break;
+        case svc_frame:
+            if ((err = parse_dm2_frame(dp)) != NULL)
+                return err;
+            break;
+        case svc_inventory:
+            dp_skip(dp, MAX_ITEMS * 2);
+            break;
+        default:
+            return "illegible server message";
+        }
+
+        if (dp_overflowed(dp))
+            return "read past end of message";
+    }
+
+    return NULL;
+}
+
+/*
+==============================================================================
+
+MULTI VIEW DEMOS
+
+==============================================================================
+*/
+
+static const char *parse_mvd_frame(demoparse_t *dp)
+{
+    int len, number;
+
+    len = dp_byte(dp);
+    if (len > MAX_MAP_PORTAL_BYTES)
+        return "bad portalbits";
+    dp_skip(dp, len);
+
+    while (1) {
+        number = dp_byte(dp);
+        if (number == CLIENTNUM_NONE)
+            break;
+        if (number < 0)
+            return "read past end of message";
+
+        len = dp_word(dp);
+        skip_fields(dp, packet_fields, q_countof(packet_fields), len);
+        if (len & PPS_STATS)
+            skip_stats(dp);
+        dp->sum->players++;
+    }
+
+    if (!skip_packet_entities(dp))
+        return "bad packetentities";
+
+    dp->sum->frames++;
+    return NULL;
+}
+
+static const char *parse_mvd_message(demoparse_t *dp)
+{
+    char string[MAX_STRING_CHARS];
+    const char *err;
+    int cmd, extrabits, index, len;
+
+    while (dp->readcount < dp->cursize) {
+        cmd = dp_byte(dp);
+        extrabits = cmd >> SVCMD_BITS;
+        cmd &= SVCMD_MASK;
+
+        if (cmd != mvd_serverdata && !dp->protocol)
+            return "no serverdata";
+
+        switch (cmd) {
+        case mvd_nop:
+            break;
+        case mvd_serverdata:
+            if (dp_long(dp) != PROTOCOL_VERSION_MVD)
+                return "unsupported protocol";
+            index = dp_short(dp);
+            if (!MVD_SUPPORTED(index))
+                return "unsupported protocol";
+            parse_serverdata(dp, index);
+            while (1) {
+                index = dp_short(dp);
+                if (index == MAX_CONFIGSTRINGS)
+                    break;
+                if (index < 0 || index >= MAX_CONFIGSTRINGS)
+                    return "bad configstring index";
+                dp_string(dp, string, sizeof(string));
+                parse_configstring(dp, index, string);
+            }
+            // baseline frame
+            if ((err = parse_mvd_frame(dp)) != NULL)
+                return err;
+            dp->sum->frames--;
+            break;
+        case mvd_multicast_all:
+        case mvd_multicast_all_r:
+            len = dp_byte(dp) | (extrabits << 8);
+            dp_skip(dp, len);
+            dp->sum->multicasts++;
+            break;
+        case mvd_multicast_pvs:
+        case mvd_multicast_phs:
+        case mvd_multicast_pvs_r:
+        case mvd_multicast_phs_r:
+            len = dp_byte(dp) | (extrabits << 8);
+            dp_word(dp);    // leafnum
+            dp_skip(dp, len);
+            dp->sum->multicasts++;
+            break;
+        case mvd_unicast:
+        case mvd_unicast_r:
+            len = dp_byte(dp) | (extrabits << 8);
+            dp_byte(dp);    // clientnum
+            dp_skip(dp, len);
+            dp->sum->unicasts++;
+            break;
+        case mvd_configstring:
+            index = dp_short(dp);
+            if (index < 0 || index >= MAX_CONFIGSTRINGS)
+                return "bad configstring index";
+            dp_string(dp, string, sizeof(string));
+            parse_configstring(dp, index, string);
+            break;
+        case mvd_frame:
+            if ((err = parse_mvd_frame(dp)) != NULL)
+                return err;
+            break;
+        case mvd_sound:
+            skip_sound(dp, qtrue);
+            break;
+        case mvd_print:
+            parse_print(dp);
+            break;
+        default:
+            return "illegible command";
+        }
+
+        if (dp_overflowed(dp))
+            return "read past end of message";
+    }
+
+    return NULL;
+}
+
+/*
+==============================================================================
+
+FILE READING
+
+==============================================================================
+*/
+
+#if USE_ZLIB
+#define dp_open(path)       gzopen(path, "rb")
+#define dp_close(f)         gzclose(f)
+#define dp_read(f, buf, n)  gzread(f, buf, n)
+#else
+#define dp_open(path)       fopen(path, "rb")
+#define dp_close(f)         fclose(f)
+#define dp_read(f, buf, n)  fread(buf, 1, n, f)
+#endif
+
+// reads message data following the length prefix
+static ssize_t read_data(demoparse_t *dp, size_t lensize, uint32_t msglen)
+{
+    ssize_t read;
+
+    if (msglen > sizeof(dp->buffer))
+        return Q_ERR_INVALID_FORMAT;
+
+    read = dp_read(dp->file, dp->buffer, msglen);
+    if (read != msglen)
+        return read < 0 ? Q_ERR_FAILURE : Q_ERR_UNEXPECTED_EOF;
+
+    dp->data = dp->buffer;
+    dp->cursize = msglen;
+    dp->readcount = 0;
+    dp->sum->bytes += lensize + msglen;
+    dp->sum->messages++;
+    return msglen;
+}
+
+// returns message length, 0 on end of demo or error code
+static ssize_t read_message(demoparse_t *dp, size_t lensize)
+{
+    byte header[4];
+    uint32_t msglen;
+    ssize_t read;
+
+    read = dp_read(dp->file, header, lensize);
+    if (read == 0)
+        return 0;   // missing end of demo marker
+    if (read != lensize)
+        return read < 0 ? Q_ERR_FAILURE : Q_ERR_UNEXPECTED_EOF;
+
+    if (lensize == 2) {
+        msglen = header[0] | (header[1] << 8);
+        if (!msglen)
+            goto complete;
+    } else {
+        msglen = header[0] | (header[1] << 8) | (header[2] << 16) | ((uint32_t)header[3] << 24);
+        if (msglen == (uint32_t)-1)
+            goto complete;
+    }
+
+    return read_data(dp, lensize, msglen);
+
+complete:
+    dp->sum->bytes += lensize;
+    dp->sum->complete = qtrue;
+    return 0;
+}
+
+static qerror_t parse_file(demoparse_t *dp)
+{
+    demosummary_t *sum = dp->sum;
+    const char *(*parse)(demoparse_t *);
+    uint32_t magic;
+    size_t lensize;
+    ssize_t ret;
+
+    ret = dp_read(dp->file, &magic, 4);
+    if (ret != 4)
+        return ret < 0 ? Q_ERR_FAILURE : Q_ERR_FILE_TOO_SMALL;
+
+    if (magic == MVD_MAGIC) {
+        sum->mvd = qtrue;
+        sum->bytes = 4;
+        lensize = 2;
+        parse = parse_mvd_message;
+    } else if (CHECK_GZIP_HEADER(magic)) {
+        return Q_ERR_UNKNOWN_FORMAT;    // no zlib
+    } else {
+        // client demos have no magic, this is the first message length
+        if (magic == (uint32_t)-1)
+            return Q_ERR_UNEXPECTED_EOF;
+        ret = read_data(dp, 4, LittleLong(magic));
+        if (ret < 0)
+            return ret == Q_ERR_INVALID_FORMAT ? Q_ERR_UNKNOWN_FORMAT : ret;
+        lensize = 4;
+        parse = parse_dm2_message;
+        goto first;
+    }
+
+    while (1) {
+        ret = read_message(dp, lensize);
+        if (ret <= 0)
+            return ret;
+first:
+        sum->reason = parse(dp);
+        if (sum->reason) {
+            sum->erroffset = sum->bytes - dp->cursize - lensize;
+            return Q_ERR_INVALID_FORMAT;
+        }
+    }
+}
+
+/*
+=============
+DP_ParseFile
+
+Parses the given system path into summary. Safe to call from any thread
+as long as each thread uses its own context.
+=============
+*/
+qerror_t DP_ParseFile(demoparse_t *dp, const char *path, demosummary_t *summary)
+{
+    unsigned start = Sys_Microseconds();
+
+    memset(summary, 0, sizeof(*summary));
+    summary->clientnum = -1;
+    dp->sum = summary;
+    dp->protocol = 0;
+    dp->cursize = dp->readcount = 0;
+
+    dp->file = dp_open(path);
+    if (!dp->file) {
+        summary->error = Q_ERR(errno);
+    } else {
+        summary->error = parse_file(dp);
+        dp_close(dp->file);
+        dp->file = NULL;
+    }
+
+    summary->usec = Sys_Microseconds() - start;
+    dp->sum = NULL;
+    return summary->error;
+}
+
+demoparse_t *DP_CreateContext(void)
+{
+    return Z_Mallocz(sizeof(demoparse_t));
+}
+
+void DP_FreeContext(demoparse_t *dp)
+{
+    Z_Free(dp);
+}
+
+/*
+==============================================================================
+
+BATCH ANALYSIS
+
+==============================================================================
+*/
+
+typedef struct {
+    const char      *path;
+    demosummary_t   summary;
+} scanjob_t;
+
+typedef struct {
+    demoparse_t     *dp;
+    systhread_t     *thread;
+} scanworker_t;
+
+static scanjob_t    *scan_jobs;
+static int          scan_numjobs;
+static volatile int scan_nextjob;
+
+static void scan_thread(void *arg)
+{
+    scanworker_t *w = arg;
+    int i;
+
+    while ((i = __sync_fetch_and_add(&scan_nextjob, 1)) < scan_numjobs)
+        DP_ParseFile(w->dp, scan_jobs[i].path, &scan_jobs[i].summary);
+}
+
+static size_t json_string(char *buffer, size_t size, const char *s)
+{
+    size_t len = 0;
+    int c;
+
+    while (*s && len + 8 < size) {
+        c = *s++ & 255;
+        if (c == '"' || c == '\\') {
+            buffer[len++] = '\\';
+            buffer[len++] = c;
+        } else if (c < 32 || c > 126) {
+            len += Q_scnprintf(buffer + len, size - len, "\\u%04x", c);
+        } else {
+            buffer[len++] = c;
+        }
+    }
+
+    buffer[len] = 0;
+    return len;
+}
+
+static void scan_output(qhandle_t f, const char *line, size_t len)
+{
+    if (f)
+        FS_Write(line, len, f);
+    else
+        Com_Printf("%s", line);
+}
+
+static void scan_print_job(qhandle_t f, const scanjob_t *job)
+{
+    const demosummary_t *s = &job->summary;
+    char line[MAX_STRING_CHARS * 2];
+    size_t len;
+
+    len = Q_scnprintf(line, sizeof(line), "{\"file\":\"");
+    len += json_string(line + len, sizeof(line) - len, job->path);
+    len += Q_scnprintf(line + len, sizeof(line) - len,
+                       "\",\"type\":\"%s\",\"protocol\":%d,\"gamedir\":\"",
+                       s->mvd ? "mvd2" : "dm2", s->protocol);
+    len += json_string(line + len, sizeof(line) - len, s->gamedir);
+    len += Q_scnprintf(line + len, sizeof(line) - len, "\",\"map\":\"");
+    len += json_string(line + len, sizeof(line) - len, s->map);
+    len += Q_scnprintf(line + len, sizeof(line) - len, "\",\"pov\":\"");
+    len += json_string(line + len, sizeof(line) - len, s->pov);
+
+    len += Q_scnprintf(line + len, sizeof(line) - len,
+                       "\",\"maxclients\":%d,\"levels\":%u,\"bytes\":%"PRIz","
+                       "\"messages\":%u,\"frames\":%u,\"seconds\":%.1f,"
+                       "\"configstrings\":%u,\"baselines\":%u,\"entities\":%u,"
+                       "\"players\":%u,\"prints\":%u,\"chats\":%u,\"sounds\":%u,"
+                       "\"effects\":%u,\"multicasts\":%u,\"unicasts\":%u,"
+                       "\"complete\":%s,\"msec\":%.3f",
+                       s->maxclients, s->levels, s->bytes,
+                       s->messages, s->frames, s->frames * 0.1f,
+                       s->configstrings, s->baselines, s->entities,
+                       s->players, s->prints, s->chats, s->sounds,
+                       s->effects, s->multicasts, s->unicasts,
+                       s->complete ? "true" : "false", s->usec * 0.001f);
+
+    if (s->error) {
+        len += Q_scnprintf(line + len, sizeof(line) - len, ",\"error\":\"%s\"",
+                           Q_ErrorString(s->error));
+    }
+    if (s->reason) {
+        len += Q_scnprintf(line + len, sizeof(line) - len,
+                           ",\"reason\":\"%s\",\"offset\":%"PRIz,
+                           s->reason, s->erroffset);
+    }
+
+    len += Q_scnprintf(line + len, sizeof(line) - len, "}\n");
+    scan_output(f, line, len);
+}
+
+static const cmd_option_t o_demoscan[] = {
+    { "h", "help", "display this message" },
+    { "j:number", "jobs", "use <number> of threads (default is CPU count)" },
+    { "o:filename", "output", "write JSON summaries into <filename>" },
+    { NULL }
+};
+
+/*
+=============
+DP_Scan_f
+
+demoscan [-j <number>] [-o <filename>] <path> [...]
+=============
+*/
+static void DP_Scan_f(void)
+{
+    char buffer[MAX_OSPATH], line[MAX_STRING_CHARS];
+    scanworker_t workers[MAX_SCAN_THREADS];
+    int c, i, numthreads, failed;
+    unsigned start, usec, frames;
+    size_t bytes, len;
+    qhandle_t f = 0;
+    char *output = NULL;
+    float sec;
+
+    numthreads = Sys_NumProcessors();
+    while ((c = Cmd_ParseOptions(o_demoscan)) != -1) {
+        switch (c) {
+        case 'h':
+            Cmd_PrintUsage(o_demoscan, "<path> [...]");
+            Com_Printf("Parse demos in parallel and print JSON summaries.\n");
+            Cmd_PrintHelp(o_demoscan);
+            Com_Printf("Paths are system paths, not quake paths.\n");
+            return;
+        case 'j':
+            numthreads = atoi(cmd_optarg);
+            if (numthreads < 1) {
+                Com_Printf("Invalid value for %s option.\n", cmd_optopt);
+                Cmd_PrintHint();
+                return;
+            }
+            break;
+        case 'o':
+            output = cmd_optarg;
+            break;
+        default:
+            return;
+        }
+    }
+
+    if (cmd_optind == Cmd_Argc()) {
+        Com_Printf("Missing path argument.\n");
+        Cmd_PrintHint();
+        return;
+    }
+
+    if (output) {
+        f = FS_EasyOpenFile(buffer, sizeof(buffer), FS_MODE_WRITE | FS_FLAG_TEXT,
+                            "", output, ".json");
+        if (!f)
+            return;
+    }
+
+    scan_numjobs = Cmd_Argc() - cmd_optind;
+    scan_nextjob = 0;
+    scan_jobs = Z_Mallocz(sizeof(scan_jobs[0]) * scan_numjobs);
+    for (i = 0; i < scan_numjobs; i++)
+        scan_jobs[i].path = Cmd_Argv(cmd_optind + i);
+
+    clamp(numthreads, 1, min(scan_numjobs, MAX_SCAN_THREADS));
+
+    start = Sys_Microseconds();
+
+    // the calling thread is worker 0
+    for (i = 0; i < numthreads; i++) {
+        workers[i].dp = DP_CreateContext();
+        workers[i].thread = NULL;
+    }
+    for (i = 1; i < numthreads; i++)
+        workers[i].thread = Sys_CreateThread(scan_thread, &workers[i]);
+    scan_thread(&workers[0]);
+    for (i = 1; i < numthreads; i++)
+        if (workers[i].thread)
+            Sys_JoinThread(workers[i].thread);
+
+    usec = Sys_Microseconds() - start;
+
+    for (i = 0; i < numthreads; i++)
+        DP_FreeContext(workers[i].dp);
+
+    bytes = frames = failed = 0;
+    for (i = 0; i < scan_numjobs; i++) {
+        scan_print_job(f, &scan_jobs[i]);
+        bytes += scan_jobs[i].summary.bytes;
+        frames += scan_jobs[i].summary.frames;
+        if (scan_jobs[i].summary.error)
+            failed++;
+    }
+
+    sec = max(usec, 1) * 1e-6f;
+    len = Q_scnprintf(line, sizeof(line), "{\"files\":%d,\"failed\":%d,"
+                      "\"threads\":%d,\"bytes\":%"PRIz",\"frames\":%u,"
+                      "\"seconds\":%.3f,\"mb_per_sec\":%.1f,\"frames_per_sec\":%.0f}\n",
+                      scan_numjobs, failed, numthreads, bytes, frames, sec,
+                      bytes / (sec * 1024 * 1024), frames / sec);
+    scan_output(f, line, len);
+
+    if (f) {
+        FS_FCloseFile(f);
+        Com_Printf("Wrote %d summaries to %s.\n", scan_numjobs, buffer);
+    }
+
+    Z_Free(scan_jobs);
+    scan_jobs = NULL;
+    scan_numjobs = 0;
+}
+
+void DP_Init(void)
+{
+    Cmd_AddCommand("demoscan", DP_Scan_f);
+}
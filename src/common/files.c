@@ -120,6 +120,8 @@ typedef struct {
     filetype_t  type;       // FS_PAK or FS_ZIP
     unsigned    refcount;   // for tracking pack users
     FILE        *fp;
+    byte        *map;       // whole pack mapped read-only, or NULL
+    size_t      mapsize;
     unsigned    num_files;
     packfile_t  *files;
     packfile_t  **file_hash;
@@ -192,12 +194,26 @@ static cvar_t       *fs_debug;
 
 cvar_t              *fs_game;
 
+static cvar_t       *fs_mmap;
+
+// zero-copy buffers returned by FS_LoadFileEx, each holds a pack reference
+#define MAX_FILE_VIEWS  32
+
+typedef struct {
+    const byte  *base;
+    pack_t      *pack;
+} fileview_t;
+
+static fileview_t   fs_views[MAX_FILE_VIEWS];
+static unsigned     fs_numviews;
+
 #if USE_ZLIB
 // local stream used for all file loads
 static zipstream_t  fs_zipstream;
 
 static void open_zip_file(file_t *file);
 static void close_zip_file(file_t *file);
+static void close_zip_stream(file_t *file);
 static ssize_t tell_zip_file(file_t *file);
 static ssize_t read_zip_file(file_t *file, void *buf, size_t len);
 #endif
@@ -207,6 +223,8 @@ static ssize_t read_zip_file(file_t *file, void *buf, size_t len);
 static pack_t *pack_get(pack_t *pack);
 static void pack_put(pack_t *pack);
 
+static void index_add_file(const char *fullpath);
+
 /*
 
 All of Quake's data access is through a hierchal file system,
@@ -534,8 +552,9 @@ static qerror_t seek_pak_file(file_t *file, off_t offset)
     if (entry->filepos > LONG_MAX - offset)
         return Q_ERR_INVAL;
 
+    // mapped packs don't have a shared file position
     filepos = entry->filepos + offset;
-    if (fseek(file->fp, filepos, SEEK_SET) == -1)
+    if (file->fp && fseek(file->fp, filepos, SEEK_SET) == -1)
         return Q_Errno();
 
     file->rest_out = entry->filelen - offset;
@@ -758,7 +777,8 @@ void FS_FCloseFile(qhandle_t f)
         break;
     case FS_PAK:
         if (file->unique) {
-            fclose(file->fp);
+            if (file->fp)
+                fclose(file->fp);
             pack_put(file->pack);
         }
         break;
@@ -997,6 +1017,8 @@ static ssize_t open_file_write(file_t *file, const char *name)
 
     FS_DPrintf("%s: %s: %lu bytes\n", __func__, fullpath, pos);
 
+    index_add_file(fullpath);
+
     file->type = FS_REAL;
     file->fp = fp;
     file->unique = qtrue;
@@ -1014,18 +1036,27 @@ fail1:
 
 #if USE_ZLIB
 
-static qerror_t check_header_coherency(FILE *fp, packfile_t *entry)
+static qerror_t check_header_coherency(pack_t *pack, FILE *fp, packfile_t *entry)
 {
     unsigned flags, comp_mtd;
     size_t comp_len, file_len;
     size_t name_size, xtra_size;
-    byte header[ZIP_SIZELOCALHEADER];
+    byte buffer[ZIP_SIZELOCALHEADER];
+    const byte *header;
     size_t ofs;
 
-    if (fseek(fp, (long)entry->filepos, SEEK_SET) == -1)
-        return Q_Errno();
-    if (fread(header, 1, sizeof(header), fp) != sizeof(header))
-        return FS_ERR_READ(fp);
+    if (pack->map) {
+        if (pack->mapsize < ZIP_SIZELOCALHEADER ||
+            entry->filepos > pack->mapsize - ZIP_SIZELOCALHEADER)
+            return Q_ERR_UNEXPECTED_EOF;
+        header = pack->map + entry->filepos;
+    } else {
+        if (fseek(fp, (long)entry->filepos, SEEK_SET) == -1)
+            return Q_Errno();
+        if (fread(buffer, 1, sizeof(buffer), fp) != sizeof(buffer))
+            return FS_ERR_READ(fp);
+        header = buffer;
+    }
 
     // check the magic
     if (LittleLongMem(&header[0]) != ZIP_LOCALHEADERMAGIC)
@@ -1103,14 +1134,77 @@ static void open_zip_file(file_t *file)
 }
 
 // only called for unique handles
-static void close_zip_file(file_t *file)
+static void close_zip_stream(file_t *file)
 {
     zipstream_t *s = file->zfp;
 
     inflateEnd(&s->stream);
     Z_Free(s);
+    file->zfp = NULL;
+}
 
-    fclose(file->fp);
+static void close_zip_file(file_t *file)
+{
+    close_zip_stream(file);
+
+    if (file->fp)
+        fclose(file->fp);
+}
+
+/*
+Inflates the whole entry with a single call. Finishing the stream in one
+call lets zlib skip allocating and updating the sliding window, and there is
+no copying through the temp buffer. The stream uses plain malloc so that it
+can run in any thread.
+*/
+static ssize_t inflate_buffer(const byte *in, size_t inlen, byte *out, size_t outlen)
+{
+    z_stream z;
+    int ret;
+
+    memset(&z, 0, sizeof(z));
+    if (inflateInit2(&z, -MAX_WBITS) != Z_OK)
+        return Q_ERR_INFLATE_FAILED;
+
+    z.next_in = (Bytef *)in;
+    z.avail_in = (uInt)inlen;
+    z.next_out = out;
+    z.avail_out = (uInt)outlen;
+
+    ret = inflate(&z, Z_FINISH);
+    inflateEnd(&z);
+
+    if (ret != Z_STREAM_END || z.total_out != outlen)
+        return Q_ERR_INFLATE_FAILED;
+
+    return outlen;
+}
+
+// reads entire entry of freshly opened file at once
+static ssize_t inflate_zip_file(file_t *file, byte *buf)
+{
+    packfile_t *entry = file->entry;
+    byte *tmp = NULL;
+    const byte *src;
+    ssize_t ret;
+
+    if (file->pack->map) {
+        src = file->pack->map + entry->filepos;
+    } else {
+        src = tmp = FS_AllocTempMem(entry->complen);
+        if (fread(tmp, 1, entry->complen, file->fp) != entry->complen) {
+            ret = FS_ERR_READ(file->fp);
+            goto fail;
+        }
+    }
+
+    ret = inflate_buffer(src, entry->complen, buf, entry->filelen);
+    if (ret >= 0)
+        file->rest_out = 0;
+
+fail:
+    FS_FreeTempMem(tmp);
+    return ret;
 }
 
 static ssize_t tell_zip_file(file_t *file)
@@ -1143,23 +1237,32 @@ static ssize_t read_zip_file(file_t *file, void *buf, size_t len)
                 break;
             }
 
-            // fill in the temp buffer
-            block = ZIP_BUFSIZE;
-            if (block > s->rest_in) {
-                block = s->rest_in;
-            }
+            if (!file->fp) {
+                // inflate straight from the mapped pack
+                block = min(s->rest_in, INT_MAX);
+                z->next_in = file->pack->map + file->entry->filepos +
+                    file->entry->complen - s->rest_in;
+                z->avail_in = (uInt)block;
+                s->rest_in -= block;
+            } else {
+                // fill in the temp buffer
+                block = ZIP_BUFSIZE;
+                if (block > s->rest_in) {
+                    block = s->rest_in;
+                }
 
-            result = fread(s->buffer, 1, block, file->fp);
-            if (result != block) {
-                file->error = FS_ERR_READ(file->fp);
-                if (!result) {
-                    break;
+                result = fread(s->buffer, 1, block, file->fp);
+                if (result != block) {
+                    file->error = FS_ERR_READ(file->fp);
+                    if (!result) {
+                        break;
+                    }
                 }
-            }
 
-            s->rest_in -= result;
-            z->next_in = s->buffer;
-            z->avail_in = result;
+                s->rest_in -= result;
+                z->next_in = s->buffer;
+                z->avail_in = result;
+            }
         }
 
         ret = inflate(z, Z_SYNC_FLUSH);
@@ -1192,8 +1295,12 @@ static ssize_t open_from_pak(file_t *file, pack_t *pack, packfile_t *entry, qboo
 {
     FILE *fp;
     qerror_t ret;
+    size_t len;
 
-    if (unique) {
+    if (pack->map) {
+        // positional reads from the mapping, nothing to open or seek
+        fp = NULL;
+    } else if (unique) {
         fp = fopen(pack->filename, "rb");
         if (!fp) {
             ret = Q_Errno();
@@ -1206,14 +1313,25 @@ static ssize_t open_from_pak(file_t *file, pack_t *pack, packfile_t *entry, qboo
 
 #if USE_ZLIB
     if (pack->type == FS_ZIP && !entry->coherent) {
-        ret = check_header_coherency(fp, entry);
+        ret = check_header_coherency(pack, fp, entry);
         if (ret) {
             goto fail2;
         }
     }
 #endif
 
-    if (fseek(fp, (long)entry->filepos, SEEK_SET) == -1) {
+    if (pack->map) {
+        len = entry->filelen;
+#if USE_ZLIB
+        if (pack->type == FS_ZIP && (entry->compmtd || (file->mode & FS_FLAG_DEFLATE))) {
+            len = entry->complen;
+        }
+#endif
+        if (entry->filepos > pack->mapsize || len > pack->mapsize - entry->filepos) {
+            ret = Q_ERR_UNEXPECTED_EOF;
+            goto fail2;
+        }
+    } else if (fseek(fp, (long)entry->filepos, SEEK_SET) == -1) {
         ret = Q_Errno();
         goto fail2;
     }
@@ -1254,7 +1372,7 @@ static ssize_t open_from_pak(file_t *file, pack_t *pack, packfile_t *entry, qboo
     return file->length;
 
 fail2:
-    if (unique) {
+    if (unique && fp) {
         fclose(fp);
     }
 fail1:
@@ -1296,6 +1414,355 @@ fail:
     return ret;
 }
 
+/*
+=============================================================================
+
+FILE INDEX
+
+Merged hash of every file in every pack and game directory, built on first
+lookup after the search path changes. Entries for the same name are chained
+in search path order, so the first matching entry wins, and a missing file
+costs a single hash probe instead of an open() per directory. Files created
+through the filesystem are added as they are written; files changed behind
+its back are only picked up after fs_restart.
+
+Lookups restricted by path, type or compression bypass the index and walk
+the search path as usual.
+=============================================================================
+*/
+
+typedef struct fsentry_s {
+    struct fsentry_s    *hash_next;
+    searchpath_t        *search;
+    packfile_t          *entry;     // NULL for files on disk
+    const char          *name;
+    size_t              namelen;
+    unsigned            order;      // search path position, 0 is first
+} fsentry_t;
+
+static struct {
+    qboolean    built;
+    qboolean    failed;             // some directory couldn't be fully scanned
+    fsentry_t   *entries;
+    unsigned    num_entries;
+    fsentry_t   **hash;
+    unsigned    hash_size;
+    char        *names;             // names of files on disk
+    size_t      names_len, names_size;
+    unsigned    num_disk, num_added;
+
+    unsigned    hits, misses, stale;
+} fs_index;
+
+static cvar_t   *fs_index_enable;
+
+static void free_index(void)
+{
+    fsentry_t   *e, *next;
+    unsigned    i;
+
+    // free entries added after the index was built
+    for (i = 0; i < fs_index.hash_size; i++) {
+        for (e = fs_index.hash[i]; e; e = next) {
+            next = e->hash_next;
+            if (e < fs_index.entries || e >= fs_index.entries + fs_index.num_entries) {
+                Z_Free(e);
+            }
+        }
+    }
+
+    Z_Free(fs_index.entries);
+    Z_Free(fs_index.hash);
+    Z_Free(fs_index.names);
+
+    fs_index.built = qfalse;
+    fs_index.failed = qfalse;
+    fs_index.entries = NULL;
+    fs_index.num_entries = 0;
+    fs_index.hash = NULL;
+    fs_index.hash_size = 0;
+    fs_index.names = NULL;
+    fs_index.names_len = fs_index.names_size = 0;
+    fs_index.num_disk = fs_index.num_added = 0;
+}
+
+static void index_name_func(const char *name, void *arg)
+{
+    size_t len = strlen(name) + 1;
+
+    if (fs_index.names_len + len > fs_index.names_size) {
+        fs_index.names_size = max(fs_index.names_size * 2, fs_index.names_len + len + 0x10000);
+        fs_index.names = Z_Realloc(fs_index.names, fs_index.names_size);
+    }
+
+    memcpy(fs_index.names + fs_index.names_len, name, len);
+    fs_index.names_len += len;
+    fs_index.num_disk++;
+}
+
+static void index_insert(fsentry_t *e, unsigned hash)
+{
+    fsentry_t   **prev;
+
+    // keep chains in search path order
+    prev = &fs_index.hash[hash & (fs_index.hash_size - 1)];
+    while (*prev && (*prev)->order < e->order) {
+        prev = &(*prev)->hash_next;
+    }
+
+    e->hash_next = *prev;
+    *prev = e;
+}
+
+static void build_index(void)
+{
+    searchpath_t    *search;
+    fsentry_t       *e;
+    packfile_t      *file;
+    unsigned        i, order, total;
+    size_t          *ofs, len;
+    const char      *s;
+
+    free_index();
+
+    for (search = fs_searchpaths, order = 0; search; search = search->next) {
+        order++;
+    }
+
+    // scan directories, remembering where names of each one start
+    ofs = FS_Malloc(sizeof(ofs[0]) * (order + 1));
+    for (search = fs_searchpaths, i = 0; search; search = search->next, i++) {
+        ofs[i] = fs_index.names_len;
+        if (search->pack) {
+            continue;
+        }
+        len = strlen(search->filename) + 1;
+        if (!Sys_WalkFiles_r(search->filename, len, index_name_func, NULL, 0)) {
+            Com_WPrintf("Couldn't index %s, file index disabled.\n", search->filename);
+            Z_Free(ofs);
+            free_index();
+            fs_index.failed = qtrue;
+            return;
+        }
+    }
+    ofs[i] = fs_index.names_len;
+
+    total = fs_index.num_disk;
+    for (search = fs_searchpaths; search; search = search->next) {
+        if (search->pack) {
+            total += search->pack->num_files;
+        }
+    }
+
+    fs_index.hash_size = npot32(max(total, 64));
+    fs_index.hash = FS_Mallocz(sizeof(fs_index.hash[0]) * fs_index.hash_size);
+    fs_index.entries = FS_Malloc(sizeof(fs_index.entries[0]) * max(total, 1));
+
+    // add in reverse order, so that insertion doesn't need to walk chains
+    e = fs_index.entries + total;
+    for (order = i; order-- > 0;) {
+        for (search = fs_searchpaths, i = 0; i < order; i++) {
+            search = search->next;
+        }
+        if (search->pack) {
+            for (i = 0; i < search->pack->num_files; i++) {
+                file = &search->pack->files[i];
+                e--;
+                e->search = search;
+                e->entry = file;
+                e->name = file->name;
+                e->namelen = file->namelen;
+                e->order = order;
+                index_insert(e, FS_HashPathLen(file->name, file->namelen, 0));
+            }
+        } else {
+            for (s = fs_index.names + ofs[order]; s < fs_index.names + ofs[order + 1]; s += len + 1) {
+                len = strlen(s);
+                e--;
+                e->search = search;
+                e->entry = NULL;
+                e->name = s;
+                e->namelen = len;
+                e->order = order;
+                index_insert(e, FS_HashPathLen(s, len, 0));
+            }
+        }
+    }
+
+    fs_index.num_entries = total;
+    fs_index.built = qtrue;
+    Z_Free(ofs);
+
+    FS_DPrintf("%s: %u files, %u on disk\n", __func__, total, fs_index.num_disk);
+}
+
+// adds a file just created on disk to the index
+static void index_add_file(const char *fullpath)
+{
+    searchpath_t    *search;
+    fsentry_t       *e;
+    const char      *name;
+    size_t          len, namelen;
+    unsigned        order, hash;
+
+    if (!fs_index.built) {
+        return;
+    }
+
+    for (search = fs_searchpaths, order = 0; search; search = search->next, order++) {
+        if (search->pack) {
+            continue;
+        }
+        len = strlen(search->filename);
+        if (!strncmp(fullpath, search->filename, len) && fullpath[len] == '/') {
+            break;
+        }
+    }
+
+    if (!search) {
+        return;     // not in the search path
+    }
+
+    name = fullpath + len + 1;
+    namelen = strlen(name);
+    hash = FS_HashPathLen(name, namelen, 0);
+
+    for (e = fs_index.hash[hash & (fs_index.hash_size - 1)]; e; e = e->hash_next) {
+        if (e->search == search && !strcmp(e->name, name)) {
+            return;     // already there
+        }
+    }
+
+    e = FS_Malloc(sizeof(*e) + namelen + 1);
+    e->search = search;
+    e->entry = NULL;
+    e->name = memcpy(e + 1, name, namelen + 1);
+    e->namelen = namelen;
+    e->order = order;
+    index_insert(e, hash);
+
+    fs_index.num_added++;
+}
+
+/*
+================
+FS_IndexFile
+
+Adds a file created outside of the filesystem (e.g. by renaming a download)
+to the file index.
+================
+*/
+void FS_IndexFile(const char *path)
+{
+    char fullpath[MAX_OSPATH];
+
+    if (Q_strlcpy(fullpath, path, sizeof(fullpath)) >= sizeof(fullpath)) {
+        return;
+    }
+
+#ifdef _WIN32
+    FS_ReplaceSeparators(fullpath, '/');
+#endif
+
+    index_add_file(fullpath);
+}
+
+static void fs_index_changed(cvar_t *self)
+{
+    free_index();
+}
+
+#ifndef _WIN32
+// files on disk are matched exactly, or in lower case if path has mixed case
+static qboolean index_case_match(const char *name, const char *normalized, int valid)
+{
+    if (!strcmp(name, normalized)) {
+        return qtrue;
+    }
+
+    if (valid != PATH_MIXED_CASE) {
+        return qfalse;
+    }
+
+    for (; *name; name++) {
+        if (Q_isupper(*name)) {
+            return qfalse;
+        }
+    }
+
+    return qtrue;
+}
+#endif
+
+// Looks up the file in the index. Returns false if the index is out of date
+// and search path needs to be walked instead.
+static qboolean open_from_index(file_t *file, const char *normalized, size_t namelen,
+                                unsigned hash, qboolean unique, ssize_t *ret)
+{
+    char        fullpath[MAX_OSPATH];
+    fsentry_t   *e;
+    int         valid;
+
+    valid = PATH_NOT_CHECKED;
+
+    for (e = fs_index.hash[hash & (fs_index.hash_size - 1)]; e; e = e->hash_next) {
+        if (e->namelen != namelen) {
+            continue;
+        }
+        FS_COUNT_STRCMP;
+        if (FS_pathcmp(e->name, normalized)) {
+            continue;
+        }
+
+        if (e->entry) {
+            // don't bother searching in paks if length exceedes MAX_QPATH
+            if (namelen >= MAX_QPATH) {
+                continue;
+            }
+            fs_index.hits++;
+            *ret = open_from_pak(file, e->search->pack, e->entry, unique);
+            return qtrue;
+        }
+
+        if (valid == PATH_NOT_CHECKED) {
+            valid = FS_ValidatePath(normalized);
+        }
+        if (valid == PATH_INVALID) {
+            continue;
+        }
+#ifndef _WIN32
+        if (!index_case_match(e->name, normalized, valid)) {
+            continue;
+        }
+#endif
+
+        if (Q_concat(fullpath, sizeof(fullpath), e->search->filename,
+                     "/", e->name, NULL) >= sizeof(fullpath)) {
+            *ret = Q_ERR_NAMETOOLONG;
+            return qtrue;
+        }
+
+        *ret = open_from_disk(file, fullpath);
+        if (*ret == Q_ERR_NOENT) {
+            // removed behind our back
+            fs_index.stale++;
+            return qfalse;
+        }
+
+        fs_index.hits++;
+        return qtrue;
+    }
+
+    if (valid == PATH_NOT_CHECKED) {
+        valid = FS_ValidatePath(normalized);
+    }
+
+    fs_index.misses++;
+    *ret = valid ? Q_ERR_NOENT : Q_ERR_INVALID_PATH;
+    FS_DPrintf("%s: %s: %s\n", __func__, normalized, Q_ErrorString(*ret));
+    return qtrue;
+}
+
 // Finds the file in the search path.
 // Fills file_t and returns file length.
 // Used for streaming data out of either a pak file or a seperate file.
@@ -1314,6 +1781,17 @@ static ssize_t open_file_read(file_t *file, const char *normalized, size_t namel
 
     hash = FS_HashPath(normalized, 0);
 
+    // unrestricted lookups are answered from the index
+    if (fs_index_enable->integer && !fs_index.failed &&
+        !(file->mode & (FS_PATH_MASK | FS_TYPE_MASK | FS_FLAG_DEFLATE))) {
+        if (!fs_index.built) {
+            build_index();
+        }
+        if (fs_index.built && open_from_index(file, normalized, namelen, hash, unique, &ret)) {
+            return ret;
+        }
+    }
+
     valid = PATH_NOT_CHECKED;
 
 // search through the path, one element at a time
@@ -1455,6 +1933,13 @@ static ssize_t read_pak_file(file_t *file, void *buf, size_t len)
         return 0;
     }
 
+    if (!file->fp) {
+        memcpy(buf, file->pack->map + file->entry->filepos +
+               file->length - file->rest_out, len);
+        file->rest_out -= len;
+        return len;
+    }
+
     result = fread(buf, 1, len, file->fp);
     if (result != len) {
         file->error = FS_ERR_READ(file->fp);
@@ -1796,6 +2281,400 @@ qhandle_t FS_EasyOpenFile(char *buf, size_t size, unsigned mode,
     return easy_open_write(buf, size, mode, dir, name, ext);
 }
 
+/*
+=============================================================================
+
+ASYNC LOADING
+
+Files are opened on the main thread, which does all path lookups, and read by
+a pool of worker threads that exit when the queue runs dry. Workers only
+touch the unique handle of their job: they copy from mapped packs, fread from
+their own FILE and inflate with a private stream allocated by plain malloc,
+since the zone is not reentrant.
+
+Requests with a callback are delivered by FS_RunAsync once per frame.
+Prefetches have no callback and are claimed by FS_LoadFileEx instead, stored
+entries of mapped packs are only faulted in for them. Unclaimed prefetches
+are dropped at the end of the frame they were issued in.
+=============================================================================
+*/
+
+#define MAX_ASYNC_JOBS      1024
+#define MAX_ASYNC_THREADS   8
+
+typedef enum {
+    JOB_QUEUED,
+    JOB_RUNNING,
+    JOB_DONE,
+    JOB_FREE
+} jobstate_t;
+
+typedef struct {
+    volatile int    state;
+    file_t          file;       // unique handle opened by main thread
+    qboolean        deflated;   // file is raw zip entry data
+    byte            *buf;       // NULL if only paging in mapped data
+    size_t          len;
+    ssize_t         ret;        // file length or error
+    memtag_t        tag;
+    fs_loaddone_t   done;
+    void            *arg;
+    char            path[MAX_QPATH];
+} asyncjob_t;
+
+static struct {
+    asyncjob_t      *jobs[MAX_ASYNC_JOBS];
+    volatile int    numjobs;    // jobs in current batch
+    volatile int    nextjob;    // first job not looked at by workers
+    unsigned        pending;    // jobs not yet freed
+
+    systhread_t     *threads[MAX_ASYNC_THREADS];
+    volatile int    running[MAX_ASYNC_THREADS];
+
+    unsigned        queued, claimed, dropped;
+} fs_async;
+
+static cvar_t   *fs_async_enable;
+
+// runs in any thread
+static void async_run_job(asyncjob_t *job)
+{
+    file_t *file = &job->file;
+    const volatile byte *page;
+    const byte *src = NULL;
+    ssize_t ret = job->len;
+    size_t i;
+
+    if (file->pack && !file->fp)
+        src = file->pack->map + file->entry->filepos;
+
+    if (!job->buf) {
+        // fault mapped pages in, the copy is made when claimed
+        for (page = src, i = 0; i < job->len; i += 4096)
+            (void)page[i];
+#if USE_ZLIB
+    } else if (job->deflated) {
+        byte *tmp = NULL;
+        size_t complen = file->entry->complen;
+
+        if (!src) {
+            src = tmp = malloc(complen);
+            if (!tmp)
+                ret = Q_ERR(ENOMEM);
+            else if (fread(tmp, 1, complen, file->fp) != complen)
+                ret = FS_ERR_READ(file->fp);
+        }
+        if (ret >= 0)
+            ret = inflate_buffer(src, complen, job->buf, job->len);
+        free(tmp);
+#endif
+    } else if (src) {
+        memcpy(job->buf, src, job->len);
+    } else if (fread(job->buf, 1, job->len, file->fp) != job->len) {
+        ret = FS_ERR_READ(file->fp);
+    }
+
+    if (ret >= 0 && job->buf)
+        job->buf[job->len] = 0;
+
+    job->ret = ret;
+    __sync_synchronize();
+    job->state = JOB_DONE;
+}
+
+static void async_thread(void *arg)
+{
+    volatile int *running = arg;
+    asyncjob_t *job;
+    int i;
+
+    while ((i = fs_async.nextjob) < fs_async.numjobs) {
+        if (!__sync_bool_compare_and_swap(&fs_async.nextjob, i, i + 1))
+            continue;
+        job = fs_async.jobs[i];
+        if (__sync_bool_compare_and_swap(&job->state, JOB_QUEUED, JOB_RUNNING))
+            async_run_job(job);
+    }
+
+    __sync_synchronize();
+    *running = 0;
+}
+
+// joins finished workers and starts new ones if there are unclaimed jobs
+static void async_start(void)
+{
+    int i, numthreads;
+
+    numthreads = Sys_NumProcessors() - 1;
+    clamp(numthreads, 1, MAX_ASYNC_THREADS);
+
+    for (i = 0; i < MAX_ASYNC_THREADS; i++) {
+        if (fs_async.threads[i] && !fs_async.running[i]) {
+            Sys_JoinThread(fs_async.threads[i]);
+            fs_async.threads[i] = NULL;
+        }
+        if (!fs_async.threads[i] && i < numthreads &&
+            fs_async.nextjob < fs_async.numjobs) {
+            fs_async.running[i] = 1;
+            fs_async.threads[i] = Sys_CreateThread(async_thread, (void *)&fs_async.running[i]);
+            if (!fs_async.threads[i])
+                fs_async.running[i] = 0;
+        }
+    }
+}
+
+static void async_close_file(file_t *file)
+{
+    if (file->fp)
+        fclose(file->fp);
+    if (file->pack)
+        pack_put(file->pack);
+}
+
+static void async_free_job(asyncjob_t *job)
+{
+    async_close_file(&job->file);
+    Z_Free(job->buf);
+    job->buf = NULL;
+    job->state = JOB_FREE;
+    fs_async.pending--;
+}
+
+// finishes the job, running it on the calling thread if not yet started
+static void async_wait(asyncjob_t *job)
+{
+    if (__sync_bool_compare_and_swap(&job->state, JOB_QUEUED, JOB_RUNNING))
+        async_run_job(job);
+
+    while (job->state != JOB_DONE)
+        Sys_Sleep(1);
+
+    __sync_synchronize();
+}
+
+static void async_deliver(asyncjob_t *job)
+{
+    byte *buf = NULL;
+
+    if (job->ret >= 0) {
+        buf = job->buf;
+        job->buf = NULL;
+    }
+
+    job->done(job->path, buf, job->ret, job->arg);
+    async_free_job(job);
+}
+
+// frees the batch once all jobs are gone and workers are joined
+static void async_reset(void)
+{
+    int i;
+
+    if (fs_async.pending)
+        return;
+
+    for (i = 0; i < MAX_ASYNC_THREADS; i++)
+        if (fs_async.threads[i])
+            return;
+
+    for (i = 0; i < fs_async.numjobs; i++)
+        Z_Free(fs_async.jobs[i]);
+
+    fs_async.numjobs = fs_async.nextjob = 0;
+}
+
+// completes all requests, called before search paths are freed
+static void async_flush(void)
+{
+    asyncjob_t *job;
+    int i;
+
+    for (i = 0; i < fs_async.numjobs; i++) {
+        job = fs_async.jobs[i];
+        if (job->state == JOB_FREE)
+            continue;
+        async_wait(job);
+        if (job->done)
+            async_deliver(job);
+        else
+            async_free_job(job);
+    }
+
+    for (i = 0; i < MAX_ASYNC_THREADS; i++) {
+        if (fs_async.threads[i]) {
+            Sys_JoinThread(fs_async.threads[i]);
+            fs_async.threads[i] = NULL;
+        }
+    }
+
+    async_reset();
+}
+
+// hands prefetched data over to FS_LoadFileEx
+static qboolean async_claim(const char *path, void **buffer, memtag_t tag, ssize_t *len_p)
+{
+    char normalized[MAX_OSPATH];
+    asyncjob_t *job;
+    byte *buf;
+    int i;
+
+    if (FS_NormalizePathBuffer(normalized, path, sizeof(normalized)) >= sizeof(normalized))
+        return qfalse;
+
+    for (i = 0; i < fs_async.numjobs; i++) {
+        job = fs_async.jobs[i];
+        if (job->state == JOB_FREE || job->done)
+            continue;
+        if (FS_pathcmp(job->path, normalized))
+            continue;
+
+        async_wait(job);
+
+        // nothing to claim for paged in or failed loads, open it normally
+        if (!job->buf || job->ret < 0) {
+            async_free_job(job);
+            return qfalse;
+        }
+
+        buf = job->buf;
+        if (job->tag != tag) {
+            buf = Z_TagMalloc(job->len + 1, tag);
+            memcpy(buf, job->buf, job->len + 1);
+        } else {
+            job->buf = NULL;
+        }
+
+        *buffer = buf;
+        *len_p = job->ret;
+        fs_async.claimed++;
+        async_free_job(job);
+        return qtrue;
+    }
+
+    return qfalse;
+}
+
+/*
+============
+FS_LoadFileAsync
+
+Opens the file and queues it for reading by worker threads. If done callback
+is given, it is called from FS_RunAsync with buffer that must be freed with
+FS_FreeFile, or NULL and error code. Otherwise file is only prefetched for
+FS_LoadFile later in the same frame.
+============
+*/
+qerror_t FS_LoadFileAsync(const char *path, memtag_t tag, fs_loaddone_t done, void *arg)
+{
+    asyncjob_t *job;
+    void *buf;
+    ssize_t len;
+
+    if (!path) {
+        Com_Error(ERR_FATAL, "%s: NULL", __func__);
+    }
+
+    if (!fs_searchpaths) {
+        return Q_ERR_AGAIN; // not yet initialized
+    }
+
+    if (!fs_async_enable->integer || fs_async.numjobs == MAX_ASYNC_JOBS) {
+        if (!done)
+            return Q_ERR_AGAIN;
+        len = FS_LoadFileEx(path, &buf, 0, tag);
+        done(path, buf, len, arg);
+        return len < 0 ? len : Q_ERR_SUCCESS;
+    }
+
+    job = FS_Mallocz(sizeof(*job));
+    job->file.mode = FS_MODE_READ;
+
+    len = FS_NormalizePathBuffer(job->path, path, sizeof(job->path));
+    if (len >= sizeof(job->path)) {
+        len = Q_ERR_NAMETOOLONG;
+        goto fail1;
+    }
+
+    len = expand_open_file_read(&job->file, job->path, qtrue);
+    if (len < 0) {
+        goto fail1;
+    }
+
+    if (len > MAX_LOADFILE) {
+        len = Q_ERR_FBIG;
+        goto fail2;
+    }
+
+#if USE_ZLIB
+    if (job->file.type == FS_ZIP) {
+        // worker inflates with its own stream
+        close_zip_stream(&job->file);
+        job->file.type = FS_PAK;
+        job->deflated = qtrue;
+    }
+#endif
+
+    if (done || job->file.fp || job->deflated) {
+        job->buf = Z_TagMalloc(len + 1, tag);
+    }
+
+    job->len = len;
+    job->tag = tag;
+    job->done = done;
+    job->arg = arg;
+    job->state = JOB_QUEUED;
+
+    fs_async.jobs[fs_async.numjobs] = job;
+    __sync_synchronize();
+    fs_async.numjobs++;
+    fs_async.pending++;
+    fs_async.queued++;
+
+    async_start();
+    return Q_ERR_SUCCESS;
+
+fail2:
+    async_close_file(&job->file);
+fail1:
+    Z_Free(job);
+    if (done)
+        done(path, NULL, len, arg);
+    return len;
+}
+
+/*
+============
+FS_RunAsync
+
+Delivers completed loads and drops unclaimed prefetches. Called once per frame.
+============
+*/
+void FS_RunAsync(void)
+{
+    asyncjob_t *job;
+    int i;
+
+    if (!fs_async.numjobs)
+        return;
+
+    for (i = 0; i < fs_async.numjobs; i++) {
+        job = fs_async.jobs[i];
+        if (job->done) {
+            if (job->state == JOB_DONE) {
+                __sync_synchronize();
+                async_deliver(job);
+            }
+        } else if (job->state == JOB_DONE ||
+                   __sync_bool_compare_and_swap(&job->state, JOB_QUEUED, JOB_RUNNING)) {
+            fs_async.dropped++;
+            async_free_job(job);
+        }
+    }
+
+    async_start();
+    async_reset();
+}
+
 /*
 ============
 FS_LoadFile
@@ -1823,6 +2702,12 @@ ssize_t FS_LoadFileEx(const char *path, void **buffer, unsigned flags, memtag_t
         return Q_ERR_AGAIN; // not yet initialized
     }
 
+    // take over prefetched data
+    if (buffer && fs_async.pending && !(flags & ~FS_FLAG_VIEW) &&
+        async_claim(path, buffer, tag, &len)) {
+        return len;
+    }
+
     // allocate new file handle
     file = alloc_handle(&f);
     if (!file) {
@@ -1848,11 +2733,27 @@ ssize_t FS_LoadFileEx(const char *path, void **buffer, unsigned flags, memtag_t
         goto done;
     }
 
+    // stored entries of mapped packs are returned in place
+    if ((flags & FS_FLAG_VIEW) && file->type == FS_PAK && !file->fp &&
+        fs_numviews < MAX_FILE_VIEWS) {
+        buf = file->pack->map + file->entry->filepos;
+        fs_views[fs_numviews].base = buf;
+        fs_views[fs_numviews].pack = pack_get(file->pack);
+        fs_numviews++;
+        *buffer = buf;
+        goto done;
+    }
+
     // allocate chunk of memory, +1 for NUL
     buf = Z_TagMalloc(len + 1, tag);
 
     // read entire file
-    read = FS_Read(buf, len, f);
+#if USE_ZLIB
+    if (file->type == FS_ZIP)
+        read = inflate_zip_file(file, buf);
+    else
+#endif
+        read = FS_Read(buf, len, f);
     if (read != len) {
         len = read < 0 ? read : Q_ERR_UNEXPECTED_EOF;
         Z_Free(buf);
@@ -1867,6 +2768,32 @@ done:
     return len;
 }
 
+/*
+============
+FS_FreeFile
+
+Frees buffer returned by FS_LoadFile, releasing the pack if it was a view.
+============
+*/
+void FS_FreeFile(void *buf)
+{
+    unsigned i;
+
+    if (!buf) {
+        return;
+    }
+
+    for (i = 0; i < fs_numviews; i++) {
+        if (fs_views[i].base == buf) {
+            pack_put(fs_views[i].pack);
+            fs_views[i] = fs_views[--fs_numviews];
+            return;
+        }
+    }
+
+    Z_Free(buf);
+}
+
 /*
 ================
 FS_WriteFile
@@ -1927,8 +2854,6 @@ qboolean FS_EasyWriteFile(char *buf, size_t size, unsigned mode,
     return qtrue;
 }
 
-#if USE_CLIENT
-
 /*
 ================
 FS_RenameFile
@@ -1969,11 +2894,11 @@ qerror_t FS_RenameFile(const char *from, const char *to)
     if (rename(frompath, topath))
         return Q_Errno();
 
+    index_add_file(topath);
+
     return Q_ERR_SUCCESS;
 }
 
-#endif // USE_CLIENT
-
 /*
 ================
 FS_FPrintf
@@ -2014,6 +2939,9 @@ static void pack_put(pack_t *pack)
     }
     if (!--pack->refcount) {
         FS_DPrintf("Freeing packfile %s\n", pack->filename);
+        if (pack->map) {
+            Sys_UnmapFile(pack->map, pack->mapsize);
+        }
         fclose(pack->fp);
         Z_Free(pack);
     }
@@ -2026,6 +2954,7 @@ static pack_t *pack_alloc(FILE *fp, filetype_t type, const char *name,
     pack_t *pack;
     unsigned hash_size;
     size_t len;
+    file_info_t info;
 
     hash_size = npot32(num_files / 3);
 
@@ -2037,6 +2966,8 @@ static pack_t *pack_alloc(FILE *fp, filetype_t type, const char *name,
     pack->type = type;
     pack->refcount = 0;
     pack->fp = fp;
+    pack->map = NULL;
+    pack->mapsize = 0;
     pack->num_files = num_files;
     pack->hash_size = hash_size;
     pack->files = (packfile_t *)(pack + 1);
@@ -2046,6 +2977,15 @@ static pack_t *pack_alloc(FILE *fp, filetype_t type, const char *name,
     memcpy(pack->filename, name, len);
     memset(pack->file_hash, 0, hash_size * sizeof(packfile_t *));
 
+    // stdio is used as fallback if pack can't be mapped
+    if (fs_mmap->integer && !get_fp_info(fp, &info) &&
+        info.size > 0 && info.size <= LONG_MAX) {
+        pack->map = Sys_MapFile(fp, info.size);
+        if (pack->map) {
+            pack->mapsize = info.size;
+        }
+    }
+
     return pack;
 }
 
@@ -2479,6 +3419,9 @@ static void q_printf(2, 3) add_game_dir(unsigned mode, const char *fmt, ...)
     FS_ReplaceSeparators(fs_gamedir, '/');
 #endif
 
+    // search path is about to change
+    free_index();
+
     // add the directory to the search path
     search = FS_Malloc(sizeof(searchpath_t) + len);
     search->mode = mode;
@@ -3190,6 +4133,12 @@ static void FS_Path_f(void)
         Com_Printf("%i files in PKZ files\n", numFilesInZIP);
     }
 #endif
+
+    if (fs_index.built) {
+        Com_Printf("%u files indexed, %u on disk\n",
+                   fs_index.num_entries + fs_index.num_added,
+                   fs_index.num_disk + fs_index.num_added);
+    }
 }
 
 #ifdef _DEBUG
@@ -3235,6 +4184,18 @@ static void FS_Stats_f(void)
     Com_Printf("Total path comparsions: %d\n", fs_count_strcmp);
     Com_Printf("Total calls to open_from_disk: %d\n", fs_count_open);
     Com_Printf("Total mixed-case reopens: %d\n", fs_count_strlwr);
+    for (path = fs_searchpaths, i = len = 0; path; path = path->next) {
+        if (path->pack) {
+            len += path->pack->map != NULL;
+            i++;
+        }
+    }
+    Com_Printf("Mapped packs: %d of %d, %u file views\n", len, i, fs_numviews);
+    Com_Printf("Async loads: %u queued, %u claimed, %u dropped, %u pending\n",
+               fs_async.queued, fs_async.claimed, fs_async.dropped, fs_async.pending);
+    Com_Printf("Index: %u files, %u on disk, %u added, %u hits, %u misses, %u stale\n",
+               fs_index.num_entries, fs_index.num_disk, fs_index.num_added,
+               fs_index.hits, fs_index.misses, fs_index.stale);
 
     if (!totalHashSize) {
         Com_Printf("No stats to display\n");
@@ -3415,6 +4376,9 @@ static void free_all_paths(void)
 {
     searchpath_t *path, *next;
 
+    async_flush();
+    free_index();
+
     for (path = fs_searchpaths; path; path = next) {
         next = path->next;
         free_search_path(path);
@@ -3427,6 +4391,9 @@ static void free_game_paths(void)
 {
     searchpath_t *path, *next;
 
+    async_flush();
+    free_index();
+
     for (path = fs_searchpaths; path != fs_base_searchpaths; path = next) {
         next = path->next;
         free_search_path(path);
@@ -3648,6 +4615,12 @@ void FS_Init(void)
     fs_debug = Cvar_Get("fs_debug", "0", 0);
 #endif
 
+    fs_index_enable = Cvar_Get("fs_index", "1", 0);
+    fs_index_enable->changed = fs_index_changed;
+
+    fs_mmap = Cvar_Get("fs_mmap", "1", 0);
+    fs_async_enable = Cvar_Get("fs_async", "1", 0);
+
     // get the game cvar and start the filesystem
     fs_game = Cvar_Get("game", DEFGAME, CVAR_LATCH | CVAR_SERVERINFO);
     fs_game->changed = fs_game_changed;
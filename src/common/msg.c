@@ -22,6 +22,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/sizebuf.h"
 #include "common/math.h"
 
+#if USE_SSE2
+#include <emmintrin.h>
+#endif
+
 /*
 ==============================================================================
 
@@ -502,11 +506,101 @@ void MSG_PackEntity(entity_packed_t *out, const entity_state_t *in, qboolean sho
     out->event = in->event;
 }
 
+/*
+==================
+MSG_DiffBytes
+
+Sets bit N of the mask if byte N of the two packed structures differs, so
+that delta encoders can test any field with a single AND instead of a chain
+of per-component comparisons. Size must be between 16 and 128 bytes.
+==================
+*/
+#if USE_TESTS
+qboolean msg_scalar_diff;
+#endif
+
+static inline void MSG_DiffBytes(const void *a, const void *b, size_t size, uint64_t *diff)
+{
+    const byte  *p = a, *q = b;
+    size_t      i;
+#if USE_SSE2
+    uint64_t    m;
+    __m128i     x, y;
+#endif
+
+    diff[0] = diff[1] = 0;
+
+#if USE_TESTS
+    if (msg_scalar_diff)
+        goto scalar;
+#endif
+
+#if USE_SSE2
+    for (i = 0; i + 16 <= size; i += 16) {
+        x = _mm_loadu_si128((const __m128i *)(p + i));
+        y = _mm_loadu_si128((const __m128i *)(q + i));
+        m = _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ 0xffff;
+        diff[i >> 6] |= m << (i & 63);
+    }
+
+    if (i < size) {
+        // overlap the last full vector and drop bytes already compared
+        x = _mm_loadu_si128((const __m128i *)(p + size - 16));
+        y = _mm_loadu_si128((const __m128i *)(q + size - 16));
+        m = _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ 0xffff;
+        diff[i >> 6] |= (m >> (i - (size - 16))) << (i & 63);
+    }
+    return;
+#endif
+
+#if USE_TESTS
+scalar:
+#endif
+    for (i = 0; i < size; i++)
+        if (p[i] != q[i])
+            diff[i >> 6] |= (uint64_t)1 << (i & 63);
+}
+
+// returns mask bits covering bytes [ofs, ofs + len), len <= 64
+static inline uint64_t MSG_DiffRange(const uint64_t *diff, size_t ofs, size_t len)
+{
+    uint64_t v = diff[ofs >> 6] >> (ofs & 63);
+
+    if ((ofs & 63) + len > 64)
+        v |= diff[(ofs >> 6) + 1] << (64 - (ofs & 63));
+    if (len < 64)
+        v &= ((uint64_t)1 << len) - 1;
+
+    return v;
+}
+
+#define MSG_DIFF(type, field) \
+    MSG_DiffRange(diff, q_offsetof(type, field), sizeof(((type *)0)->field))
+
+#define ES_DIFF(field)  MSG_DIFF(entity_packed_t, field)
+#define PS_DIFF(field)  MSG_DIFF(player_packed_t, field)
+
+// folds byte mask of stats array into one bit per stat
+static inline int MSG_DiffStats(const uint64_t *diff)
+{
+    uint64_t x = PS_DIFF(stats);
+
+    x = (x | (x >> 1)) & 0x5555555555555555ULL;
+    x = (x | (x >> 1)) & 0x3333333333333333ULL;
+    x = (x | (x >> 2)) & 0x0f0f0f0f0f0f0f0fULL;
+    x = (x | (x >> 4)) & 0x00ff00ff00ff00ffULL;
+    x = (x | (x >> 8)) & 0x0000ffff0000ffffULL;
+    x = (x | (x >> 16)) & 0x00000000ffffffffULL;
+
+    return (int)(uint32_t)x;
+}
+
 void MSG_WriteDeltaEntity(const entity_packed_t *from,
                           const entity_packed_t *to,
                           msgEsFlags_t          flags)
 {
     uint32_t    bits, mask;
+    uint64_t    diff[2];
 
     if (!to) {
         if (!from)
@@ -540,29 +634,25 @@ void MSG_WriteDeltaEntity(const entity_packed_t *from,
 // send an update
     bits = 0;
 
+    MSG_DiffBytes(from, to, sizeof(*to), diff);
+
     if (!(flags & MSG_ES_FIRSTPERSON)) {
-        if (to->origin[0] != from->origin[0])
+        if (ES_DIFF(origin[0]))
             bits |= U_ORIGIN1;
-        if (to->origin[1] != from->origin[1])
+        if (ES_DIFF(origin[1]))
             bits |= U_ORIGIN2;
-        if (to->origin[2] != from->origin[2])
+        if (ES_DIFF(origin[2]))
             bits |= U_ORIGIN3;
 
-        if (flags & MSG_ES_SHORTANGLES) {
-            if (to->angles[0] != from->angles[0])
-                bits |= U_ANGLE1 | U_ANGLE16;
-            if (to->angles[1] != from->angles[1])
-                bits |= U_ANGLE2 | U_ANGLE16;
-            if (to->angles[2] != from->angles[2])
-                bits |= U_ANGLE3 | U_ANGLE16;
-        } else {
-            if (to->angles[0] != from->angles[0])
-                bits |= U_ANGLE1;
-            if (to->angles[1] != from->angles[1])
-                bits |= U_ANGLE2;
-            if (to->angles[2] != from->angles[2])
-                bits |= U_ANGLE3;
-        }
+        if (ES_DIFF(angles[0]))
+            bits |= U_ANGLE1;
+        if (ES_DIFF(angles[1]))
+            bits |= U_ANGLE2;
+        if (ES_DIFF(angles[2]))
+            bits |= U_ANGLE3;
+
+        if ((flags & MSG_ES_SHORTANGLES) && (bits & (U_ANGLE1 | U_ANGLE2 | U_ANGLE3)))
+            bits |= U_ANGLE16;
 
         if (flags & MSG_ES_NEWENTITY) {
             if (to->old_origin[0] != from->origin[0] ||
@@ -577,7 +667,7 @@ void MSG_WriteDeltaEntity(const entity_packed_t *from,
     else
         mask = 0xffff8000;  // don't confuse old clients
 
-    if (to->skinnum != from->skinnum) {
+    if (ES_DIFF(skinnum)) {
         if (to->skinnum & mask)
             bits |= U_SKIN8 | U_SKIN16;
         else if (to->skinnum & 0x0000ff00)
@@ -586,14 +676,14 @@ void MSG_WriteDeltaEntity(const entity_packed_t *from,
             bits |= U_SKIN8;
     }
 
-    if (to->frame != from->frame) {
+    if (ES_DIFF(frame)) {
         if (to->frame & 0xff00)
             bits |= U_FRAME16;
         else
             bits |= U_FRAME8;
     }
 
-    if (to->effects != from->effects) {
+    if (ES_DIFF(effects)) {
         if (to->effects & mask)
             bits |= U_EFFECTS8 | U_EFFECTS16;
         else if (to->effects & 0x0000ff00)
@@ -602,7 +692,7 @@ void MSG_WriteDeltaEntity(const entity_packed_t *from,
             bits |= U_EFFECTS8;
     }
 
-    if (to->renderfx != from->renderfx) {
+    if (ES_DIFF(renderfx)) {
         if (to->renderfx & mask)
             bits |= U_RENDERFX8 | U_RENDERFX16;
         else if (to->renderfx & 0x0000ff00)
@@ -611,32 +701,30 @@ void MSG_WriteDeltaEntity(const entity_packed_t *from,
             bits |= U_RENDERFX8;
     }
 
-    if (to->solid != from->solid)
+    if (ES_DIFF(solid))
         bits |= U_SOLID;
 
     // event is not delta compressed, just 0 compressed
     if (to->event)
         bits |= U_EVENT;
 
-    if (to->modelindex != from->modelindex)
+    if (ES_DIFF(modelindex))
         bits |= U_MODEL;
-    if (to->modelindex2 != from->modelindex2)
+    if (ES_DIFF(modelindex2))
         bits |= U_MODEL2;
-    if (to->modelindex3 != from->modelindex3)
+    if (ES_DIFF(modelindex3))
         bits |= U_MODEL3;
-    if (to->modelindex4 != from->modelindex4)
+    if (ES_DIFF(modelindex4))
         bits |= U_MODEL4;
 
-    if (to->sound != from->sound)
+    if (ES_DIFF(sound))
         bits |= U_SOUND;
 
     if (to->renderfx & RF_FRAMELERP) {
         bits |= U_OLDORIGIN;
     } else if (to->renderfx & RF_BEAM) {
         if (flags & MSG_ES_BEAMORIGIN) {
-            if (to->old_origin[0] != from->old_origin[0] ||
-                to->old_origin[1] != from->old_origin[1] ||
-                to->old_origin[2] != from->old_origin[2])
+            if (ES_DIFF(old_origin))
                 bits |= U_OLDORIGIN;
         } else {
             bits |= U_OLDORIGIN;
@@ -794,9 +882,10 @@ void MSG_PackPlayer(player_packed_t *out, const player_state_t *in)
 
 void MSG_WriteDeltaPlayerstate_Default(const player_packed_t *from, const player_packed_t *to)
 {
-    int     i;
-    int     pflags;
-    int     statbits;
+    int         i;
+    int         pflags;
+    int         statbits;
+    uint64_t    diff[2];
 
     if (!to)
         Com_Error(ERR_DROP, "%s: NULL", __func__);
@@ -809,70 +898,51 @@ void MSG_WriteDeltaPlayerstate_Default(const player_packed_t *from, const player
     //
     pflags = 0;
 
-    if (to->pmove.pm_type != from->pmove.pm_type)
+    MSG_DiffBytes(from, to, sizeof(*to), diff);
+
+    if (PS_DIFF(pmove.pm_type))
         pflags |= PS_M_TYPE;
 
-    if (to->pmove.origin[0] != from->pmove.origin[0] ||
-        to->pmove.origin[1] != from->pmove.origin[1] ||
-        to->pmove.origin[2] != from->pmove.origin[2])
+    if (PS_DIFF(pmove.origin))
         pflags |= PS_M_ORIGIN;
 
-    if (to->pmove.velocity[0] != from->pmove.velocity[0] ||
-        to->pmove.velocity[1] != from->pmove.velocity[1] ||
-        to->pmove.velocity[2] != from->pmove.velocity[2])
+    if (PS_DIFF(pmove.velocity))
         pflags |= PS_M_VELOCITY;
 
-    if (to->pmove.pm_time != from->pmove.pm_time)
+    if (PS_DIFF(pmove.pm_time))
         pflags |= PS_M_TIME;
 
-    if (to->pmove.pm_flags != from->pmove.pm_flags)
+    if (PS_DIFF(pmove.pm_flags))
         pflags |= PS_M_FLAGS;
 
-    if (to->pmove.gravity != from->pmove.gravity)
+    if (PS_DIFF(pmove.gravity))
         pflags |= PS_M_GRAVITY;
 
-    if (to->pmove.delta_angles[0] != from->pmove.delta_angles[0] ||
-        to->pmove.delta_angles[1] != from->pmove.delta_angles[1] ||
-        to->pmove.delta_angles[2] != from->pmove.delta_angles[2])
+    if (PS_DIFF(pmove.delta_angles))
         pflags |= PS_M_DELTA_ANGLES;
 
-    if (to->viewoffset[0] != from->viewoffset[0] ||
-        to->viewoffset[1] != from->viewoffset[1] ||
-        to->viewoffset[2] != from->viewoffset[2])
+    if (PS_DIFF(viewoffset))
         pflags |= PS_VIEWOFFSET;
 
-    if (to->viewangles[0] != from->viewangles[0] ||
-        to->viewangles[1] != from->viewangles[1] ||
-        to->viewangles[2] != from->viewangles[2])
+    if (PS_DIFF(viewangles))
         pflags |= PS_VIEWANGLES;
 
-    if (to->kick_angles[0] != from->kick_angles[0] ||
-        to->kick_angles[1] != from->kick_angles[1] ||
-        to->kick_angles[2] != from->kick_angles[2])
+    if (PS_DIFF(kick_angles))
         pflags |= PS_KICKANGLES;
 
-    if (to->blend[0] != from->blend[0] ||
-        to->blend[1] != from->blend[1] ||
-        to->blend[2] != from->blend[2] ||
-        to->blend[3] != from->blend[3])
+    if (PS_DIFF(blend))
         pflags |= PS_BLEND;
 
-    if (to->fov != from->fov)
+    if (PS_DIFF(fov))
         pflags |= PS_FOV;
 
-    if (to->rdflags != from->rdflags)
+    if (PS_DIFF(rdflags))
         pflags |= PS_RDFLAGS;
 
-    if (to->gunframe != from->gunframe ||
-        to->gunoffset[0] != from->gunoffset[0] ||
-        to->gunoffset[1] != from->gunoffset[1] ||
-        to->gunoffset[2] != from->gunoffset[2] ||
-        to->gunangles[0] != from->gunangles[0] ||
-        to->gunangles[1] != from->gunangles[1] ||
-        to->gunangles[2] != from->gunangles[2])
+    if (PS_DIFF(gunframe) || PS_DIFF(gunoffset) || PS_DIFF(gunangles))
         pflags |= PS_WEAPONFRAME;
 
-    if (to->gunindex != from->gunindex)
+    if (PS_DIFF(gunindex))
         pflags |= PS_WEAPONINDEX;
 
     //
@@ -961,10 +1031,7 @@ void MSG_WriteDeltaPlayerstate_Default(const player_packed_t *from, const player
         MSG_WriteByte(to->rdflags);
 
     // send stats
-    statbits = 0;
-    for (i = 0; i < MAX_STATS; i++)
-        if (to->stats[i] != from->stats[i])
-            statbits |= 1 << i;
+    statbits = MSG_DiffStats(diff);
 
     MSG_WriteLong(statbits);
     for (i = 0; i < MAX_STATS; i++)
@@ -976,9 +1043,10 @@ int MSG_WriteDeltaPlayerstate_Enhanced(const player_packed_t    *from,
                                              player_packed_t    *to,
                                              msgPsFlags_t       flags)
 {
-    int     i;
-    int     pflags, eflags;
-    int     statbits;
+    int         i;
+    int         pflags, eflags;
+    int         statbits;
+    uint64_t    diff[2];
 
     if (!to)
         Com_Error(ERR_DROP, "%s: NULL", __func__);
@@ -992,31 +1060,32 @@ int MSG_WriteDeltaPlayerstate_Enhanced(const player_packed_t    *from,
     pflags = 0;
     eflags = 0;
 
-    if (to->pmove.pm_type != from->pmove.pm_type)
+    // fields overwritten below are never tested after being overwritten
+    MSG_DiffBytes(from, to, sizeof(*to), diff);
+
+    if (PS_DIFF(pmove.pm_type))
         pflags |= PS_M_TYPE;
 
-    if (to->pmove.origin[0] != from->pmove.origin[0] ||
-        to->pmove.origin[1] != from->pmove.origin[1])
+    if (PS_DIFF(pmove.origin[0]) || PS_DIFF(pmove.origin[1]))
         pflags |= PS_M_ORIGIN;
 
-    if (to->pmove.origin[2] != from->pmove.origin[2])
+    if (PS_DIFF(pmove.origin[2]))
         eflags |= EPS_M_ORIGIN2;
 
     if (!(flags & MSG_PS_IGNORE_PREDICTION)) {
-        if (to->pmove.velocity[0] != from->pmove.velocity[0] ||
-            to->pmove.velocity[1] != from->pmove.velocity[1])
+        if (PS_DIFF(pmove.velocity[0]) || PS_DIFF(pmove.velocity[1]))
             pflags |= PS_M_VELOCITY;
 
-        if (to->pmove.velocity[2] != from->pmove.velocity[2])
+        if (PS_DIFF(pmove.velocity[2]))
             eflags |= EPS_M_VELOCITY2;
 
-        if (to->pmove.pm_time != from->pmove.pm_time)
+        if (PS_DIFF(pmove.pm_time))
             pflags |= PS_M_TIME;
 
-        if (to->pmove.pm_flags != from->pmove.pm_flags)
+        if (PS_DIFF(pmove.pm_flags))
             pflags |= PS_M_FLAGS;
 
-        if (to->pmove.gravity != from->pmove.gravity)
+        if (PS_DIFF(pmove.gravity))
             pflags |= PS_M_GRAVITY;
     } else {
         // save previous state
@@ -1027,26 +1096,21 @@ int MSG_WriteDeltaPlayerstate_Enhanced(const player_packed_t    *from,
     }
 
     if (!(flags & MSG_PS_IGNORE_DELTAANGLES)) {
-        if (to->pmove.delta_angles[0] != from->pmove.delta_angles[0] ||
-            to->pmove.delta_angles[1] != from->pmove.delta_angles[1] ||
-            to->pmove.delta_angles[2] != from->pmove.delta_angles[2])
+        if (PS_DIFF(pmove.delta_angles))
             pflags |= PS_M_DELTA_ANGLES;
     } else {
         // save previous state
         VectorCopy(from->pmove.delta_angles, to->pmove.delta_angles);
     }
 
-    if (from->viewoffset[0] != to->viewoffset[0] ||
-        from->viewoffset[1] != to->viewoffset[1] ||
-        from->viewoffset[2] != to->viewoffset[2])
+    if (PS_DIFF(viewoffset))
         pflags |= PS_VIEWOFFSET;
 
     if (!(flags & MSG_PS_IGNORE_VIEWANGLES)) {
-        if (from->viewangles[0] != to->viewangles[0] ||
-            from->viewangles[1] != to->viewangles[1])
+        if (PS_DIFF(viewangles[0]) || PS_DIFF(viewangles[1]))
             pflags |= PS_VIEWANGLES;
 
-        if (from->viewangles[2] != to->viewangles[2])
+        if (PS_DIFF(viewangles[2]))
             eflags |= EPS_VIEWANGLE2;
     } else {
         // save previous state
@@ -1055,16 +1119,11 @@ int MSG_WriteDeltaPlayerstate_Enhanced(const player_packed_t    *from,
         to->viewangles[2] = from->viewangles[2];
     }
 
-    if (from->kick_angles[0] != to->kick_angles[0] ||
-        from->kick_angles[1] != to->kick_angles[1] ||
-        from->kick_angles[2] != to->kick_angles[2])
+    if (PS_DIFF(kick_angles))
         pflags |= PS_KICKANGLES;
 
     if (!(flags & MSG_PS_IGNORE_BLEND)) {
-        if (from->blend[0] != to->blend[0] ||
-            from->blend[1] != to->blend[1] ||
-            from->blend[2] != to->blend[2] ||
-            from->blend[3] != to->blend[3])
+        if (PS_DIFF(blend))
             pflags |= PS_BLEND;
     } else {
         // save previous state
@@ -1074,14 +1133,14 @@ int MSG_WriteDeltaPlayerstate_Enhanced(const player_packed_t    *from,
         to->blend[3] = from->blend[3];
     }
 
-    if (from->fov != to->fov)
+    if (PS_DIFF(fov))
         pflags |= PS_FOV;
 
-    if (to->rdflags != from->rdflags)
+    if (PS_DIFF(rdflags))
         pflags |= PS_RDFLAGS;
 
     if (!(flags & MSG_PS_IGNORE_GUNINDEX)) {
-        if (to->gunindex != from->gunindex)
+        if (PS_DIFF(gunindex))
             pflags |= PS_WEAPONINDEX;
     } else {
         // save previous state
@@ -1089,17 +1148,13 @@ int MSG_WriteDeltaPlayerstate_Enhanced(const player_packed_t    *from,
     }
 
     if (!(flags & MSG_PS_IGNORE_GUNFRAMES)) {
-        if (to->gunframe != from->gunframe)
+        if (PS_DIFF(gunframe))
             pflags |= PS_WEAPONFRAME;
 
-        if (from->gunoffset[0] != to->gunoffset[0] ||
-            from->gunoffset[1] != to->gunoffset[1] ||
-            from->gunoffset[2] != to->gunoffset[2])
+        if (PS_DIFF(gunoffset))
             eflags |= EPS_GUNOFFSET;
 
-        if (from->gunangles[0] != to->gunangles[0] ||
-            from->gunangles[1] != to->gunangles[1] ||
-            from->gunangles[2] != to->gunangles[2])
+        if (PS_DIFF(gunangles))
             eflags |= EPS_GUNANGLES;
     } else {
         // save previous state
@@ -1114,11 +1169,7 @@ int MSG_WriteDeltaPlayerstate_Enhanced(const player_packed_t    *from,
         to->gunangles[2] = from->gunangles[2];
     }
 
-    statbits = 0;
-    for (i = 0; i < MAX_STATS; i++)
-        if (to->stats[i] != from->stats[i])
-            statbits |= 1 << i;
-
+    statbits = MSG_DiffStats(diff);
     if (statbits)
         eflags |= EPS_STATS;
 
@@ -1244,9 +1295,10 @@ void MSG_WriteDeltaPlayerstate_Packet(const player_packed_t *from,
                                       int                   number,
                                       msgPsFlags_t          flags)
 {
-    int     i;
-    int     pflags;
-    int     statbits;
+    int         i;
+    int         pflags;
+    int         statbits;
+    uint64_t    diff[2];
 
     if (number < 0 || number >= MAX_CLIENTS)
         Com_Error(ERR_DROP, "%s: bad number: %d", __func__, number);
@@ -1265,72 +1317,57 @@ void MSG_WriteDeltaPlayerstate_Packet(const player_packed_t *from,
     //
     pflags = 0;
 
-    if (to->pmove.pm_type != from->pmove.pm_type)
+    MSG_DiffBytes(from, to, sizeof(*to), diff);
+
+    if (PS_DIFF(pmove.pm_type))
         pflags |= PPS_M_TYPE;
 
-    if (to->pmove.origin[0] != from->pmove.origin[0] ||
-        to->pmove.origin[1] != from->pmove.origin[1])
+    if (PS_DIFF(pmove.origin[0]) || PS_DIFF(pmove.origin[1]))
         pflags |= PPS_M_ORIGIN;
 
-    if (to->pmove.origin[2] != from->pmove.origin[2])
+    if (PS_DIFF(pmove.origin[2]))
         pflags |= PPS_M_ORIGIN2;
 
-    if (from->viewoffset[0] != to->viewoffset[0] ||
-        from->viewoffset[1] != to->viewoffset[1] ||
-        from->viewoffset[2] != to->viewoffset[2])
+    if (PS_DIFF(viewoffset))
         pflags |= PPS_VIEWOFFSET;
 
-    if (from->viewangles[0] != to->viewangles[0] ||
-        from->viewangles[1] != to->viewangles[1])
+    if (PS_DIFF(viewangles[0]) || PS_DIFF(viewangles[1]))
         pflags |= PPS_VIEWANGLES;
 
-    if (from->viewangles[2] != to->viewangles[2])
+    if (PS_DIFF(viewangles[2]))
         pflags |= PPS_VIEWANGLE2;
 
-    if (from->kick_angles[0] != to->kick_angles[0] ||
-        from->kick_angles[1] != to->kick_angles[1] ||
-        from->kick_angles[2] != to->kick_angles[2])
+    if (PS_DIFF(kick_angles))
         pflags |= PPS_KICKANGLES;
 
     if (!(flags & MSG_PS_IGNORE_BLEND)) {
-        if (from->blend[0] != to->blend[0] ||
-            from->blend[1] != to->blend[1] ||
-            from->blend[2] != to->blend[2] ||
-            from->blend[3] != to->blend[3])
+        if (PS_DIFF(blend))
             pflags |= PPS_BLEND;
     }
 
-    if (from->fov != to->fov)
+    if (PS_DIFF(fov))
         pflags |= PPS_FOV;
 
-    if (to->rdflags != from->rdflags)
+    if (PS_DIFF(rdflags))
         pflags |= PPS_RDFLAGS;
 
     if (!(flags & MSG_PS_IGNORE_GUNINDEX)) {
-        if (to->gunindex != from->gunindex)
+        if (PS_DIFF(gunindex))
             pflags |= PPS_WEAPONINDEX;
     }
 
     if (!(flags & MSG_PS_IGNORE_GUNFRAMES)) {
-        if (to->gunframe != from->gunframe)
+        if (PS_DIFF(gunframe))
             pflags |= PPS_WEAPONFRAME;
 
-        if (from->gunoffset[0] != to->gunoffset[0] ||
-            from->gunoffset[1] != to->gunoffset[1] ||
-            from->gunoffset[2] != to->gunoffset[2])
+        if (PS_DIFF(gunoffset))
             pflags |= PPS_GUNOFFSET;
 
-        if (from->gunangles[0] != to->gunangles[0] ||
-            from->gunangles[1] != to->gunangles[1] ||
-            from->gunangles[2] != to->gunangles[2])
+        if (PS_DIFF(gunangles))
             pflags |= PPS_GUNANGLES;
     }
 
-    statbits = 0;
-    for (i = 0; i < MAX_STATS; i++)
-        if (to->stats[i] != from->stats[i])
-            statbits |= 1 << i;
-
+    statbits = MSG_DiffStats(diff);
     if (statbits)
         pflags |= PPS_STATS;
 
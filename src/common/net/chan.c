@@ -17,6 +17,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "shared/shared.h"
+#include "common/cmd.h"
 #include "common/common.h"
 #include "common/cvar.h"
 #include "common/msg.h"
@@ -99,6 +100,70 @@ cvar_t      *net_qport;
 cvar_t      *net_maxmsglen;
 cvar_t      *net_chantype;
 
+// two ints, qport and fragment offset (worst case)
+#define MAX_PACKET_HEADER   12
+
+// packets are sent directly from header, reliable and unreliable buffers
+typedef struct {
+    void        *data[3];
+    size_t      len[3];
+    int         count;
+    size_t      total;
+} ncpacket_t;
+
+// payload bytes moved around by netchan, excluding packet headers
+static struct {
+    uint64_t    packets_sent;
+    uint64_t    bytes_sent;
+    uint64_t    copied_sent;
+    uint64_t    packets_rcvd;
+    uint64_t    bytes_rcvd;
+    uint64_t    copied_rcvd;
+} nc_stats;
+
+static void add_packet_data(ncpacket_t *p, const void *data, size_t len)
+{
+    if (!len) {
+        return;
+    }
+
+    p->data[p->count] = (void *)data;
+    p->len[p->count] = len;
+    p->count++;
+    p->total += len;
+}
+
+static void send_packet(netchan_t *netchan, ncpacket_t *p, size_t header)
+{
+    NET_SendPacketV(netchan->sock, p->data, p->len, p->count,
+                    &netchan->remote_address);
+
+    nc_stats.packets_sent++;
+    nc_stats.bytes_sent += p->total - header;
+}
+
+/*
+===============
+Netchan_Stats_f
+===============
+*/
+static void Netchan_Stats_f(void)
+{
+    if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset")) {
+        memset(&nc_stats, 0, sizeof(nc_stats));
+        return;
+    }
+
+    Com_Printf("Packets sent: %"PRIu64", %"PRIu64" bytes, "
+               "%"PRIu64" copied (%.1f per packet)\n",
+               nc_stats.packets_sent, nc_stats.bytes_sent, nc_stats.copied_sent,
+               (double)nc_stats.copied_sent / max(nc_stats.packets_sent, 1));
+    Com_Printf("Packets rcvd: %"PRIu64", %"PRIu64" bytes, "
+               "%"PRIu64" copied (%.1f per packet)\n",
+               nc_stats.packets_rcvd, nc_stats.bytes_rcvd, nc_stats.copied_rcvd,
+               (double)nc_stats.copied_rcvd / max(nc_stats.packets_rcvd, 1));
+}
+
 // allow either 0 (no hard limit), or an integer between 512 and 4086
 static void net_maxmsglen_changed(cvar_t *self)
 {
@@ -128,6 +193,8 @@ void Netchan_Init(void)
     net_maxmsglen = Cvar_Get("net_maxmsglen", va("%d", MAX_PACKETLEN_WRITABLE_DEFAULT), 0);
     net_maxmsglen->changed = net_maxmsglen_changed;
     net_chantype = Cvar_Get("net_chantype", "1", 0);
+
+    Cmd_AddCommand("netchan_stats", Netchan_Stats_f);
 }
 
 /*
@@ -185,7 +252,8 @@ static size_t NetchanOld_Transmit(netchan_t *netchan, size_t length, const void
 {
     netchan_old_t *chan = (netchan_old_t *)netchan;
     sizebuf_t   send;
-    byte        send_buf[MAX_PACKETLEN];
+    byte        send_buf[MAX_PACKET_HEADER];
+    ncpacket_t  packet;
     qboolean    send_reliable;
     uint32_t    w1, w2;
     int         i;
@@ -211,6 +279,7 @@ static size_t NetchanOld_Transmit(netchan_t *netchan, size_t length, const void
         send_reliable = qtrue;
         memcpy(chan->reliable_buf, chan->message_buf,
                netchan->message.cursize);
+        nc_stats.copied_sent += netchan->message.cursize;
         netchan->reliable_length = netchan->message.cursize;
         netchan->message.cursize = 0;
         chan->reliable_sequence ^= 1;
@@ -238,21 +307,24 @@ static size_t NetchanOld_Transmit(netchan_t *netchan, size_t length, const void
     }
 #endif
 
-// copy the reliable message to the packet first
+    memset(&packet, 0, sizeof(packet));
+    add_packet_data(&packet, send.data, send.cursize);
+
+// reliable message goes to the packet first
     if (send_reliable) {
-        SZ_Write(&send, chan->reliable_buf, netchan->reliable_length);
+        add_packet_data(&packet, chan->reliable_buf, netchan->reliable_length);
         chan->last_reliable_sequence = netchan->outgoing_sequence;
     }
 
 // add the unreliable part if space is available
-    if (send.maxsize - send.cursize >= length)
-        SZ_Write(&send, data, length);
+    if (MAX_PACKETLEN - packet.total >= length)
+        add_packet_data(&packet, data, length);
     else
         Com_WPrintf("%s: dumped unreliable\n",
                     NET_AdrToString(&netchan->remote_address));
 
     SHOWPACKET("send %4"PRIz" : s=%d ack=%d rack=%d",
-               send.cursize,
+               packet.total,
                netchan->outgoing_sequence,
                netchan->incoming_sequence,
                chan->incoming_reliable_sequence);
@@ -263,15 +335,14 @@ static size_t NetchanOld_Transmit(netchan_t *netchan, size_t length, const void
 
     // send the datagram
     for (i = 0; i < numpackets; i++) {
-        NET_SendPacket(netchan->sock, send.data, send.cursize,
-                       &netchan->remote_address);
+        send_packet(netchan, &packet, send.cursize);
     }
 
     netchan->outgoing_sequence++;
     netchan->reliable_ack_pending = qfalse;
     netchan->last_sent = com_localTime;
 
-    return send.cursize * numpackets;
+    return packet.total * numpackets;
 }
 
 /*
@@ -438,7 +509,8 @@ static size_t NetchanNew_TransmitNextFragment(netchan_t *netchan)
 {
     netchan_new_t *chan = (netchan_new_t *)netchan;
     sizebuf_t   send;
-    byte        send_buf[MAX_PACKETLEN];
+    byte        send_buf[MAX_PACKET_HEADER];
+    ncpacket_t  packet;
     qboolean    send_reliable;
     uint32_t    w1, w2;
     uint16_t    offset;
@@ -481,13 +553,15 @@ static size_t NetchanNew_TransmitNextFragment(netchan_t *netchan)
              (more_fragments << 15);
     SZ_WriteShort(&send, offset);
 
-    // write fragment contents
-    SZ_Write(&send, chan->fragment_out.data + chan->fragment_out.readcount,
-             fragment_length);
+    // fragment contents are sent directly from fragment buffer
+    memset(&packet, 0, sizeof(packet));
+    add_packet_data(&packet, send.data, send.cursize);
+    add_packet_data(&packet, chan->fragment_out.data +
+                    chan->fragment_out.readcount, fragment_length);
 
     SHOWPACKET("send %4"PRIz" : s=%d ack=%d rack=%d "
                "fragment_offset=%"PRIz" more_fragments=%d",
-               send.cursize,
+               packet.total,
                netchan->outgoing_sequence,
                netchan->incoming_sequence,
                chan->incoming_reliable_sequence,
@@ -498,6 +572,9 @@ static size_t NetchanNew_TransmitNextFragment(netchan_t *netchan)
     }
     SHOWPACKET("\n");
 
+    // send the datagram before fragment buffer is cleared
+    send_packet(netchan, &packet, send.cursize);
+
     chan->fragment_out.readcount += fragment_length;
     netchan->fragment_pending = more_fragments;
 
@@ -508,11 +585,7 @@ static size_t NetchanNew_TransmitNextFragment(netchan_t *netchan)
         SZ_Clear(&chan->fragment_out);
     }
 
-    // send the datagram
-    NET_SendPacket(netchan->sock, send.data, send.cursize,
-                   &netchan->remote_address);
-
-    return send.cursize;
+    return packet.total;
 }
 
 /*
@@ -524,7 +597,8 @@ static size_t NetchanNew_Transmit(netchan_t *netchan, size_t length, const void
 {
     netchan_new_t *chan = (netchan_new_t *)netchan;
     sizebuf_t   send;
-    byte        send_buf[MAX_PACKETLEN];
+    byte        send_buf[MAX_PACKET_HEADER];
+    ncpacket_t  packet;
     qboolean    send_reliable;
     uint32_t    w1, w2;
     int         i;
@@ -554,6 +628,7 @@ static size_t NetchanNew_Transmit(netchan_t *netchan, size_t length, const void
         send_reliable = qtrue;
         memcpy(chan->reliable_buf, chan->message_buf,
                netchan->message.cursize);
+        nc_stats.copied_sent += netchan->message.cursize;
         netchan->reliable_length = netchan->message.cursize;
         netchan->message.cursize = 0;
         chan->reliable_sequence ^= 1;
@@ -565,11 +640,13 @@ static size_t NetchanNew_Transmit(netchan_t *netchan, size_t length, const void
             chan->last_reliable_sequence = netchan->outgoing_sequence;
             SZ_Write(&chan->fragment_out, chan->reliable_buf,
                      netchan->reliable_length);
+            nc_stats.copied_sent += netchan->reliable_length;
         }
         // add the unreliable part if space is available
-        if (chan->fragment_out.maxsize - chan->fragment_out.cursize >= length)
+        if (chan->fragment_out.maxsize - chan->fragment_out.cursize >= length) {
             SZ_Write(&chan->fragment_out, data, length);
-        else
+            nc_stats.copied_sent += length;
+        } else
             Com_WPrintf("%s: dumped unreliable\n",
                         NET_AdrToString(&netchan->remote_address));
         return NetchanNew_TransmitNextFragment(netchan);
@@ -592,17 +669,20 @@ static size_t NetchanNew_Transmit(netchan_t *netchan, size_t length, const void
     }
 #endif
 
-    // copy the reliable message to the packet first
+    memset(&packet, 0, sizeof(packet));
+    add_packet_data(&packet, send.data, send.cursize);
+
+    // reliable message goes to the packet first
     if (send_reliable) {
         chan->last_reliable_sequence = netchan->outgoing_sequence;
-        SZ_Write(&send, chan->reliable_buf, netchan->reliable_length);
+        add_packet_data(&packet, chan->reliable_buf, netchan->reliable_length);
     }
 
     // add the unreliable part
-    SZ_Write(&send, data, length);
+    add_packet_data(&packet, data, length);
 
     SHOWPACKET("send %4"PRIz" : s=%d ack=%d rack=%d",
-               send.cursize,
+               packet.total,
                netchan->outgoing_sequence,
                netchan->incoming_sequence,
                chan->incoming_reliable_sequence);
@@ -613,15 +693,14 @@ static size_t NetchanNew_Transmit(netchan_t *netchan, size_t length, const void
 
     // send the datagram
     for (i = 0; i < numpackets; i++) {
-        NET_SendPacket(netchan->sock, send.data, send.cursize,
-                       &netchan->remote_address);
+        send_packet(netchan, &packet, send.cursize);
     }
 
     netchan->outgoing_sequence++;
     netchan->reliable_ack_pending = qfalse;
     netchan->last_sent = com_localTime;
 
-    return send.cursize * numpackets;
+    return packet.total * numpackets;
 }
 
 /*
@@ -735,17 +814,31 @@ static qboolean NetchanNew_Process(netchan_t *netchan)
             return qfalse;
         }
 
-        SZ_Write(&chan->fragment_in, msg_read.data +
-                 msg_read.readcount, length);
+        nc_stats.packets_rcvd++;
+        nc_stats.bytes_rcvd += length;
+
         if (more_fragments) {
+            SZ_Write(&chan->fragment_in, msg_read.data +
+                     msg_read.readcount, length);
+            nc_stats.copied_rcvd += length;
             return qfalse;
         }
 
-        // message has been sucessfully assembled
+        // assemble message in place, moving the last fragment behind the
+        // ones received before. msg_read can't point into fragment buffer
+        // as netchan may be freed while the message is being parsed.
+        memmove(msg_read.data + chan->fragment_in.cursize,
+                msg_read.data + msg_read.readcount, length);
+        memcpy(msg_read.data, chan->fragment_in.data,
+               chan->fragment_in.cursize);
+        nc_stats.copied_rcvd += chan->fragment_in.cursize + length;
+
         SZ_Clear(&msg_read);
-        SZ_Write(&msg_read, chan->fragment_in.data,
-                 chan->fragment_in.cursize);
+        msg_read.cursize = chan->fragment_in.cursize + length;
         SZ_Clear(&chan->fragment_in);
+    } else {
+        nc_stats.packets_rcvd++;
+        nc_stats.bytes_rcvd += msg_read.cursize - msg_read.readcount;
     }
 
     netchan->incoming_sequence = sequence;
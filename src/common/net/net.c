@@ -64,6 +64,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // prevents infinite retry loops caused by broken TCP/IP stacks
 #define MAX_ERROR_RETRIES   64
 
+// maximum number of buffers a datagram can be gathered from
+#define MAX_PACKET_IOV      4
+
 #if USE_CLIENT
 
 #define MAX_LOOPBACK    4
@@ -139,6 +142,8 @@ static uint64_t     net_bytes_rcvd;
 static uint64_t     net_bytes_sent;
 static uint64_t     net_packets_rcvd;
 static uint64_t     net_packets_sent;
+static uint64_t     net_stream_recvs;
+static uint64_t     net_stream_sends;
 
 //=============================================================================
 
@@ -516,6 +521,8 @@ static void NET_Stats_f(void)
                net_packets_sent, net_packets_sent / diff);
     Com_Printf("Packets rcvd: %"PRIu64" (%"PRIu64" packets/sec)\n",
                net_packets_rcvd, net_packets_rcvd / diff);
+    Com_Printf("Stream calls: %"PRIu64"/%"PRIu64" (send/recv)\n",
+               net_stream_sends, net_stream_recvs);
 #if USE_ICMP
     Com_Printf("Total errors: %"PRIu64"/%"PRIu64"/%"PRIu64" (send/recv/icmp)\n",
                net_send_errors, net_recv_errors, net_icmp_errors);
@@ -574,11 +581,12 @@ static void NET_GetLoopPackets(netsrc_t sock, void (*packet_cb)(void))
     }
 }
 
-static qboolean NET_SendLoopPacket(netsrc_t sock, const void *data,
-                                   size_t len, const netadr_t *to)
+static qboolean NET_SendLoopPacket(netsrc_t sock, void **data, size_t *len,
+                                   int count, size_t total, const netadr_t *to)
 {
     loopback_t *loop;
     loopmsg_t *msg;
+    size_t i, pos;
 
     if (net_dropsim->integer > 0 && (rand() % 100) < net_dropsim->integer) {
         return qfalse;
@@ -589,16 +597,18 @@ static qboolean NET_SendLoopPacket(netsrc_t sock, const void *data,
     msg = &loop->msgs[loop->send & (MAX_LOOPBACK - 1)];
     loop->send++;
 
-    memcpy(msg->data, data, len);
-    msg->datalen = len;
+    for (i = 0, pos = 0; i < count; pos += len[i++]) {
+        memcpy(msg->data + pos, data[i], len[i]);
+    }
+    msg->datalen = total;
 
 #ifdef _DEBUG
     if (net_log_enable->integer > 1) {
-        NET_LogPacket(to, "LP send", data, len);
+        NET_LogPacket(to, "LP send", msg->data, total);
     }
 #endif
     if (sock == NS_CLIENT) {
-        net_rate_sent += len;
+        net_rate_sent += total;
     }
 
     return qtrue;
@@ -917,14 +927,38 @@ NET_SendPacket
 */
 qboolean NET_SendPacket(netsrc_t sock, const void *data,
                         size_t len, const netadr_t *to)
+{
+    void *iov = (void *)data;
+
+    return NET_SendPacketV(sock, &iov, &len, 1, to);
+}
+
+/*
+=============
+NET_SendPacketV
+
+Sends a datagram gathered from `count' buffers, without copying them
+together first.
+=============
+*/
+qboolean NET_SendPacketV(netsrc_t sock, void **data, size_t *len,
+                         int count, const netadr_t *to)
 {
     ssize_t ret;
     qsocket_t s;
+    size_t total;
+    int i;
+
+    if (count > MAX_PACKET_IOV)
+        Com_Error(ERR_FATAL, "%s: too many buffers", __func__);
+
+    for (i = 0, total = 0; i < count; i++)
+        total += len[i];
 
-    if (len == 0)
+    if (total == 0)
         return qfalse;
 
-    if (len > MAX_PACKETLEN) {
+    if (total > MAX_PACKETLEN) {
         Com_EPrintf("%s: oversize packet to %s\n", __func__,
                     NET_AdrToString(to));
         return qfalse;
@@ -935,7 +969,7 @@ qboolean NET_SendPacket(netsrc_t sock, const void *data,
         return qfalse;
 #if USE_CLIENT
     case NA_LOOPBACK:
-        return NET_SendLoopPacket(sock, data, len, to);
+        return NET_SendLoopPacket(sock, data, len, count, total, to);
 #endif
     case NA_IP:
     case NA_BROADCAST:
@@ -951,7 +985,7 @@ qboolean NET_SendPacket(netsrc_t sock, const void *data,
     if (s == -1)
         return qfalse;
 
-    ret = os_udp_send(s, data, len, to);
+    ret = os_udp_send(s, data, len, count, to);
     if (ret == NET_AGAIN)
         return qfalse;
 
@@ -962,13 +996,19 @@ qboolean NET_SendPacket(netsrc_t sock, const void *data,
         return qfalse;
     }
 
-    if (ret < len)
+    if (ret < total)
         Com_WPrintf("%s: short send to %s\n", __func__,
                     NET_AdrToString(to));
 
 #ifdef _DEBUG
-    if (net_log_enable->integer)
-        NET_LogPacket(to, "UDP send", data, ret);
+    if (net_log_enable->integer) {
+        byte buf[MAX_PACKETLEN];
+        size_t pos;
+
+        for (i = 0, pos = 0; i < count; pos += len[i++])
+            memcpy(buf + pos, data[i], len[i]);
+        NET_LogPacket(to, "UDP send", buf, ret);
+    }
 #endif
 
     net_rate_sent += ret;
@@ -1647,8 +1687,9 @@ void NET_UpdateStream(netstream_t *s)
 neterr_t NET_RunStream(netstream_t *s)
 {
     ssize_t ret;
-    size_t len;
-    void *data;
+    size_t len[2];
+    void *data[2];
+    int count;
     neterr_t result = NET_AGAIN;
     ioentry_t *e;
 
@@ -1658,10 +1699,12 @@ neterr_t NET_RunStream(netstream_t *s)
 
     e = os_get_io(s->socket);
     if (e->wantread && e->canread) {
-        // read as much as we can
-        data = FIFO_Reserve(&s->recv, &len);
-        if (len) {
-            ret = os_recv(s->socket, data, len, 0);
+        // read as much as we can, filling both free regions of FIFO
+        count = FIFO_ReserveV(&s->recv, data, len);
+        if (count) {
+            ret = os_recvv(s->socket, data, len, count);
+            s->num_recvs++;
+            net_stream_recvs++;
             if (!ret) {
                 goto closed;
             }
@@ -1675,17 +1718,17 @@ neterr_t NET_RunStream(netstream_t *s)
                 FIFO_Commit(&s->recv, ret);
 #if _DEBUG
                 if (net_log_enable->integer) {
-                    NET_LogPacket(&s->address, "TCP recv", data, ret);
+                    NET_LogPacket(&s->address, "TCP recv", data[0], min(ret, len[0]));
                 }
 #endif
                 net_rate_rcvd += ret;
                 net_bytes_rcvd += ret;
+                s->bytes_rcvd += ret;
 
                 result = NET_OK;
 
                 // now see if there's more space to read
-                FIFO_Reserve(&s->recv, &len);
-                if (!len) {
+                if (!FIFO_ReserveV(&s->recv, data, len)) {
                     e->wantread = qfalse;
                 }
             }
@@ -1693,10 +1736,12 @@ neterr_t NET_RunStream(netstream_t *s)
     }
 
     if (e->wantwrite && e->canwrite) {
-        // write as much as we can
-        data = FIFO_Peek(&s->send, &len);
-        if (len) {
-            ret = os_send(s->socket, data, len, 0);
+        // write as much as we can, including wrapped data
+        count = FIFO_PeekV(&s->send, data, len);
+        if (count) {
+            ret = os_sendv(s->socket, data, len, count);
+            s->num_sends++;
+            net_stream_sends++;
             if (!ret) {
                 goto closed;
             }
@@ -1710,17 +1755,17 @@ neterr_t NET_RunStream(netstream_t *s)
                 FIFO_Decommit(&s->send, ret);
 #if _DEBUG
                 if (net_log_enable->integer) {
-                    NET_LogPacket(&s->address, "TCP send", data, ret);
+                    NET_LogPacket(&s->address, "TCP send", data[0], min(ret, len[0]));
                 }
 #endif
                 net_rate_sent += ret;
                 net_bytes_sent += ret;
+                s->bytes_sent += ret;
 
                 //result = NET_OK;
 
                 // now see if there's more data to write
-                FIFO_Peek(&s->send, &len);
-                if (!len) {
+                if (!FIFO_Usage(&s->send)) {
                     e->wantwrite = qfalse;
                 }
 
@@ -142,19 +142,24 @@ static ssize_t os_udp_recv(qsocket_t sock, void *data,
     return NET_ERROR;
 }
 
-static ssize_t os_udp_send(qsocket_t sock, const void *data,
-                           size_t len, const netadr_t *to)
+static ssize_t os_udp_send(qsocket_t sock, void **data, size_t *len,
+                           int count, const netadr_t *to)
 {
     struct sockaddr_storage addr;
+    WSABUF buf[MAX_PACKET_IOV];
     int addrlen;
-    int ret;
+    DWORD ret;
+    int i;
 
-    addrlen = NET_NetadrToSockadr(to, &addr);
+    for (i = 0; i < count; i++) {
+        buf[i].buf = data[i];
+        buf[i].len = len[i];
+    }
 
-    ret = sendto(sock, data, len, 0,
-                 (struct sockaddr *)&addr, addrlen);
+    addrlen = NET_NetadrToSockadr(to, &addr);
 
-    if (ret != SOCKET_ERROR)
+    if (WSASendTo(sock, buf, count, &ret, 0, (struct sockaddr *)&addr,
+                  addrlen, NULL, NULL) != SOCKET_ERROR)
         return ret;
 
     net_error = WSAGetLastError();
@@ -179,21 +184,35 @@ static neterr_t os_get_error(void)
     return NET_ERROR;
 }
 
-static ssize_t os_recv(qsocket_t sock, void *data, size_t len, int flags)
+static ssize_t os_recvv(qsocket_t sock, void **data, size_t *len, int count)
 {
-    int ret = recv(sock, data, len, flags);
+    WSABUF buf[2];
+    DWORD ret, flags = 0;
+    int i;
 
-    if (ret == SOCKET_ERROR)
+    for (i = 0; i < count; i++) {
+        buf[i].buf = data[i];
+        buf[i].len = len[i];
+    }
+
+    if (WSARecv(sock, buf, count, &ret, &flags, NULL, NULL) == SOCKET_ERROR)
         return os_get_error();
 
     return ret;
 }
 
-static ssize_t os_send(qsocket_t sock, const void *data, size_t len, int flags)
+static ssize_t os_sendv(qsocket_t sock, void **data, size_t *len, int count)
 {
-    int ret = send(sock, data, len, flags);
+    WSABUF buf[2];
+    DWORD ret;
+    int i;
 
-    if (ret == SOCKET_ERROR)
+    for (i = 0; i < count; i++) {
+        buf[i].buf = data[i];
+        buf[i].len = len[i];
+    }
+
+    if (WSASend(sock, buf, count, &ret, 0, NULL, NULL) == SOCKET_ERROR)
         return os_get_error();
 
     return ret;
@@ -19,9 +19,16 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "shared/shared.h"
 #include "common/bsp.h"
 #include "common/cmd.h"
+#include "common/cmodel.h"
 #include "common/common.h"
+#include "common/demoparse.h"
 #include "common/files.h"
+#include "common/msg.h"
+#include "common/protocol.h"
 #include "common/tests.h"
+#if USE_CLIENT
+#include "client/sound/sound.h"
+#endif
 #include "refresh/refresh.h"
 #include "system/system.h"
 
@@ -155,6 +162,389 @@ static void BSP_Test_f(void)
     FS_FreeList(list);
 }
 
+static int asynctest_pending, asynctest_errors;
+
+static void async_test_done(const char *path, void *buf, ssize_t len, void *arg)
+{
+    void *data;
+    ssize_t ret;
+
+    ret = FS_LoadFile(path, &data);
+    if (len != ret || (buf && memcmp(buf, data, len))) {
+        Com_EPrintf("%s: async load differs\n", path);
+        asynctest_errors++;
+    }
+
+    FS_FreeFile(data);
+    FS_FreeFile(buf);
+    asynctest_pending--;
+}
+
+static void Com_TestAsync_f(void)
+{
+    void **list;
+    void *data;
+    int i, count;
+    unsigned start, mid, end;
+
+    list = FS_ListFiles(Cmd_Argv(1), Cmd_Argv(2), FS_SEARCH_SAVEPATH, &count);
+    if (!list) {
+        Com_Printf("No files found\n");
+        return;
+    }
+
+    start = Sys_Milliseconds();
+
+    // completion callbacks check against synchronous loads
+    asynctest_pending = count;
+    asynctest_errors = 0;
+    for (i = 0; i < count; i++)
+        FS_LoadFileAsync(list[i], TAG_FILESYSTEM, async_test_done, NULL);
+    while (asynctest_pending > 0) {
+        FS_RunAsync();
+        Sys_Sleep(1);
+    }
+
+    mid = Sys_Milliseconds();
+
+    // prefetched files are claimed by FS_LoadFile
+    for (i = 0; i < count; i++)
+        FS_PrefetchFile(list[i]);
+    for (i = 0; i < count; i++) {
+        if (FS_LoadFile(list[i], &data) < 0)
+            asynctest_errors++;
+        FS_FreeFile(data);
+    }
+    FS_RunAsync();
+
+    end = Sys_Milliseconds();
+
+    Com_Printf("%d msec callbacks, %d msec prefetch, %d failures, %d files tested\n",
+               mid - start, end - mid, asynctest_errors, count);
+
+    FS_FreeList(list);
+}
+
+static void inflate_test_done(const char *path, void *buf, ssize_t len, void *arg)
+{
+    if (!buf)
+        asynctest_errors++;
+    FS_FreeFile(buf);
+    asynctest_pending--;
+}
+
+static void inflate_test_print(const char *name, size_t bytes, unsigned usec)
+{
+    Com_Printf("%-10s %8.1f msec %8.1f MB/s\n", name, usec * 0.001f,
+               bytes / (max(usec, 1) * 1.048576f));
+}
+
+static void Com_TestInflate_f(void)
+{
+    static byte buffer[0x10000];
+    void **list;
+    void *data;
+    int i, count;
+    size_t bytes;
+    ssize_t ret;
+    qhandle_t f;
+    unsigned start, stream, whole, parallel;
+
+    list = FS_ListFiles(Cmd_Argv(1), Cmd_Argv(2), FS_SEARCH_SAVEPATH, &count);
+    if (!list) {
+        Com_Printf("No files found\n");
+        return;
+    }
+
+    asynctest_errors = 0;
+
+    // streamed through the zip buffer in 64k reads
+    start = Sys_Microseconds();
+    bytes = 0;
+    for (i = 0; i < count; i++) {
+        if (FS_FOpenFile(list[i], &f, FS_MODE_READ) < 0) {
+            asynctest_errors++;
+            continue;
+        }
+        while ((ret = FS_Read(buffer, sizeof(buffer), f)) > 0)
+            bytes += ret;
+        if (ret < 0)
+            asynctest_errors++;
+        FS_FCloseFile(f);
+    }
+    stream = Sys_Microseconds() - start;
+
+    // whole files in one call each
+    start = Sys_Microseconds();
+    for (i = 0; i < count; i++) {
+        if (FS_LoadFile(list[i], &data) < 0)
+            asynctest_errors++;
+        FS_FreeFile(data);
+    }
+    whole = Sys_Microseconds() - start;
+
+    // whole files in worker threads
+    start = Sys_Microseconds();
+    asynctest_pending = count;
+    for (i = 0; i < count; i++)
+        FS_LoadFileAsync(list[i], TAG_FILESYSTEM, inflate_test_done, NULL);
+    while (asynctest_pending > 0) {
+        FS_RunAsync();
+        Sys_Sleep(1);
+    }
+    parallel = Sys_Microseconds() - start;
+
+    Com_Printf("%d files, %"PRIz" bytes, %d failures\n", count, bytes, asynctest_errors);
+    inflate_test_print("stream", bytes, stream);
+    inflate_test_print("whole", bytes, whole);
+    inflate_test_print("parallel", bytes, parallel);
+
+    FS_FreeList(list);
+}
+
+#define ZONETEST_BLOCKS     4096
+
+// allocates and frees random sized blocks of engine and game tags
+static void Com_TestZone_f(void)
+{
+    static byte *blocks[ZONETEST_BLOCKS];
+    static size_t sizes[ZONETEST_BLOCKS];
+    int i, j, count, errors;
+    memtag_t tag;
+    unsigned start, end;
+
+    count = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 100000;
+
+    start = Sys_Milliseconds();
+
+    errors = 0;
+    for (i = 0; i < count; i++) {
+        j = rand() % ZONETEST_BLOCKS;
+        if (blocks[j]) {
+            if (blocks[j][0] != (byte)j || blocks[j][sizes[j] - 1] != (byte)j)
+                errors++;
+            Z_Free(blocks[j]);
+            blocks[j] = NULL;
+            continue;
+        }
+        // mostly small blocks, some large ones
+        sizes[j] = 1 + (rand() % 8 ? rand() % 256 : rand() % 16384);
+        tag = j & 1 ? TAG_GENERAL : TAG_MAX + 1;
+        blocks[j] = Z_TagMalloc(sizes[j], tag);
+        blocks[j][0] = blocks[j][sizes[j] - 1] = j;
+    }
+
+    Z_Check();
+
+    end = Sys_Milliseconds();
+
+    // game tag is freed at once, engine tag block by block
+    Z_FreeTags(TAG_MAX + 1);
+    for (i = 0; i < ZONETEST_BLOCKS; i++) {
+        if (i & 1)
+            Z_Free(blocks[i]);
+        blocks[i] = NULL;
+    }
+    Z_LeakTest(TAG_MAX + 1);
+
+    Com_Printf("%d msec, %d failures, %d operations tested\n",
+               end - start, errors, count);
+}
+
+#define DEMOTEST_ENTITIES   8
+
+// appends msg_write to demo as a single message
+static void demotest_flush(sizebuf_t *demo)
+{
+    SZ_WriteLong(demo, msg_write.cursize);
+    MSG_FlushTo(demo);
+}
+
+// writes a demo with entities using all widths of skin, effects and
+// renderfx fields and checks that demo parser stays in sync with them
+static void Com_TestDemoParse_f(void)
+{
+    static byte buffer[MAX_MSGLEN * 2];
+    static const int effects[] = { 0, EF_ROTATE, EF_QUAD, EF_QUAD | EF_PENT };
+    static const int renderfx[] = { 0, RF_GLOW, RF_SHELL_RED | RF_SHELL_GREEN,
+                                    RF_SHELL_RED | RF_SHELL_DOUBLE };
+    static const int skins[] = { 0, 1, 300, 0xf2f2f0f0 };
+    char path[MAX_OSPATH];
+    entity_state_t state;
+    entity_packed_t packed[DEMOTEST_ENTITIES];
+    demosummary_t summary;
+    demoparse_t *dp;
+    sizebuf_t demo;
+    qerror_t ret;
+    int i, errors;
+
+    SZ_Init(&demo, buffer, sizeof(buffer));
+    SZ_Clear(&msg_write);
+
+    MSG_WriteByte(svc_serverdata);
+    MSG_WriteLong(PROTOCOL_VERSION_DEFAULT);
+    MSG_WriteLong(1);
+    MSG_WriteByte(1);
+    MSG_WriteString("baseq2");
+    MSG_WriteShort(0);
+    MSG_WriteString("demo parser test");
+
+    for (i = 0; i < DEMOTEST_ENTITIES; i++) {
+        memset(&state, 0, sizeof(state));
+        state.number = i + 1;
+        state.modelindex = 1;
+        state.origin[0] = i * 64;
+        state.skinnum = skins[i % 4];
+        state.effects = effects[(i + 1) % 4];
+        state.renderfx = renderfx[(i + 2) % 4];
+        MSG_PackEntity(&packed[i], &state, qfalse);
+        MSG_WriteByte(svc_spawnbaseline);
+        MSG_WriteDeltaEntity(NULL, &packed[i], MSG_ES_FORCE);
+    }
+    demotest_flush(&demo);
+
+    MSG_WriteByte(svc_frame);
+    MSG_WriteLong(1);
+    MSG_WriteLong(-1);
+    MSG_WriteByte(0);
+    MSG_WriteByte(0);
+    MSG_WriteByte(svc_playerinfo);
+    MSG_WriteShort(0);
+    MSG_WriteLong(0);
+    MSG_WriteByte(svc_packetentities);
+    for (i = 0; i < DEMOTEST_ENTITIES; i++)
+        MSG_WriteDeltaEntity(NULL, &packed[i], MSG_ES_FORCE);
+    MSG_WriteShort(0);
+    MSG_WriteByte(svc_print);
+    MSG_WriteByte(PRINT_HIGH);
+    MSG_WriteString("end of test\n");
+    demotest_flush(&demo);
+
+    SZ_WriteLong(&demo, -1);
+
+    ret = FS_WriteFile("demoparsetest.dm2", demo.data, demo.cursize);
+    if (ret) {
+        Com_Printf("Couldn't write test demo: %s\n", Q_ErrorString(ret));
+        return;
+    }
+
+    Q_concat(path, sizeof(path), fs_gamedir, "/demoparsetest.dm2", NULL);
+    dp = DP_CreateContext();
+    ret = DP_ParseFile(dp, path, &summary);
+    DP_FreeContext(dp);
+    remove(path);
+
+    errors = 0;
+    if (ret) {
+        Com_Printf("%s at offset %"PRIz": %s\n", Q_ErrorString(ret),
+                   summary.erroffset, summary.reason ? summary.reason : "");
+        errors++;
+    }
+    if (summary.baselines != DEMOTEST_ENTITIES || summary.entities != DEMOTEST_ENTITIES ||
+        summary.frames != 1 || summary.prints != 1 || !summary.complete) {
+        Com_Printf("%u baselines, %u entities, %u frames, %u prints\n",
+                   summary.baselines, summary.entities, summary.frames, summary.prints);
+        errors++;
+    }
+
+    Com_Printf("%d failures, %d entities tested\n", errors, DEMOTEST_ENTITIES);
+}
+
+#define TRACETEST_COUNT     1024
+#define TRACETEST_CLUSTER   16
+
+static void CM_TestTrace_f(void)
+{
+    static vec3_t starts[TRACETEST_COUNT], ends[TRACETEST_COUNT];
+    static trace_t single[TRACETEST_COUNT], batch[TRACETEST_COUNT];
+    static vec3_t box_mins = { -16, -16, -24 }, box_maxs = { 16, 16, 32 };
+    char name[MAX_QPATH];
+    bsp_t *bsp;
+    qerror_t ret;
+    mmodel_t *world;
+    float *mins, *maxs;
+    int i, j, k, passes, errors;
+    unsigned time_single, time_batch, start;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s <map> [passes]\n", Cmd_Argv(0));
+        return;
+    }
+
+    if (Q_concat(name, sizeof(name), "maps/", Cmd_Argv(1), ".bsp", NULL) >= sizeof(name)) {
+        Com_Printf("Oversize map name\n");
+        return;
+    }
+
+    passes = Cmd_Argc() > 2 ? atoi(Cmd_Argv(2)) : 100;
+    if (passes < 1) {
+        passes = 1;
+    }
+
+    ret = BSP_Load(name, &bsp);
+    if (!bsp) {
+        Com_EPrintf("%s: %s\n", name, Q_ErrorString(ret));
+        return;
+    }
+
+    // rays are cast in clusters from a common start, like shotgun pellets
+    world = &bsp->models[0];
+    for (i = 0; i < TRACETEST_COUNT; i++) {
+        for (j = 0; j < 3; j++) {
+            if (i % TRACETEST_CLUSTER) {
+                starts[i][j] = starts[i - 1][j];
+                ends[i][j] = ends[i - i % TRACETEST_CLUSTER][j] + crand() * 64;
+            } else {
+                starts[i][j] = world->mins[j] + frand() * (world->maxs[j] - world->mins[j]);
+                ends[i][j] = starts[i][j] + crand() * 512;
+            }
+        }
+    }
+
+    errors = 0;
+    time_single = time_batch = 0;
+    for (k = 0; k < 2; k++) {
+        // point and box traces
+        mins = k ? box_mins : vec3_origin;
+        maxs = k ? box_maxs : vec3_origin;
+
+        start = Sys_Milliseconds();
+        for (i = 0; i < passes; i++) {
+            for (j = 0; j < TRACETEST_COUNT; j++) {
+                CM_BoxTrace(&single[j], starts[j], ends[j], mins, maxs,
+                            bsp->nodes, MASK_PLAYERSOLID);
+            }
+        }
+        time_single += Sys_Milliseconds() - start;
+
+        start = Sys_Milliseconds();
+        for (i = 0; i < passes; i++) {
+            CM_BoxTraceN(batch, starts, ends, TRACETEST_COUNT, mins, maxs,
+                         bsp->nodes, MASK_PLAYERSOLID);
+        }
+        time_batch += Sys_Milliseconds() - start;
+
+        for (j = 0; j < TRACETEST_COUNT; j++) {
+            if (single[j].fraction != batch[j].fraction ||
+                single[j].allsolid != batch[j].allsolid ||
+                single[j].startsolid != batch[j].startsolid ||
+                single[j].contents != batch[j].contents ||
+                single[j].surface != batch[j].surface ||
+                !VectorCompare(single[j].endpos, batch[j].endpos) ||
+                !VectorCompare(single[j].plane.normal, batch[j].plane.normal)) {
+                Com_EPrintf("Trace %d (%s) mismatch: fraction %f, expected %f\n",
+                            j, k ? "box" : "point", batch[j].fraction, single[j].fraction);
+                errors++;
+            }
+        }
+    }
+
+    Com_Printf("%u msec single, %u msec batched, %d failures, %d traces tested\n",
+               time_single, time_batch, errors, passes * TRACETEST_COUNT * 2);
+
+    BSP_Free(bsp);
+}
+
 typedef struct {
     const char *filter;
     const char *string;
@@ -532,6 +922,15 @@ void TST_Init(void)
     Cmd_AddCommand("crash", Com_Crash_f);
     Cmd_AddCommand("printjunk", Com_PrintJunk_f);
     Cmd_AddCommand("bsptest", BSP_Test_f);
+    Cmd_AddCommand("tracetest", CM_TestTrace_f);
+    Cmd_AddCommand("asynctest", Com_TestAsync_f);
+    Cmd_AddCommand("zonetest", Com_TestZone_f);
+    Cmd_AddCommand("demoparsetest", Com_TestDemoParse_f);
+#if USE_CLIENT && USE_SNDDMA
+    Cmd_AddCommand("mixtest", S_MixTest_f);
+    Cmd_AddCommand("mixertest", S_MixerTest_f);
+#endif
+    Cmd_AddCommand("inflatetest", Com_TestInflate_f);
     Cmd_AddCommand("wildtest", Com_TestWild_f);
     Cmd_AddCommand("normtest", Com_TestNorm_f);
     Cmd_AddCommand("infotest", Com_TestInfo_f);
@@ -26,27 +26,40 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define Z_TAIL_F(z) \
     *(uint16_t *)((byte *)(z) + (z)->size - sizeof(uint16_t))
 
-#define Z_FOR_EACH(z) \
-    for ((z) = z_chain.next; (z) != &z_chain; (z) = (z)->next)
+#define Z_FOR_EACH(z, c) \
+    for ((z) = (c)->next; (z) != (c); (z) = (z)->next)
 
-#define Z_FOR_EACH_SAFE(z, n) \
-    for ((z) = z_chain.next; (z) != &z_chain; (z) = (n))
+#define Z_FOR_EACH_SAFE(z, n, c) \
+    for ((z) = (c)->next; (z) != (c); (z) = (n))
+
+// where the block came from
+typedef enum {
+    Z_KIND_MALLOC,
+    Z_KIND_SMALL,
+    Z_KIND_ARENA
+} zkind_t;
 
 typedef struct zhead_s {
     uint16_t    magic;
     uint16_t    tag;            // for group free
+    uint16_t    kind;
     size_t      size;
 #ifdef _DEBUG
     void        *addr;
     time_t      time;
 #endif
-    struct zhead_s  *prev, *next;
+    struct zhead_s  *prev, *next;   // arena blocks point to their chunk
 } zhead_t;
 
 // number of overhead bytes
 #define Z_EXTRA (sizeof(zhead_t) + sizeof(uint16_t))
 
-static zhead_t      z_chain;
+// blocks of engine tags are chained per tag, game tags share a few chains
+#define Z_GAME_CHAINS   4
+#define Z_CHAIN(tag) \
+    (&z_chains[(tag) < TAG_MAX ? (tag) : TAG_MAX + (tag) % Z_GAME_CHAINS])
+
+static zhead_t      z_chains[TAG_MAX + Z_GAME_CHAINS];
 
 typedef struct {
     zhead_t     z;
@@ -56,7 +69,7 @@ typedef struct {
 
 static const zstatic_t z_static[] = {
 #define Z_STATIC(x) \
-    { { Z_MAGIC, TAG_STATIC, q_offsetof(zstatic_t, tail) + sizeof(uint16_t) }, x, Z_TAIL }
+    { { Z_MAGIC, TAG_STATIC, Z_KIND_MALLOC, q_offsetof(zstatic_t, tail) + sizeof(uint16_t) }, x, Z_TAIL }
 
     Z_STATIC("0"),
     Z_STATIC("1"),
@@ -76,10 +89,60 @@ static const zstatic_t z_static[] = {
 typedef struct {
     size_t count;
     size_t bytes;
+    size_t peak;
 } zstats_t;
 
 static zstats_t z_stats[TAG_MAX];
 
+static zpool_t  *z_pools;
+
+/*
+Small blocks, including header and tail, are rounded up to a multiple of
+Z_SMALL_ALIGN and carved out of Z_SMALL_SLAB sized slabs shared by all tags.
+Freed blocks go to the free list of their size class. Slabs are never
+returned to the system.
+*/
+#define Z_SMALL_ALIGN   16
+#define Z_SMALL_MAX     512
+#define Z_SMALL_CLASSES (Z_SMALL_MAX / Z_SMALL_ALIGN)
+#define Z_SMALL_SLAB    0x10000
+
+typedef struct {
+    zhead_t     *free;
+    byte        *cursor, *end;  // unused part of the last slab
+    size_t      numused, peakused;
+} zclass_t;
+
+static zclass_t z_classes[Z_SMALL_CLASSES];
+static size_t   z_small_slabs;
+
+/*
+Game tags are freed all at once on level change and shutdown, so their
+blocks up to Z_ARENA_MAX are bump allocated from per tag chunks. Freeing
+single block only releases its chunk once the chunk is empty, while
+Z_FreeTags drops all chunks of the arena without walking the blocks.
+*/
+#define Z_ARENA_MAX     0x1000
+#define Z_ARENA_CHUNK   0x40000
+#define Z_ARENAS        4
+
+typedef struct {
+    zhead_t     z;              // next links chunks of the arena
+    size_t      used;
+    size_t      live;           // blocks not yet freed
+} zchunk_t;
+
+typedef struct {
+    memtag_t    tag;            // TAG_FREE if unused
+    zchunk_t    *chunks;        // first chunk is the one being filled
+    size_t      numchunks;
+    size_t      count, bytes;   // live blocks
+    size_t      peakchunks;
+    size_t      resets;
+} zarena_t;
+
+static zarena_t z_arenas[Z_ARENAS];
+
 static const char z_tagnames[TAG_MAX][8] = {
     "game",
     "static",
@@ -108,37 +171,128 @@ static inline void Z_Validate(zhead_t *z, const char *func)
     }
 }
 
+#define Z_CHUNK_FIRST(c) \
+    (zhead_t *)((byte *)(c) + ((sizeof(zchunk_t) + Z_SMALL_ALIGN - 1) & ~(Z_SMALL_ALIGN - 1)))
+
+#define Z_CHUNK_END(c) \
+    (zhead_t *)((byte *)Z_CHUNK_FIRST(c) + (c)->used)
+
+// calls func for every live block of the arena
+static void Z_ArenaForEach(zarena_t *a, void (*func)(zhead_t *, void *), void *arg)
+{
+    zchunk_t *c;
+    zhead_t *z, *end;
+
+    for (c = a->chunks; c; c = (zchunk_t *)c->z.next) {
+        end = Z_CHUNK_END(c);
+        for (z = Z_CHUNK_FIRST(c); z < end; z = (zhead_t *)((byte *)z + z->size)) {
+            if (z->tag != TAG_FREE) {
+                func(z, arg);
+            }
+        }
+    }
+}
+
+static void Z_CheckBlock(zhead_t *z, void *arg)
+{
+    Z_Validate(z, arg);
+}
+
 void Z_Check(void)
 {
-    zhead_t *z;
+    zhead_t *z, *c;
+    int i;
 
-    Z_FOR_EACH(z) {
-        Z_Validate(z, __func__);
+    for (i = 0; i < TAG_MAX + Z_GAME_CHAINS; i++) {
+        c = &z_chains[i];
+        Z_FOR_EACH(z, c) {
+            Z_Validate(z, __func__);
+        }
     }
+
+    for (i = 0; i < Z_ARENAS; i++) {
+        Z_ArenaForEach(&z_arenas[i], Z_CheckBlock, (void *)__func__);
+    }
+}
+
+static zarena_t *Z_FindArena(memtag_t tag)
+{
+    int i;
+
+    for (i = 0; i < Z_ARENAS; i++) {
+        if (z_arenas[i].tag == tag) {
+            return &z_arenas[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void Z_CountLeak(zhead_t *z, void *arg)
+{
+    size_t *leaks = arg;
+
+    leaks[0]++;
+    leaks[1] += z->size;
 }
 
 void Z_LeakTest(memtag_t tag)
 {
-    zhead_t *z;
-    size_t numLeaks = 0, numBytes = 0;
+    zhead_t *z, *c = Z_CHAIN(tag);
+    zarena_t *a;
+    size_t leaks[2] = { 0, 0 };
 
-    Z_FOR_EACH(z) {
+    Z_FOR_EACH(z, c) {
         Z_Validate(z, __func__);
         if (z->tag == tag) {
-            numLeaks++;
-            numBytes += z->size;
+            Z_CountLeak(z, leaks);
         }
     }
 
-    if (numLeaks) {
+    if ((a = Z_FindArena(tag)) != NULL) {
+        Z_ArenaForEach(a, Z_CountLeak, leaks);
+    }
+
+    if (leaks[0]) {
         Com_WPrintf("************* Z_LeakTest *************\n"
                     "%s leaked %"PRIz" bytes of memory (%"PRIz" object%s)\n"
                     "**************************************\n",
                     z_tagnames[tag < TAG_MAX ? tag : TAG_FREE],
-                    numBytes, numLeaks, numLeaks == 1 ? "" : "s");
+                    leaks[1], leaks[0], leaks[0] == 1 ? "" : "s");
     }
 }
 
+static void Z_Unlink(zhead_t *z)
+{
+    z->prev->next = z->next;
+    z->next->prev = z->prev;
+}
+
+static void Z_Link(zhead_t *z)
+{
+    zhead_t *c = Z_CHAIN(z->tag);
+
+    z->next = c->next;
+    z->prev = c;
+    c->next->prev = z;
+    c->next = z;
+}
+
+static void Z_FreeChunk(zarena_t *a, zchunk_t *c)
+{
+    zchunk_t **p;
+
+    for (p = &a->chunks; *p; p = (zchunk_t **)&(*p)->z.next) {
+        if (*p == c) {
+            *p = (zchunk_t *)c->z.next;
+            break;
+        }
+    }
+
+    a->numchunks--;
+    free(c);
+}
+
 /*
 ========================
 Z_Free
@@ -148,6 +302,9 @@ void Z_Free(void *ptr)
 {
     zhead_t *z;
     zstats_t *s;
+    zclass_t *k;
+    zchunk_t *c;
+    zarena_t *a;
 
     if (!ptr) {
         return;
@@ -161,12 +318,36 @@ void Z_Free(void *ptr)
     s->count--;
     s->bytes -= z->size;
 
-    if (z->tag != TAG_STATIC) {
-        z->prev->next = z->next;
-        z->next->prev = z->prev;
-        z->magic = 0xdead;
-        z->tag = TAG_FREE;
+    if (z->tag == TAG_STATIC) {
+        return;
+    }
+
+    a = z->kind == Z_KIND_ARENA ? Z_FindArena(z->tag) : NULL;
+
+    z->magic = 0xdead;
+    z->tag = TAG_FREE;
+
+    switch (z->kind) {
+    case Z_KIND_SMALL:
+        Z_Unlink(z);
+        k = &z_classes[z->size / Z_SMALL_ALIGN - 1];
+        k->numused--;
+        z->next = k->free;
+        k->free = z;
+        break;
+    case Z_KIND_ARENA:
+        c = (zchunk_t *)z->prev;
+        a->count--;
+        a->bytes -= z->size;
+        // keep the chunk being filled
+        if (!--c->live && c != a->chunks) {
+            Z_FreeChunk(a, c);
+        }
+        break;
+    default:
+        Z_Unlink(z);
         free(z);
+        break;
     }
 }
 
@@ -179,6 +360,7 @@ void *Z_Realloc(void *ptr, size_t size)
 {
     zhead_t *z;
     zstats_t *s;
+    void *copy;
 
     if (!ptr) {
         return Z_Malloc(size);
@@ -197,6 +379,13 @@ void *Z_Realloc(void *ptr, size_t size)
         Com_Error(ERR_FATAL, "%s: couldn't realloc static memory", __func__);
     }
 
+    if (z->kind != Z_KIND_MALLOC) {
+        copy = Z_TagMalloc(size, z->tag);
+        memcpy(copy, ptr, min(size, z->size - Z_EXTRA));
+        Z_Free(ptr);
+        return copy;
+    }
+
     s = &z_stats[z->tag < TAG_MAX ? z->tag : TAG_FREE];
     s->bytes -= z->size;
 
@@ -215,6 +404,7 @@ void *Z_Realloc(void *ptr, size_t size)
     z->next->prev = z;
 
     s->bytes += size;
+    s->peak = max(s->peak, s->bytes);
 
     Z_TAIL_F(z) = Z_TAIL;
 
@@ -228,25 +418,64 @@ Z_Stats_f
 */
 void Z_Stats_f(void)
 {
-    size_t bytes = 0, count = 0;
+    size_t bytes = 0, count = 0, used, reserved;
     zstats_t *s;
+    zpool_t *p;
+    zclass_t *k;
+    zarena_t *a;
     int i;
 
-    Com_Printf("    bytes blocks name\n"
-               "--------- ------ -------\n");
+    Com_Printf("    bytes blocks      peak name\n"
+               "--------- ------ --------- -------\n");
 
     for (i = 0, s = z_stats; i < TAG_MAX; i++, s++) {
-        if (!s->count) {
+        if (!s->count && !s->peak) {
             continue;
         }
-        Com_Printf("%9"PRIz" %6"PRIz" %s\n", s->bytes, s->count, z_tagnames[i]);
+        Com_Printf("%9"PRIz" %6"PRIz" %9"PRIz" %s\n",
+                   s->bytes, s->count, s->peak, z_tagnames[i]);
         bytes += s->bytes;
         count += s->count;
     }
 
-    Com_Printf("--------- ------ -------\n"
-               "%9"PRIz" %6"PRIz" total\n",
+    Com_Printf("--------- ------ --------- -------\n"
+               "%9"PRIz" %6"PRIz"           total\n",
                bytes, count);
+
+    // fragmentation is the share of reserved memory not holding live blocks
+    used = reserved = 0;
+    for (i = 0, k = z_classes; i < Z_SMALL_CLASSES; i++, k++) {
+        used += k->numused * (i + 1) * Z_SMALL_ALIGN;
+    }
+    reserved = z_small_slabs * Z_SMALL_SLAB;
+    Com_Printf("\nsmall blocks: %"PRIz" of %"PRIz" bytes used, %.1f%% fragmented\n",
+               used, reserved, reserved ? 100.0f - used * 100.0f / reserved : 0.0f);
+
+    for (i = 0, a = z_arenas; i < Z_ARENAS; i++, a++) {
+        if (a->tag == TAG_FREE) {
+            continue;
+        }
+        reserved = a->numchunks * Z_ARENA_CHUNK;
+        Com_Printf("arena %u: %"PRIz" blocks, %"PRIz" of %"PRIz" bytes used, "
+                   "%.1f%% fragmented, peak %"PRIz" chunks, %"PRIz" resets\n",
+                   a->tag - TAG_MAX, a->count, a->bytes, reserved,
+                   reserved ? 100.0f - a->bytes * 100.0f / reserved : 0.0f,
+                   a->peakchunks, a->resets);
+    }
+
+    if (!z_pools) {
+        return;
+    }
+
+    Com_Printf("\n"
+               "    size   used   peak  slabs    allocs name\n"
+               "-------- ------ ------ ------ --------- -------\n");
+
+    for (p = z_pools; p; p = p->next) {
+        Com_Printf("%8"PRIz" %6"PRIz" %6"PRIz" %6"PRIz" %9"PRIz" %s\n",
+                   p->size, p->numused, p->peakused, p->numslabs,
+                   p->numallocs, p->name);
+    }
 }
 
 /*
@@ -256,15 +485,108 @@ Z_FreeTags
 */
 void Z_FreeTags(memtag_t tag)
 {
-    zhead_t *z, *n;
+    zhead_t *z, *n, *c = Z_CHAIN(tag);
+    zarena_t *a;
+    zchunk_t *next;
+    zstats_t *s;
 
-    Z_FOR_EACH_SAFE(z, n) {
+    Z_FOR_EACH_SAFE(z, n, c) {
         Z_Validate(z, __func__);
         n = z->next;
         if (z->tag == tag) {
             Z_Free(z + 1);
         }
     }
+
+    // reset the arena
+    if ((a = Z_FindArena(tag)) != NULL) {
+        s = &z_stats[tag < TAG_MAX ? tag : TAG_FREE];
+        s->count -= a->count;
+        s->bytes -= a->bytes;
+
+        for (; a->chunks; a->chunks = next) {
+            next = (zchunk_t *)a->chunks->z.next;
+            free(a->chunks);
+        }
+
+        a->numchunks = 0;
+        a->count = a->bytes = 0;
+        a->resets++;
+    }
+}
+
+static zhead_t *Z_SmallAlloc(size_t size)
+{
+    zclass_t *k = &z_classes[size / Z_SMALL_ALIGN - 1];
+    zhead_t *z;
+
+    if (k->free) {
+        z = k->free;
+        k->free = z->next;
+    } else {
+        if (k->cursor + size > k->end) {
+            k->cursor = malloc(Z_SMALL_SLAB);
+            if (!k->cursor) {
+                return NULL;
+            }
+            k->end = k->cursor + Z_SMALL_SLAB;
+            z_small_slabs++;
+        }
+        z = (zhead_t *)k->cursor;
+        k->cursor += size;
+    }
+
+    if (++k->numused > k->peakused) {
+        k->peakused = k->numused;
+    }
+
+    z->kind = Z_KIND_SMALL;
+    return z;
+}
+
+static zhead_t *Z_ArenaAlloc(size_t size, memtag_t tag)
+{
+    zarena_t *a = Z_FindArena(tag);
+    zchunk_t *c;
+    zhead_t *z;
+
+    if (!a) {
+        // claim unused arena
+        if (!(a = Z_FindArena(TAG_FREE))) {
+            return NULL;
+        }
+        a->tag = tag;
+    }
+
+    c = a->chunks;
+    if (!c || (byte *)Z_CHUNK_END(c) + size > (byte *)c + Z_ARENA_CHUNK) {
+        c = malloc(Z_ARENA_CHUNK);
+        if (!c) {
+            return NULL;
+        }
+        c->z.magic = Z_MAGIC;
+        c->z.tag = tag;
+        c->z.kind = Z_KIND_ARENA;
+        c->z.size = Z_ARENA_CHUNK;
+        c->z.prev = NULL;
+        c->z.next = &a->chunks->z;
+        c->used = 0;
+        c->live = 0;
+        a->chunks = c;
+        a->numchunks++;
+        a->peakchunks = max(a->peakchunks, a->numchunks);
+    }
+
+    z = Z_CHUNK_END(c);
+    c->used += size;
+    c->live++;
+    a->count++;
+    a->bytes += size;
+
+    z->kind = Z_KIND_ARENA;
+    z->prev = &c->z;
+    z->next = NULL;
+    return z;
 }
 
 /*
@@ -285,14 +607,27 @@ void *Z_TagMalloc(size_t size, memtag_t tag)
         Com_Error(ERR_FATAL, "%s: bad tag", __func__);
     }
 
-    if (size > SIZE_MAX - Z_EXTRA - 3) {
+    if (size > SIZE_MAX - Z_EXTRA - Z_SMALL_ALIGN) {
         Com_Error(ERR_FATAL, "%s: bad size", __func__);
     }
 
-    size = (size + Z_EXTRA + 3) & ~3;
-    z = malloc(size);
+    z = NULL;
+    if (size + Z_EXTRA <= Z_ARENA_MAX && tag >= TAG_MAX) {
+        size = (size + Z_EXTRA + Z_SMALL_ALIGN - 1) & ~(Z_SMALL_ALIGN - 1);
+        z = Z_ArenaAlloc(size, tag);
+    } else if (size + Z_EXTRA <= Z_SMALL_MAX) {
+        size = (size + Z_EXTRA + Z_SMALL_ALIGN - 1) & ~(Z_SMALL_ALIGN - 1);
+        z = Z_SmallAlloc(size);
+    } else {
+        size = (size + Z_EXTRA + 3) & ~3;
+    }
+
     if (!z) {
-        Com_Error(ERR_FATAL, "%s: couldn't allocate %"PRIz" bytes", __func__, size);
+        z = malloc(size);
+        if (!z) {
+            Com_Error(ERR_FATAL, "%s: couldn't allocate %"PRIz" bytes", __func__, size);
+        }
+        z->kind = Z_KIND_MALLOC;
     }
     z->magic = Z_MAGIC;
     z->tag = tag;
@@ -309,10 +644,9 @@ void *Z_TagMalloc(size_t size, memtag_t tag)
     z->time = time(NULL);
 #endif
 
-    z->next = z_chain.next;
-    z->prev = &z_chain;
-    z_chain.next->prev = z;
-    z_chain.next = z;
+    if (z->kind != Z_KIND_ARENA) {
+        Z_Link(z);
+    }
 
     if (z_perturb && z_perturb->integer) {
         memset(z + 1, z_perturb->integer, size - Z_EXTRA);
@@ -323,6 +657,7 @@ void *Z_TagMalloc(size_t size, memtag_t tag)
     s = &z_stats[tag < TAG_MAX ? tag : TAG_FREE];
     s->count++;
     s->bytes += size;
+    s->peak = max(s->peak, s->bytes);
 
     return z + 1;
 }
@@ -384,6 +719,108 @@ char *Z_ReservedCopyString(const char *in)
     return memcpy(Z_ReservedAlloc(len), in, len);
 }
 
+/*
+==============================================================================
+
+FIXED SIZE POOLS
+
+Blocks are handed out from slabs of Z_SLAB_SIZE bytes and kept on a free list
+when released, so frequent allocations of similar size bypass malloc and the
+zone chain entirely.
+==============================================================================
+*/
+
+#define Z_SLAB_SIZE     0x10000
+#define Z_SLAB_HEADER   16  // keeps blocks aligned
+
+void Z_PoolInit(zpool_t *pool, const char *name, size_t size, memtag_t tag)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->name = name;
+    pool->tag = tag;
+    pool->size = (size + 15) & ~15;
+    pool->perslab = max(1, (Z_SLAB_SIZE - Z_SLAB_HEADER) / pool->size);
+
+    pool->next = z_pools;
+    z_pools = pool;
+}
+
+void Z_PoolShutdown(zpool_t *pool)
+{
+    zpool_t **p;
+    void *slab, *next;
+
+    for (p = &z_pools; *p; p = &(*p)->next) {
+        if (*p == pool) {
+            *p = pool->next;
+            break;
+        }
+    }
+
+    if (pool->numused) {
+        Com_WPrintf("%s: %s leaked %"PRIz" blocks\n",
+                    __func__, pool->name, pool->numused);
+    }
+
+    for (slab = pool->slabs; slab; slab = next) {
+        next = *(void **)slab;
+        Z_Free(slab);
+    }
+
+    memset(pool, 0, sizeof(*pool));
+}
+
+static void Z_PoolGrow(zpool_t *pool)
+{
+    byte *slab, *block;
+    size_t i;
+
+    slab = Z_TagMalloc(Z_SLAB_HEADER + pool->size * pool->perslab, pool->tag);
+    *(void **)slab = pool->slabs;
+    pool->slabs = slab;
+    pool->numslabs++;
+
+    block = slab + Z_SLAB_HEADER;
+    for (i = 0; i < pool->perslab; i++, block += pool->size) {
+        *(void **)block = pool->free;
+        pool->free = block;
+    }
+}
+
+void *Z_PoolAlloc(zpool_t *pool)
+{
+    void *ptr;
+
+    if (!pool->free) {
+        Z_PoolGrow(pool);
+    }
+
+    ptr = pool->free;
+    pool->free = *(void **)ptr;
+
+    pool->numallocs++;
+    if (++pool->numused > pool->peakused) {
+        pool->peakused = pool->numused;
+    }
+
+    return ptr;
+}
+
+void Z_PoolFree(zpool_t *pool, void *ptr)
+{
+    if (!ptr) {
+        return;
+    }
+
+    if (!pool->numused) {
+        Com_Error(ERR_FATAL, "%s: %s: double free", __func__, pool->name);
+    }
+
+    *(void **)ptr = pool->free;
+    pool->free = ptr;
+    pool->numused--;
+}
+
 /*
 ========================
 Z_Init
@@ -391,7 +828,11 @@ Z_Init
 */
 void Z_Init(void)
 {
-    z_chain.next = z_chain.prev = &z_chain;
+    int i;
+
+    for (i = 0; i < TAG_MAX + Z_GAME_CHAINS; i++) {
+        z_chains[i].next = z_chains[i].prev = &z_chains[i];
+    }
 }
 
 /*
@@ -441,6 +882,7 @@ char *Z_CvarCopyString(const char *in)
     s = &z_stats[TAG_STATIC];
     s->count++;
     s->bytes += z->z.size;
+    s->peak = max(s->peak, s->bytes);
     return z->data;
 }
 
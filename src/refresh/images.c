@@ -1597,7 +1597,7 @@ static int _try_image_format(imageformat_t fmt, image_t *image, byte **pic)
     qerror_t    ret;
 
     // load the file
-    len = FS_LoadFile(image->name, (void **)&data);
+    len = FS_LoadFileEx(image->name, (void **)&data, FS_FLAG_VIEW, TAG_FILESYSTEM);
     if (!data) {
         return len;
     }
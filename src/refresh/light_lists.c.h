@@ -41,7 +41,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // the trick for many scenarios
 
 static vec3_t* cluster_aabbs(bsp_mesh_t *wm, float dilation) {
-	vec3_t* aabbs = Z_Malloc(wm->num_clusters  * 2 * sizeof(vec3_t));
+	vec3_t* aabbs = Hunk_Alloc(&wm->hunk, wm->num_clusters  * 2 * sizeof(vec3_t));
 	for (int i = 0; i < wm->num_clusters ; i++) {
 		vec3_t* aabb_min = aabbs[2 * i];
 		vec3_t* aabb_max = aabb_min + 1;
@@ -121,7 +121,7 @@ collect_light_clusters(bsp_mesh_t *wm, bsp_t *bsp)
 	mface_t *surfaces = bsp->faces;
 	int num_faces = bsp->numfaces;
 
-	int *face_clusters = Z_Malloc(num_faces * sizeof(int));
+	int *face_clusters = Hunk_Alloc(&wm->hunk, num_faces * sizeof(int));
 	memset(face_clusters, -1, num_faces * sizeof(int));
 
 	int num_leafs = bsp->numleafs;
@@ -146,9 +146,9 @@ collect_cluster_lights(bsp_mesh_t *wm, bsp_t *bsp)
 	int num_cluster_bytes = bsp->visrowsize;
 
 	wm->num_clusters = num_clusters;
-	wm->cluster_light_offsets = Z_Malloc((num_clusters+1) * sizeof(int));
+	wm->cluster_light_offsets = Hunk_Alloc(&wm->hunk, (num_clusters+1) * sizeof(int));
 
-	int *local_light_counts = Z_Malloc(num_clusters * sizeof(int));
+	int *local_light_counts = Hunk_Alloc(&wm->hunk, num_clusters * sizeof(int));
 	memset(local_light_counts, 0, num_clusters * sizeof(int));
 
 	int num_tris = wm->num_indices/3;
@@ -163,7 +163,7 @@ collect_cluster_lights(bsp_mesh_t *wm, bsp_t *bsp)
 		}
 	}
 
-	int *local_light_offsets = Z_Malloc((num_clusters+1) * sizeof(int));
+	int *local_light_offsets = Hunk_Alloc(&wm->hunk, (num_clusters+1) * sizeof(int));
 	int num_cluster_lights = 0;
 	for (int i = 0; i < num_clusters; i++) {
 		local_light_offsets[i] = num_cluster_lights;
@@ -171,7 +171,7 @@ collect_cluster_lights(bsp_mesh_t *wm, bsp_t *bsp)
 	}
 	local_light_offsets[num_clusters] = num_cluster_lights;
 
-	int *local_cluster_lights = Z_Malloc(num_cluster_lights * sizeof(int));
+	int *local_cluster_lights = Hunk_Alloc(&wm->hunk, num_cluster_lights * sizeof(int));
 	for (int i = 0; i < num_tris; i++) {
 		if (wm->materials[i] & BSP_FLAG_LIGHT || wm->clusters[i] & BSP_FLAG_LIGHT) {
 			int cidx = wm->clusters[i];
@@ -187,7 +187,7 @@ collect_cluster_lights(bsp_mesh_t *wm, bsp_t *bsp)
 	// that requires AABBs of clusters!
 	vec3_t* aabbs = cluster_aabbs(wm, 8.f); // 8 taken from FatPVS
 
-	int *cluster_light_counts = Z_Malloc(num_clusters * sizeof(int));
+	int *cluster_light_counts = Hunk_Alloc(&wm->hunk, num_clusters * sizeof(int));
 	memset(cluster_light_counts, 0, num_clusters * sizeof(int));
 
 	byte mask[VIS_MAX_BYTES];
@@ -212,7 +212,7 @@ collect_cluster_lights(bsp_mesh_t *wm, bsp_t *bsp)
 	wm->cluster_light_offsets[num_clusters] = num_cluster_lights;
 
 	wm->num_cluster_lights = num_cluster_lights;
-	wm->cluster_lights = Z_Malloc(num_cluster_lights * sizeof(int));
+	wm->cluster_lights = Hunk_Alloc(&wm->hunk, num_cluster_lights * sizeof(int));
 
 	for (int i = 0; i < num_clusters; i++) {
 		cluster_vis_mask(bsp, mask, i, aabbs);
@@ -235,9 +235,5 @@ collect_cluster_lights(bsp_mesh_t *wm, bsp_t *bsp)
 		wm->cluster_light_offsets[i] -= cluster_light_counts[i]; // reset after prev loop
 	}
 
-	Z_Free(local_light_counts);
-	Z_Free(local_light_offsets);
-	Z_Free(local_cluster_lights);
-	Z_Free(cluster_light_counts);
-	Z_Free(aabbs);
+	// temporary arrays stay in the level hunk until the next map is loaded
 }
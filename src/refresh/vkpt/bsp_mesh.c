@@ -201,20 +201,31 @@ collect_surfaces(int *idx_ctr, bsp_mesh_t *wm, bsp_t *bsp, int model_idx, int sk
 void
 bsp_mesh_create_from_bsp(bsp_mesh_t *wm, bsp_t *bsp)
 {
-	wm->models_idx_offset = Z_Malloc(bsp->nummodels * sizeof(int));
-	wm->models_idx_count = Z_Malloc(bsp->nummodels * sizeof(int));
+	// all map lifetime data goes into a single hunk that is released at once
+	// in bsp_mesh_destroy. vertex arrays are sized for the worst case, but
+	// pages that are never touched are never committed.
+	size_t maxsize = WM_MAX_VERTICES * 5 * sizeof(float)
+	               + WM_MAX_VERTICES / 3 * 2 * sizeof(uint32_t)
+	               + WM_MAX_VERTICES * sizeof(int)
+	               + bsp->nummodels * 5 * sizeof(uint32_t)
+	               + bsp->numfaces * 3 * sizeof(int)
+	               + WM_HUNK_EXTRA;
+	Hunk_Begin(&wm->hunk, maxsize);
+
+	wm->models_idx_offset = Hunk_Alloc(&wm->hunk, bsp->nummodels * sizeof(int));
+	wm->models_idx_count = Hunk_Alloc(&wm->hunk, bsp->nummodels * sizeof(int));
 	memset(wm->models_idx_offset, 0, bsp->nummodels * sizeof(int));
 	memset(wm->models_idx_count, 0, bsp->nummodels * sizeof(int));
-	wm->model_centers = Z_Malloc(bsp->nummodels * 3 * sizeof(float));
+	wm->model_centers = Hunk_Alloc(&wm->hunk, bsp->nummodels * 3 * sizeof(float));
 
 	wm->num_models = bsp->nummodels;
 
 	wm->num_vertices  = 0;
 	wm->num_indices   = 0;
-	wm->positions     = Z_Malloc(WM_MAX_VERTICES * 3 * sizeof(*wm->positions));
-	wm->tex_coords    = Z_Malloc(WM_MAX_VERTICES * 2 * sizeof(*wm->tex_coords));
-	wm->materials     = Z_Malloc(WM_MAX_VERTICES / 3 * sizeof(*wm->materials));
-	wm->clusters      = Z_Malloc(WM_MAX_VERTICES / 3 * sizeof(*wm->clusters));
+	wm->positions     = Hunk_Alloc(&wm->hunk, WM_MAX_VERTICES * 3 * sizeof(*wm->positions));
+	wm->tex_coords    = Hunk_Alloc(&wm->hunk, WM_MAX_VERTICES * 2 * sizeof(*wm->tex_coords));
+	wm->materials     = Hunk_Alloc(&wm->hunk, WM_MAX_VERTICES / 3 * sizeof(*wm->materials));
+	wm->clusters      = Hunk_Alloc(&wm->hunk, WM_MAX_VERTICES / 3 * sizeof(*wm->clusters));
 
 	int idx_ctr = 0;
 
@@ -240,7 +251,7 @@ bsp_mesh_create_from_bsp(bsp_mesh_t *wm, bsp_t *bsp)
 	wm->num_indices = idx_ctr;
 	wm->num_vertices = idx_ctr;
 
-	wm->indices = Z_Malloc(idx_ctr * sizeof(int));
+	wm->indices = Hunk_Alloc(&wm->hunk, idx_ctr * sizeof(int));
 	for (int i = 0; i < wm->num_vertices; i++)
 		wm->indices[i] = i;
 
@@ -288,18 +299,15 @@ bsp_mesh_create_from_bsp(bsp_mesh_t *wm, bsp_t *bsp)
 	//fclose(f);
 
 	collect_cluster_lights(wm, bsp);
+
+	// release unused reserve
+	Hunk_End(&wm->hunk);
 }
 
 void
 bsp_mesh_destroy(bsp_mesh_t *wm)
 {
-	Z_Free(wm->models_idx_offset);
-	Z_Free(wm->models_idx_count);
-	Z_Free(wm->model_centers);
-
-	Z_Free(wm->positions);
-	Z_Free(wm->tex_coords);
-	Z_Free(wm->indices);
+	Hunk_Free(&wm->hunk);
 
 	memset(wm, 0, sizeof(*wm));
 }
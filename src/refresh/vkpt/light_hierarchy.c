@@ -35,6 +35,12 @@ static VkDescriptorPool        desc_pool_light_hierarchy;
 static BufferResource_t        buf_light_hierarchy[MAX_SWAPCHAIN_IMAGES];
 static BufferResource_t        buf_light_hierarchy_staging[MAX_SWAPCHAIN_IMAGES];
 
+// build temporaries, reserved once and reused by every frame's build
+#define LH_SCRATCH_BINS 16
+static memhunk_t               lh_scratch;
+static int                     lh_scratch_prims;
+static int                     lh_scratch_bins;
+
 typedef struct lh_bin_s {
     int num_prims;
     float c_aabb[6];
@@ -560,14 +566,29 @@ lh_build_binned(void *dst, const float *positions, const uint32_t *colors, int n
 {
 	light_hierarchy_t light_hierarchy;
 	light_hierarchy_t *lh = &light_hierarchy; // fixme
+	memhunk_t *scratch = &lh_scratch;
+
+    // grow the reservation only if a map has more lights than expected,
+    // otherwise pages stay mapped and just get reused
+    if (num_prims > lh_scratch_prims || num_bins > lh_scratch_bins) {
+        Hunk_Free(scratch);
+        lh_scratch_prims = max(num_prims, MAX_LIGHTS);
+        lh_scratch_bins = max(num_bins, LH_SCRATCH_BINS);
+        Hunk_Begin(scratch, 3 * lh_scratch_prims * sizeof(lh_node_t)
+                          + lh_scratch_prims * sizeof(lh_prim_t)
+                          + 9 * lh_scratch_bins * sizeof(lh_bin_t) + 11 * 64);
+    }
+    scratch->cursize = 0;
 
     lh->max_num_nodes = 3 * num_prims;
-    lh->nodes = calloc(lh->max_num_nodes, sizeof(lh_node_t));
+    lh->nodes = Hunk_Alloc(scratch, lh->max_num_nodes * sizeof(lh_node_t));
+    memset(lh->nodes, 0, lh->max_num_nodes * sizeof(lh_node_t));
     lh->num_nodes = 0;
 
     float c_aabb[6];
     lh_init_aabb(c_aabb);
-    lh_prim_t *prims = calloc(num_prims, sizeof(lh_prim_t));
+    lh_prim_t *prims = Hunk_Alloc(scratch, num_prims * sizeof(lh_prim_t));
+    memset(prims, 0, num_prims * sizeof(lh_prim_t));
     for (int i = 0; i < num_prims; i++)
     {
         lh_prim_t *prim = &prims[i];
@@ -598,26 +619,19 @@ lh_build_binned(void *dst, const float *positions, const uint32_t *colors, int n
     lh_bin_t *a_bins[3][2];
     for (int d = 0; d < 3; d++)
     {
-        bins[d] = calloc(num_bins, sizeof(lh_bin_t));
-        for (int i = 0; i < 2; i++)
-            a_bins[d][i] = calloc(num_bins, sizeof(lh_bin_t));
+        bins[d] = Hunk_Alloc(scratch, num_bins * sizeof(lh_bin_t));
+        memset(bins[d], 0, num_bins * sizeof(lh_bin_t));
+        for (int i = 0; i < 2; i++) {
+            a_bins[d][i] = Hunk_Alloc(scratch, num_bins * sizeof(lh_bin_t));
+            memset(a_bins[d][i], 0, num_bins * sizeof(lh_bin_t));
+        }
     }
 
     lh_child_t child;
     lh_build_binned_rec(lh, &child, 0, num_prims, prims, num_bins, bins, a_bins, c_aabb, 0);
 
-    for (int d = 0; d < 3; d++)
-    {
-        free(bins[d]);
-        for (int i = 0; i < 2; i++)
-            free(a_bins[d][i]);
-    }
-    free(prims);
-
 	lh_compactify(lh, dst, positions, colors);
 
-    free(lh->nodes);
-
 	return lh->num_nodes;
 }
 
@@ -817,6 +831,8 @@ vkpt_lh_destroy()
 	}
 	vkDestroyDescriptorPool(qvk.device, desc_pool_light_hierarchy, NULL);
 	vkDestroyDescriptorSetLayout(qvk.device, qvk.desc_set_layout_light_hierarchy, NULL);
+	Hunk_Free(&lh_scratch);
+	lh_scratch_prims = lh_scratch_bins = 0;
 	return VK_SUCCESS;
 }
 
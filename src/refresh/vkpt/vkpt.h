@@ -208,7 +208,10 @@ _VK_EXTENSION_LIST
 #undef _VK_EXTENSION_DO
 
 #define WM_MAX_VERTICES (1<<24)
+#define WM_HUNK_EXTRA   (256<<20) // cluster light lists and temporaries
 typedef struct bsp_mesh_s {
+	memhunk_t hunk;
+
 	uint32_t world_idx_count;
 	uint32_t *models_idx_offset;
 	uint32_t *models_idx_count;
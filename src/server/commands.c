@@ -1563,10 +1563,18 @@ static const cmdreg_t c_server[] = {
     { "addfiltercmd", SV_AddFilterCmd_f, SV_AddFilterCmd_c },
     { "delfiltercmd", SV_DelFilterCmd_f, SV_DelFilterCmd_c },
     { "listfiltercmds", SV_ListFilterCmds_f },
+    { "tracestats", SV_TraceStats_f },
+    { "lagstats", SV_LagStats_f },
+    { "deltastats", SV_DeltaStats_f },
+    { "perfstats", SV_PerfStats_f },
 #if USE_MVD_CLIENT || USE_MVD_SERVER
     { "mvdrecord", SV_Record_f, SV_Record_c },
     { "mvdstop", SV_Stop_f },
 #endif
+#if USE_TESTS
+    { "areatest", SV_AreaTest_f },
+    { "deltatest", SV_DeltaTest_f },
+#endif
 
     { NULL }
 };
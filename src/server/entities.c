@@ -17,6 +17,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "server.h"
+#include "common/mdfour.h"
 
 /*
 =============================================================================
@@ -30,6 +31,119 @@ Encode a client frame onto the network channel
 #define Q2PRO_OPTIMIZE(c) \
     ((c)->protocol == PROTOCOL_VERSION_Q2PRO && !(c)->settings[CLS_RECORDING])
 
+/*
+=============================================================================
+
+DELTA CACHE
+
+Encoded entity delta is a function of the two states and flags only, so
+identical deltas written for different clients (e.g. spectators chasing
+the same player, or clients delta'ing from the same frame) are copied from
+a direct-mapped cache instead of being encoded again.
+
+=============================================================================
+*/
+
+#define DC_HASH_SIZE    2048
+#define DC_HASH_MASK    (DC_HASH_SIZE - 1)
+#define DC_MAXBYTES     64
+
+typedef struct {
+    entity_packed_t from, to;
+    msgEsFlags_t    flags;
+    qboolean        valid;
+    size_t          cursize;
+    byte            data[DC_MAXBYTES];
+} dcentry_t;
+
+static dcentry_t    dc_entries[DC_HASH_SIZE];
+
+static struct {
+    unsigned    lookups;
+    unsigned    hits;
+    size_t      bytes;
+} dc_stats;
+
+static unsigned SV_DeltaCacheHash(const entity_packed_t *from,
+                                  const entity_packed_t *to,
+                                  msgEsFlags_t flags)
+{
+    const byte  *a = (const byte *)from, *b = (const byte *)to;
+    unsigned    hash = flags, x, y;
+    size_t      i;
+
+    for (i = 0; i + 4 <= sizeof(*from); i += 4) {
+        memcpy(&x, a + i, 4);
+        memcpy(&y, b + i, 4);
+        hash = (hash ^ x) * 0x01000193;
+        hash = (hash ^ y) * 0x01000193;
+    }
+    hash ^= hash >> 15;
+
+    return hash & DC_HASH_MASK;
+}
+
+static void SV_WriteDeltaEntity(const entity_packed_t *from,
+                                const entity_packed_t *to,
+                                msgEsFlags_t flags)
+{
+    dcentry_t   *e;
+    size_t      start;
+
+    if (!sv_delta_cache->integer) {
+        MSG_WriteDeltaEntity(from, to, flags);
+        return;
+    }
+
+    dc_stats.lookups++;
+
+    e = &dc_entries[SV_DeltaCacheHash(from, to, flags)];
+    if (e->valid && e->flags == flags &&
+        !memcmp(&e->from, from, sizeof(*from)) &&
+        !memcmp(&e->to, to, sizeof(*to))) {
+        MSG_WriteData(e->data, e->cursize);
+        dc_stats.hits++;
+        dc_stats.bytes += e->cursize;
+        return;
+    }
+
+    start = msg_write.cursize;
+    MSG_WriteDeltaEntity(from, to, flags);
+
+    if (msg_write.overflowed || msg_write.cursize - start > DC_MAXBYTES) {
+        e->valid = qfalse;
+        return;
+    }
+
+    e->from = *from;
+    e->to = *to;
+    e->flags = flags;
+    e->valid = qtrue;
+    e->cursize = msg_write.cursize - start;
+    memcpy(e->data, msg_write.data + start, e->cursize);
+}
+
+/*
+=============
+SV_DeltaStats_f
+=============
+*/
+void SV_DeltaStats_f(void)
+{
+    if (!sv_delta_cache->integer) {
+        Com_Printf("Delta cache is disabled.\n");
+    }
+
+    Com_Printf("%u lookups, %u hits (%.1f%%), %"PRIz" bytes copied\n",
+               dc_stats.lookups, dc_stats.hits,
+               dc_stats.lookups ? dc_stats.hits * 100.0f / dc_stats.lookups : 0.0f,
+               dc_stats.bytes);
+
+    if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset")) {
+        memset(&dc_stats, 0, sizeof(dc_stats));
+    }
+}
+
 /*
 =============
 SV_EmitPacketEntities
@@ -91,7 +205,7 @@ static void SV_EmitPacketEntities(client_t         *client,
             if (Q2PRO_SHORTANGLES(client, newnum)) {
                 flags |= MSG_ES_SHORTANGLES;
             }
-            MSG_WriteDeltaEntity(oldent, newent, flags);
+            SV_WriteDeltaEntity(oldent, newent, flags);
             oldindex++;
             newindex++;
             continue;
@@ -114,7 +228,7 @@ static void SV_EmitPacketEntities(client_t         *client,
             if (Q2PRO_SHORTANGLES(client, newnum)) {
                 flags |= MSG_ES_SHORTANGLES;
             }
-            MSG_WriteDeltaEntity(oldent, newent, flags);
+            SV_WriteDeltaEntity(oldent, newent, flags);
             newindex++;
             continue;
         }
@@ -130,6 +244,159 @@ static void SV_EmitPacketEntities(client_t         *client,
     MSG_WriteShort(0);      // end of packetentities
 }
 
+#if USE_TESTS
+
+#define DT_MAXPAIRS     0x10000
+
+typedef struct {
+    entity_packed_t (*ents)[2];
+    player_packed_t (*players)[2];
+    int             numents;
+    int             numplayers;
+} deltatest_t;
+
+static void SV_DeltaTestCapture(deltatest_t *dt, client_frame_t *from, client_frame_t *to)
+{
+    const entity_packed_t *oldent, *newent;
+    unsigned oldindex, newindex;
+    int oldnum, newnum;
+
+    if (dt->numplayers < DT_MAXPAIRS) {
+        dt->players[dt->numplayers][0] = from->ps;
+        dt->players[dt->numplayers][1] = to->ps;
+        dt->numplayers++;
+    }
+
+    oldindex = newindex = 0;
+    while (newindex < to->num_entities && dt->numents < DT_MAXPAIRS) {
+        newent = &svs.entities[(to->first_entity + newindex) % svs.num_entities];
+        newnum = newent->number;
+        if (oldindex < from->num_entities) {
+            oldent = &svs.entities[(from->first_entity + oldindex) % svs.num_entities];
+            oldnum = oldent->number;
+        } else {
+            oldent = &nullEntityState;
+            oldnum = 9999;
+        }
+
+        if (oldnum < newnum) {
+            oldindex++;
+            continue;
+        }
+
+        if (oldnum > newnum)
+            oldent = &nullEntityState;
+        else
+            oldindex++;
+
+        dt->ents[dt->numents][0] = *oldent;
+        dt->ents[dt->numents][1] = *newent;
+        dt->numents++;
+        newindex++;
+    }
+}
+
+static unsigned SV_DeltaTestRun(const deltatest_t *dt, int passes, unsigned *hash)
+{
+    unsigned start, time;
+    int i, j;
+
+    *hash = 0;
+    start = Sys_Microseconds();
+    for (j = 0; j < passes; j++) {
+        for (i = 0; i < dt->numents; i++) {
+            MSG_WriteDeltaEntity(&dt->ents[i][0], &dt->ents[i][1], MSG_ES_NEWENTITY | MSG_ES_UMASK);
+            if (msg_write.cursize > msg_write.maxsize / 2) {
+                *hash = Com_BlockChecksum(msg_write.data, msg_write.cursize) ^ (*hash * 31);
+                SZ_Clear(&msg_write);
+            }
+        }
+        for (i = 0; i < dt->numplayers; i++) {
+            MSG_WriteDeltaPlayerstate_Default(&dt->players[i][0], &dt->players[i][1]);
+            if (msg_write.cursize > msg_write.maxsize / 2) {
+                *hash = Com_BlockChecksum(msg_write.data, msg_write.cursize) ^ (*hash * 31);
+                SZ_Clear(&msg_write);
+            }
+        }
+    }
+    time = Sys_Microseconds() - start;
+
+    *hash = Com_BlockChecksum(msg_write.data, msg_write.cursize) ^ (*hash * 31);
+    SZ_Clear(&msg_write);
+
+    return time;
+}
+
+/*
+=============
+SV_DeltaTest_f
+
+Replays entity and player state deltas captured from frames currently held
+for spawned clients through the SIMD and scalar change mask code, verifying
+that both produce identical output.
+=============
+*/
+void SV_DeltaTest_f(void)
+{
+    deltatest_t     dt;
+    client_t        *client;
+    unsigned        hash_simd, hash_scalar, time_simd, time_scalar;
+    int             passes, count, f;
+
+    if (!svs.initialized) {
+        Com_Printf("No server running.\n");
+        return;
+    }
+
+    if (msg_write.cursize) {
+        Com_Printf("Message buffer not empty.\n");
+        return;
+    }
+
+    passes = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 100;
+    if (passes < 1) {
+        passes = 1;
+    }
+
+    dt.ents = SV_Malloc(sizeof(*dt.ents) * DT_MAXPAIRS);
+    dt.players = SV_Malloc(sizeof(*dt.players) * DT_MAXPAIRS);
+    dt.numents = dt.numplayers = 0;
+
+    FOR_EACH_CLIENT(client) {
+        if (client->state != cs_spawned || client->framenum < UPDATE_BACKUP)
+            continue;
+        for (f = client->framenum - UPDATE_BACKUP + 2; f < client->framenum; f++) {
+            SV_DeltaTestCapture(&dt, &client->frames[(f - 1) & UPDATE_MASK],
+                                &client->frames[f & UPDATE_MASK]);
+        }
+    }
+
+    count = dt.numents + dt.numplayers;
+    if (!count) {
+        Com_Printf("No client frames to replay.\n");
+        goto done;
+    }
+
+    msg_scalar_diff = qtrue;
+    time_scalar = SV_DeltaTestRun(&dt, passes, &hash_scalar);
+    msg_scalar_diff = qfalse;
+    time_simd = SV_DeltaTestRun(&dt, passes, &hash_simd);
+
+    Com_Printf("%d entity and %d player state deltas, %d passes\n",
+               dt.numents, dt.numplayers, passes);
+    Com_Printf("default: %.1f ns/delta\n", time_simd * 1000.0f / passes / count);
+    Com_Printf("scalar:  %.1f ns/delta\n", time_scalar * 1000.0f / passes / count);
+    if (hash_simd != hash_scalar) {
+        Com_EPrintf("Output mismatch!\n");
+    }
+
+done:
+    Z_Free(dt.ents);
+    Z_Free(dt.players);
+}
+
+#endif // USE_TESTS
+
 static client_frame_t *get_last_frame(client_t *client)
 {
     client_frame_t *frame;
@@ -392,7 +659,7 @@ void SV_BuildClientFrame(client_t *client)
     mleaf_t     *leaf;
     byte        clientphs[VIS_MAX_BYTES];
     byte        clientpvs[VIS_MAX_BYTES];
-    int cull_nonvisible_entities = Cvar_Get("sv_cull_nonvisible_entities", "1", CVAR_CHEAT)->integer;
+    int cull_nonvisible_entities = sv_cull_nonvisible_entities->integer;
 
     clent = client->edict;
     if (!clent->client)
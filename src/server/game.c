@@ -434,10 +434,10 @@ static qboolean PF_inVIS(vec3_t p1, vec3_t p2, int vis)
         Com_Error(ERR_DROP, "%s: no map loaded", __func__);
     }
 
-    leaf1 = BSP_PointLeaf(bsp->nodes, p1);
+    leaf1 = SV_PointLeaf(p1);
     BSP_ClusterVis(bsp, mask, leaf1->cluster, vis);
 
-    leaf2 = BSP_PointLeaf(bsp->nodes, p2);
+    leaf2 = SV_PointLeaf(p2);
     if (leaf2->cluster == -1)
         return qfalse;
     if (!Q_IsBitSet(mask, leaf2->cluster))
@@ -564,7 +564,7 @@ static void PF_StartSound(edict_t *edict, int channel,
             // get client viewpos
             ps = &client->edict->client->ps;
             VectorMA(ps->viewoffset, 0.125f, ps->pmove.origin, origin);
-            leaf = CM_PointLeaf(&sv.cm, origin);
+            leaf = SV_PointLeaf(origin);
             area = CM_LeafArea(leaf);
             if (!CM_AreasConnected(&sv.cm, area, edict->areanum)) {
                 // doors can legally straddle two areas, so
@@ -881,6 +881,8 @@ void SV_InitGameProgs(void)
     import.unlinkentity = PF_UnlinkEdict;
     import.BoxEdicts = SV_AreaEdicts;
     import.trace = SV_Trace;
+    import.tracebatch = SV_TraceBatch;
+    import.tracelagged = SV_TraceLagged;
     import.pointcontents = SV_PointContents;
     import.setmodel = PF_setmodel;
     import.inPVS = PF_inPVS;
@@ -419,6 +419,8 @@ void SV_InitGame(unsigned mvd_spawn)
     svs.num_entities = sv_maxclients->integer * UPDATE_BACKUP * MAX_PACKET_ENTITIES;
     svs.entities = SV_Mallocz(sizeof(entity_packed_t) * svs.num_entities);
 
+    SV_InitMessagePools();
+
     // initialize MVD server
     if (!mvd_spawn) {
         SV_MvdInit();
@@ -52,6 +52,7 @@ cvar_t  *sv_show_name_changes;
 cvar_t  *sv_airaccelerate;
 cvar_t  *sv_qwmod;              // atu QW Physics modificator
 cvar_t  *sv_novis;
+cvar_t  *sv_cull_nonvisible_entities;
 
 cvar_t  *sv_maxclients;
 cvar_t  *sv_reserved_slots;
@@ -92,6 +93,10 @@ cvar_t  *sv_namechange_limit;
 
 cvar_t  *sv_allow_unconnected_cmds;
 
+cvar_t  *sv_trace_cache;
+cvar_t  *sv_lagcomp;
+cvar_t  *sv_delta_cache;
+
 cvar_t  *g_features;
 
 cvar_t  *map_override_path;
@@ -1640,6 +1645,8 @@ static void SV_PrepWorldFrame(void)
 
     sv.tracecount = 0;
 
+    SV_ClearTraceCache();
+
     if (!SV_FRAMESYNC)
         return;
 
@@ -1696,6 +1703,8 @@ SV_RunGameFrame
 */
 static void SV_RunGameFrame(void)
 {
+    unsigned start;
+
     // save the entire world state if recording a serverdemo
     SV_MvdBeginFrame();
 
@@ -1704,6 +1713,8 @@ static void SV_RunGameFrame(void)
         time_before_game = Sys_Milliseconds();
 #endif
 
+    start = SV_PerfBegin();
+
     X86_PUSH_FPCW;
     X86_SINGLE_FPCW;
 
@@ -1711,6 +1722,11 @@ static void SV_RunGameFrame(void)
 
     X86_POP_FPCW;
 
+    SV_PerfEnd(PERF_GAME, start);
+
+    // save positions for lag compensated traces
+    SV_RecordLagFrame();
+
 #if USE_CLIENT
     if (host_speeds->integer)
         time_after_game = Sys_Milliseconds();
@@ -1724,7 +1740,9 @@ static void SV_RunGameFrame(void)
     }
 
     // save the entire world state if recording a serverdemo
+    start = SV_PerfBegin();
     SV_MvdEndFrame();
+    SV_PerfEnd(PERF_MVD, start);
 }
 
 /*
@@ -1813,6 +1831,10 @@ Returns amount of extra frametime available for sleeping on IO.
 */
 unsigned SV_Frame(unsigned msec)
 {
+    unsigned    start, perf_start;
+
+    perf_start = SV_PerfBegin();
+
 #if USE_CLIENT
     time_before_game = time_after_game = 0;
 #endif
@@ -1831,7 +1853,9 @@ unsigned SV_Frame(unsigned msec)
 #endif
 
     // read packets from UDP clients
+    start = SV_PerfBegin();
     NET_GetPackets(NS_SERVER, SV_PacketEvent);
+    SV_PerfEnd(PERF_PACKETS, start);
 
     if (svs.initialized) {
         // run connection to the anticheat server
@@ -1847,6 +1871,7 @@ unsigned SV_Frame(unsigned msec)
     // move autonomous things around if enough time has passed
     sv.frameresidual += msec;
     if (sv.frameresidual < SV_FRAMETIME) {
+        SV_PerfEnd(PERF_TOTAL, perf_start);
         return SV_FRAMETIME - sv.frameresidual;
     }
 
@@ -1872,8 +1897,14 @@ unsigned SV_Frame(unsigned msec)
         // clear teleport flags, etc for next frame
         SV_PrepWorldFrame();
 
+        // record telemetry for this frame
+        SV_PerfEndFrame(perf_start);
+
         // advance for next frame
         sv.framenum++;
+    } else {
+        // don't charge paused frames to the next one
+        SV_PerfResetFrame();
     }
 
     if (COM_DEDICATED) {
@@ -2051,6 +2082,8 @@ void SV_Init(void)
 
     SV_MvdRegister();
 
+    SV_PerfRegister();
+
 #if USE_MVD_CLIENT
     MVD_Register();
 #endif
@@ -2095,6 +2128,7 @@ void SV_Init(void)
     sv_reserved_password = Cvar_Get("sv_reserved_password", "", CVAR_PRIVATE);
     sv_locked = Cvar_Get("sv_locked", "0", 0);
     sv_novis = Cvar_Get("sv_novis", "0", 0);
+    sv_cull_nonvisible_entities = Cvar_Get("sv_cull_nonvisible_entities", "1", CVAR_CHEAT);
     sv_downloadserver = Cvar_Get("sv_downloadserver", "", 0);
     sv_redirect_address = Cvar_Get("sv_redirect_address", "", 0);
 
@@ -2141,6 +2175,10 @@ void SV_Init(void)
 
     sv_allow_unconnected_cmds = Cvar_Get("sv_allow_unconnected_cmds", "0", 0);
 
+    sv_trace_cache = Cvar_Get("sv_trace_cache", "0", 0);
+    sv_delta_cache = Cvar_Get("sv_delta_cache", "1", 0);
+    sv_lagcomp = Cvar_Get("sv_lagcomp", "0", 0);
+
     Cvar_Get("sv_features", va("%d", SV_FEATURES), CVAR_ROM);
     g_features = Cvar_Get("g_features", "0", CVAR_ROM);
 
@@ -2249,11 +2287,14 @@ void SV_Shutdown(const char *finalmsg, error_type_t type)
 
     SV_MvdShutdown(type);
 
+    SV_PerfShutdown();
+
     SV_FinalMessage(finalmsg, type);
     SV_MasterShutdown();
     SV_ShutdownGameProgs();
 
     // free current level
+    SV_ClearLagHistory();
     CM_FreeMap(&sv.cm);
     SV_FreeFile(sv.entitystring);
     memset(&sv, 0, sizeof(sv));
@@ -2261,6 +2302,7 @@ void SV_Shutdown(const char *finalmsg, error_type_t type)
     // free server static data
     Z_Free(svs.client_pool);
     Z_Free(svs.entities);
+    SV_ShutdownMessagePools();
 #if USE_ZLIB
     deflateEnd(&svs.z);
 #endif
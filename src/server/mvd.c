@@ -29,6 +29,22 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define FOR_EACH_ACTIVE_GTV(client) \
     LIST_FOR_EACH(gtv_client_t, client, &gtv_active_list, active)
 
+// shared deflate stream is flushed every that many frames
+#define GTV_CHUNK_FRAMES    10
+
+#if USE_ZLIB
+// piece of shared deflate stream between two full flush points
+typedef struct gtv_chunk_s {
+    struct gtv_chunk_s  *next;
+    unsigned    refcount;
+    size_t      start;      // offset in shared stream
+    size_t      len;        // compressed length
+    size_t      ulen;       // uncompressed length
+    uLong       adler;      // of uncompressed data
+    byte        data[1];
+} gtv_chunk_t;
+#endif
+
 typedef struct {
     list_t      entry;
     list_t      active;
@@ -36,6 +52,16 @@ typedef struct {
     netstream_t stream;
 #if USE_ZLIB
     z_stream    z;
+
+    // shared deflate mode
+    qboolean    shared;
+    gtv_chunk_t *chunk;     // NULL if not receiving shared stream
+    gtv_chunk_t *detach;    // stop after this chunk
+    gtv_chunk_t *resume;    // continue after this chunk if restarted
+    size_t      offset;     // into current chunk
+    uLong       adler;      // of everything sent to this client
+    byte        *pending;   // stored blocks waiting for chunk boundary
+    size_t      pendlen;
 #endif
     unsigned    msglen;
     unsigned    lastmessage;
@@ -73,13 +99,46 @@ typedef struct {
     qhandle_t       recording;
     int             numlevels; // stop after that many levels
     int             numframes; // stop after that many frames
+    size_t          recsize;   // uncompressed bytes queued for writing
 
     // TCP client pool
     gtv_client_t    *clients; // [sv_mvd_maxclients]
+
+#if USE_ZLIB
+    // shared compressor for GTV clients
+    z_stream        z;
+    byte            *zdata;     // compressed data of current chunk
+    size_t          zsize;
+    size_t          zlen;
+    size_t          zulen;
+    uLong           zadler;
+    unsigned        zframes;    // since last chunk
+    unsigned        zclients;   // clients receiving shared stream
+    gtv_chunk_t     *ztail;
+    size_t          ztotal_in;
+    size_t          ztotal_out;
+#endif
 } mvd_server_t;
 
 static mvd_server_t     mvd;
 
+// asynchronous writer for local recorder
+#define REC_RING_SIZE   (1 << 20)   // must be power of two
+
+typedef struct {
+    systhread_t     *thread;
+    qhandle_t       file;       // owned by writer thread while it runs
+    byte            *data;      // [REC_RING_SIZE]
+    volatile size_t head;       // advanced by game thread
+    volatile size_t tail;       // advanced by writer thread
+    volatile int    stop;
+    volatile int    error;
+    size_t          peak;
+    unsigned        stalls;
+} rec_writer_t;
+
+static rec_writer_t     rec_writer;
+
 // TCP client lists
 static LIST_DECL(gtv_client_list);
 static LIST_DECL(gtv_active_list);
@@ -105,6 +164,10 @@ static cvar_t   *sv_mvd_disconnect_time;
 static cvar_t   *sv_mvd_suspend_time;
 static cvar_t   *sv_mvd_allow_stufftext;
 static cvar_t   *sv_mvd_spawn_dummy;
+static cvar_t   *sv_mvd_async;
+#if USE_ZLIB
+static cvar_t   *sv_mvd_shared;
+#endif
 
 static qboolean mvd_enable(void);
 static void     mvd_disable(void);
@@ -114,12 +177,15 @@ static void     write_stream(gtv_client_t *client, void *data, size_t len);
 static void     write_message(gtv_client_t *client, gtv_serverop_t op);
 #if USE_ZLIB
 static void     flush_stream(gtv_client_t *client, int flush);
+static void     shared_write(void *data, size_t len);
+static void     shared_close(void);
 #endif
 
 static void     rec_stop(void);
 static qboolean rec_allowed(void);
 static void     rec_start(qhandle_t demofile);
 static void     rec_write(void);
+static qerror_t rec_put(const void *data, size_t len);
 
 
 /*
@@ -816,39 +882,58 @@ static void emit_frame(void)
     MSG_WriteShort(0);      // end of packetentities
 }
 
-static void suspend_streams(void)
+// sends msg_write to all active clients, optionally flushing their streams
+static void broadcast_message(gtv_serverop_t op, qboolean flush)
 {
     gtv_client_t *client;
 
     FOR_EACH_ACTIVE_GTV(client) {
-        // send stream suspend marker
-        write_message(client, GTS_STREAM_DATA);
 #if USE_ZLIB
-        flush_stream(client, Z_SYNC_FLUSH);
+        if (client->shared) {
+            continue;
+        }
+#endif
+        write_message(client, op);
+#if USE_ZLIB
+        if (flush) {
+            flush_stream(client, Z_SYNC_FLUSH);
+        }
 #endif
         NET_UpdateStream(&client->stream);
     }
 
+#if USE_ZLIB
+    if (mvd.zclients) {
+        byte header[3];
+        size_t len = msg_write.cursize + 1;
+
+        header[0] = len & 255;
+        header[1] = (len >> 8) & 255;
+        header[2] = op;
+        shared_write(header, sizeof(header));
+        shared_write(msg_write.data, msg_write.cursize);
+        shared_close();
+    }
+#endif
+}
+
+static void suspend_streams(void)
+{
+    // send stream suspend marker
+    broadcast_message(GTS_STREAM_DATA, qtrue);
+
     Com_DPrintf("Suspending MVD streams.\n");
     mvd.active = qfalse;
 }
 
 static void resume_streams(void)
 {
-    gtv_client_t *client;
-
     // build and emit gamestate
     build_gamestate();
     emit_gamestate();
 
-    FOR_EACH_ACTIVE_GTV(client) {
-        // send gamestate
-        write_message(client, GTS_STREAM_DATA);
-#if USE_ZLIB
-        flush_stream(client, Z_SYNC_FLUSH);
-#endif
-        NET_UpdateStream(&client->stream);
-    }
+    // send gamestate
+    broadcast_message(GTS_STREAM_DATA, qtrue);
 
     // write it to demofile
     if (mvd.recording) {
@@ -961,27 +1046,27 @@ static void mvd_disable(void)
 static void rec_frame(size_t total)
 {
     uint16_t msglen;
-    ssize_t ret;
+    qerror_t ret;
 
     if (!total)
         return;
 
     msglen = LittleShort(total);
-    ret = FS_Write(&msglen, 2, mvd.recording);
-    if (ret != 2)
+    ret = rec_put(&msglen, 2);
+    if (ret)
         goto fail;
-    ret = FS_Write(mvd.message.data, mvd.message.cursize, mvd.recording);
-    if (ret != mvd.message.cursize)
+    ret = rec_put(mvd.message.data, mvd.message.cursize);
+    if (ret)
         goto fail;
-    ret = FS_Write(msg_write.data, msg_write.cursize, mvd.recording);
-    if (ret != msg_write.cursize)
+    ret = rec_put(msg_write.data, msg_write.cursize);
+    if (ret)
         goto fail;
-    ret = FS_Write(mvd.datagram.data, mvd.datagram.cursize, mvd.recording);
-    if (ret != mvd.datagram.cursize)
+    ret = rec_put(mvd.datagram.data, mvd.datagram.cursize);
+    if (ret)
         goto fail;
 
     if (sv_mvd_maxsize->value > 0 &&
-        FS_Tell(mvd.recording) > sv_mvd_maxsize->value * 1000) {
+        mvd.recsize > sv_mvd_maxsize->value * 1000) {
         Com_Printf("Stopping MVD recording, maximum size reached.\n");
         rec_stop();
         return;
@@ -1076,6 +1161,11 @@ void SV_MvdEndFrame(void)
 
     // send frame to clients
     FOR_EACH_ACTIVE_GTV(client) {
+#if USE_ZLIB
+        if (client->shared) {
+            continue;
+        }
+#endif
         write_stream(client, header, sizeof(header));
         write_stream(client, mvd.message.data, mvd.message.cursize);
         write_stream(client, msg_write.data, msg_write.cursize);
@@ -1088,6 +1178,19 @@ void SV_MvdEndFrame(void)
         NET_UpdateStream(&client->stream);
     }
 
+#if USE_ZLIB
+    // compress frame once for all shared clients
+    if (mvd.zclients) {
+        shared_write(header, sizeof(header));
+        shared_write(mvd.message.data, mvd.message.cursize);
+        shared_write(msg_write.data, msg_write.cursize);
+        shared_write(mvd.datagram.data, mvd.datagram.cursize);
+        if (++mvd.zframes >= GTV_CHUNK_FRAMES) {
+            shared_close();
+        }
+    }
+#endif
+
     // write frame to demofile
     if (mvd.recording) {
         rec_frame(total - 1);
@@ -1299,6 +1402,12 @@ TCP CLIENTS HANDLING
 */
 
 
+static void drop_client(gtv_client_t *client, const char *error);
+
+#if USE_ZLIB
+static void shared_detach(gtv_client_t *client);
+#endif
+
 static void remove_client(gtv_client_t *client)
 {
     NET_CloseStream(&client->stream);
@@ -1307,10 +1416,311 @@ static void remove_client(gtv_client_t *client)
         Z_Free(client->data);
         client->data = NULL;
     }
+#if USE_ZLIB
+    shared_detach(client);
+    Z_Free(client->pending);
+    client->pending = NULL;
+    client->pendlen = 0;
+    client->shared = qfalse;
+#endif
     client->state = cs_free;
 }
 
 #if USE_ZLIB
+/*
+Shared deflate mode compresses the MVD stream once for all GTV clients.
+
+All clients receive a single raw deflate stream that is full flushed every
+GTV_CHUNK_FRAMES frames, splitting it into reference counted chunks that
+don't refer to each other. Each client tracks its position in the chunk list
+and receives data from the point it has joined at. Per-client messages are
+sent as stored deflate blocks at chunk boundaries, and zlib header and
+trailer are generated per client, so that every client still sees a single
+valid zlib stream.
+
+Stopping the stream doesn't discard chunks already closed before the stop
+message: they are delivered first, followed by the ack. If the stream is
+restarted before that, the chunks closed in between are skipped and the
+client continues from the restart point, right after the new gamestate. If
+it is stopped again before catching up, it detaches at the first stop point
+instead, and nothing sent after that is delivered.
+*/
+
+static void chunk_unref(gtv_chunk_t *chunk)
+{
+    gtv_chunk_t *next;
+
+    while (chunk && --chunk->refcount == 0) {
+        next = chunk->next;
+        Z_Free(chunk);
+        chunk = next;
+    }
+}
+
+// feeds data into the current chunk
+static void shared_write(void *data, size_t len)
+{
+    z_streamp z = &mvd.z;
+
+    if (!len) {
+        return;
+    }
+
+    mvd.zadler = adler32(mvd.zadler, data, len);
+    mvd.zulen += len;
+
+    z->next_in = data;
+    z->avail_in = (uInt)len;
+
+    do {
+        if (mvd.zlen == mvd.zsize) {
+            mvd.zsize *= 2;
+            mvd.zdata = Z_Realloc(mvd.zdata, mvd.zsize);
+        }
+
+        z->next_out = mvd.zdata + mvd.zlen;
+        z->avail_out = (uInt)(mvd.zsize - mvd.zlen);
+
+        deflate(z, Z_NO_FLUSH);
+
+        mvd.zlen = mvd.zsize - z->avail_out;
+    } while (z->avail_in);
+}
+
+static void shared_attach(gtv_client_t *client)
+{
+    client->chunk = mvd.ztail;
+    client->chunk->refcount++;
+    client->offset = client->chunk->len;
+    client->detach = NULL;
+    client->resume = NULL;
+    mvd.zclients++;
+}
+
+static void shared_detach(gtv_client_t *client)
+{
+    if (!client->chunk) {
+        return;
+    }
+
+    chunk_unref(client->chunk);
+    client->chunk = NULL;
+    client->detach = NULL;
+    client->resume = NULL;
+    mvd.zclients--;
+}
+
+// stream can't be finished properly after falling behind
+static void shared_overflow(gtv_client_t *client)
+{
+    shared_detach(client);
+    client->pendlen = 0;
+    client->shared = qfalse;
+    drop_client(client, "overflowed");
+}
+
+static qboolean shared_boundary(gtv_client_t *client)
+{
+    return !client->pendlen && (!client->chunk ||
+                                client->offset == client->chunk->len);
+}
+
+// moves as much shared and pending data into send FIFO as possible
+static void shared_pump(gtv_client_t *client)
+{
+    fifo_t *fifo = &client->stream.send;
+    gtv_chunk_t *next;
+    size_t len;
+
+    while (1) {
+        // finish current chunk first
+        if (client->chunk && client->offset < client->chunk->len) {
+            len = FIFO_Write(fifo, client->chunk->data + client->offset,
+                             client->chunk->len - client->offset);
+            client->offset += len;
+            if (client->offset < client->chunk->len) {
+                break;
+            }
+        }
+
+        // per-client data goes between chunks, stop ack after the last one
+        if (client->pendlen && (!client->detach ||
+                                client->chunk == client->detach)) {
+            len = FIFO_Write(fifo, client->pending, client->pendlen);
+            client->pendlen -= len;
+            memmove(client->pending, client->pending + len, client->pendlen);
+            if (client->pendlen) {
+                break;
+            }
+        }
+
+        if (!client->chunk) {
+            break;
+        }
+
+        if (client->chunk == client->detach) {
+            next = client->resume;
+            if (!next) {
+                shared_detach(client);
+                break;
+            }
+
+            // skip to restart point, gamestate has been sent already
+            next->refcount++;
+            chunk_unref(client->chunk);
+            client->chunk = next;
+            client->offset = next->len;
+            client->detach = NULL;
+            client->resume = NULL;
+            continue;
+        }
+
+        next = client->chunk->next;
+        if (!next) {
+            break;
+        }
+
+        next->refcount++;
+        chunk_unref(client->chunk);
+        client->chunk = next;
+        client->offset = 0;
+        client->adler = adler32_combine(client->adler, next->adler, next->ulen);
+    }
+}
+
+// full flushes the current chunk and appends it to the list
+static void shared_close(void)
+{
+    z_streamp z = &mvd.z;
+    gtv_chunk_t *chunk, *tail = mvd.ztail;
+    gtv_client_t *client;
+    size_t backlog;
+
+    mvd.zframes = 0;
+
+    if (!mvd.zulen) {
+        return;
+    }
+
+    z->next_in = NULL;
+    z->avail_in = 0;
+
+    do {
+        if (mvd.zlen == mvd.zsize) {
+            mvd.zsize *= 2;
+            mvd.zdata = Z_Realloc(mvd.zdata, mvd.zsize);
+        }
+
+        z->next_out = mvd.zdata + mvd.zlen;
+        z->avail_out = (uInt)(mvd.zsize - mvd.zlen);
+
+        deflate(z, Z_FULL_FLUSH);
+
+        mvd.zlen = mvd.zsize - z->avail_out;
+    } while (!z->avail_out);
+
+    chunk = SV_Malloc(sizeof(*chunk) + mvd.zlen);
+    chunk->next = NULL;
+    chunk->refcount = 1;    // held by mvd.ztail
+    chunk->start = tail->start + tail->len;
+    chunk->len = mvd.zlen;
+    chunk->ulen = mvd.zulen;
+    chunk->adler = mvd.zadler;
+    memcpy(chunk->data, mvd.zdata, mvd.zlen);
+
+    mvd.ztotal_in += mvd.zulen;
+    mvd.ztotal_out += mvd.zlen;
+    mvd.zlen = 0;
+    mvd.zulen = 0;
+    mvd.zadler = adler32(0, NULL, 0);
+
+    // link new chunk and release the old tail
+    tail->next = chunk;
+    chunk->refcount++;
+    mvd.ztail = chunk;
+    chunk_unref(tail);
+
+    FOR_EACH_GTV(client) {
+        if (!client->chunk) {
+            continue;
+        }
+
+        shared_pump(client);
+
+        // allow as much data to be queued as send FIFO holds
+        if (client->chunk) {
+            backlog = chunk->start + chunk->len -
+                      client->chunk->start - client->offset;
+            if (client->resume) {
+                // skipped on restart
+                backlog -= client->resume->start + client->resume->len -
+                           client->detach->start - client->detach->len;
+            }
+            if (backlog > client->stream.send.size) {
+                shared_overflow(client);
+            }
+        }
+
+        NET_UpdateStream(&client->stream);
+    }
+}
+
+// adds per-client data as stored blocks
+static void shared_stored(gtv_client_t *client, void *data, size_t len)
+{
+    size_t size = client->stream.send.size;
+    byte *p;
+    size_t n;
+
+    client->adler = adler32(client->adler, data, len);
+
+    while (len) {
+        n = min(len, 0xffff);
+        if (client->pendlen + n + 5 > size) {
+            shared_overflow(client);
+            return;
+        }
+
+        p = client->pending + client->pendlen;
+        p[0] = 0;   // BFINAL = 0, BTYPE = 00
+        p[1] = n & 255;
+        p[2] = (n >> 8) & 255;
+        p[3] = ~n & 255;
+        p[4] = (~n >> 8) & 255;
+        memcpy(p + 5, data, n);
+
+        client->pendlen += n + 5;
+        data = (byte *)data + n;
+        len -= n;
+    }
+
+    shared_pump(client);
+}
+
+// ends zlib stream with empty final block and adler32 trailer
+static void shared_finish(gtv_client_t *client)
+{
+    byte trailer[9];
+
+    shared_pump(client);
+
+    if (shared_boundary(client)) {
+        trailer[0] = 1;     // BFINAL = 1, BTYPE = 00
+        trailer[1] = 0;
+        trailer[2] = 0;
+        trailer[3] = 0xff;
+        trailer[4] = 0xff;
+        trailer[5] = (client->adler >> 24) & 255;
+        trailer[6] = (client->adler >> 16) & 255;
+        trailer[7] = (client->adler >> 8) & 255;
+        trailer[8] = client->adler & 255;
+        FIFO_Write(&client->stream.send, trailer, sizeof(trailer));
+    }
+
+    shared_detach(client);
+    client->pendlen = 0;
+}
+
 static void flush_stream(gtv_client_t *client, int flush)
 {
     fifo_t *fifo = &client->stream.send;
@@ -1368,6 +1778,10 @@ static void drop_client(gtv_client_t *client, const char *error)
         flush_stream(client, Z_FINISH);
         deflateEnd(&client->z);
     }
+
+    if (client->shared) {
+        shared_finish(client);
+    }
 #endif
 
     List_Remove(&client->active);
@@ -1389,7 +1803,9 @@ static void write_stream(gtv_client_t *client, void *data, size_t len)
     }
 
 #if USE_ZLIB
-    if (client->z.state) {
+    if (client->shared) {
+        shared_stored(client, data, len);
+    } else if (client->z.state) {
         z_streamp z = &client->z;
 
         z->next_in = data;
@@ -1516,7 +1932,16 @@ static void parse_hello(gtv_client_t *client)
 
 #if USE_ZLIB
     // the rest of the stream will be deflated
-    if (flags & GTF_DEFLATE) {
+    if ((flags & GTF_DEFLATE) && mvd.ztail) {
+        static const byte header[2] = { 0x78, 0x9c };
+
+        // zlib header of shared stream
+        FIFO_Write(&client->stream.send, header, sizeof(header));
+        client->pending = SV_Malloc(size);
+        client->pendlen = 0;
+        client->adler = adler32(0, NULL, 0);
+        client->shared = qtrue;
+    } else if (flags & GTF_DEFLATE) {
         client->z.zalloc = SV_zalloc;
         client->z.zfree = SV_zfree;
         if (deflateInit(&client->z, Z_DEFAULT_COMPRESSION) != Z_OK) {
@@ -1572,6 +1997,13 @@ static void parse_stream_start(gtv_client_t *client)
     // send ack to client
     write_message(client, GTS_STREAM_START);
 
+#if USE_ZLIB
+    // gamestate must immediately precede the next chunk
+    if (client->shared) {
+        shared_close();
+    }
+#endif
+
     // send gamestate if active
     if (mvd.active) {
         emit_gamestate();
@@ -1583,6 +2015,14 @@ static void parse_stream_start(gtv_client_t *client)
     }
 
 #if USE_ZLIB
+    if (client->shared && client->state == cs_spawned) {
+        if (client->chunk) {
+            // still catching up with stopped stream
+            client->resume = mvd.ztail;
+        } else {
+            shared_attach(client);
+        }
+    }
     flush_stream(client, Z_SYNC_FLUSH);
 #endif
 }
@@ -1598,6 +2038,17 @@ static void parse_stream_stop(gtv_client_t *client)
 
     List_Delete(&client->active);
 
+#if USE_ZLIB
+    // ack follows the chunks closed so far. If restarted and stopped again
+    // before catching up, keep the first stop point and drop frames sent
+    // in between, so that both acks and the gamestate follow it.
+    if (client->resume) {
+        client->resume = NULL;
+    } else if (client->chunk) {
+        client->detach = mvd.ztail;
+    }
+#endif
+
     // send ack to client
     write_message(client, GTS_STREAM_STOP);
 #if USE_ZLIB
@@ -1805,6 +2256,14 @@ void SV_MvdRunClients(void)
 
     // run existing connections
     FOR_EACH_GTV(client) {
+#if USE_ZLIB
+        // refill send FIFO from shared stream
+        if (client->chunk || client->pendlen) {
+            shared_pump(client);
+            NET_UpdateStream(&client->stream);
+        }
+#endif
+
         // check timeouts
         delta = svs.realtime - client->lastmessage;
         switch (client->state) {
@@ -1860,13 +2319,14 @@ static void dump_clients(void)
     int count;
 
     Com_Printf(
-        "num name             buf lastmsg address               state\n"
-        "--- ---------------- --- ------- --------------------- -----\n");
+        "num name             buf lastmsg sent kB  sends address               state\n"
+        "--- ---------------- --- ------- ------- ------ --------------------- -----\n");
     count = 0;
     FOR_EACH_GTV(client) {
-        Com_Printf("%3d %-16.16s %3"PRIz" %7u %-21s ",
+        Com_Printf("%3d %-16.16s %3"PRIz" %7u %7"PRIz" %6u %-21s ",
                    count, client->name, FIFO_Usage(&client->stream.send),
                    svs.realtime - client->lastmessage,
+                   client->stream.bytes_sent / 1000, client->stream.num_sends,
                    NET_AdrToString(&client->stream.address));
 
         switch (client->state) {
@@ -1911,6 +2371,23 @@ static void dump_versions(void)
 
 void SV_MvdStatus_f(void)
 {
+    if (mvd.recording) {
+        Com_Printf("Recording local MVD, %"PRIz" kB written", mvd.recsize / 1000);
+        if (rec_writer.thread) {
+            Com_Printf(", %"PRIz" kB queued (peak %"PRIz" kB, %u stalls)",
+                       (rec_writer.head - rec_writer.tail) / 1000,
+                       rec_writer.peak / 1000, rec_writer.stalls);
+        }
+        Com_Printf(".\n");
+    }
+
+#if USE_ZLIB
+    if (mvd.ztail) {
+        Com_Printf("Shared deflate: %u clients, %"PRIz" kB in, %"PRIz" kB out.\n",
+                   mvd.zclients, mvd.ztotal_in / 1000, mvd.ztotal_out / 1000);
+    }
+#endif
+
     if (LIST_EMPTY(&gtv_client_list)) {
         Com_Printf("No TCP clients.\n");
     } else {
@@ -1927,6 +2404,13 @@ static void mvd_drop(gtv_serverop_t op)
 {
     gtv_client_t *client;
 
+#if USE_ZLIB
+    // flush frames pending in shared stream
+    if (mvd.zclients) {
+        shared_close();
+    }
+#endif
+
     // drop GTV clients
     FOR_EACH_GTV(client) {
         switch (client->state) {
@@ -1989,7 +2473,6 @@ Server has just changed the map, spawn the MVD dummy and go!
 */
 void SV_MvdMapChanged(void)
 {
-    gtv_client_t *client;
     int ret;
 
     if (!mvd.entities) {
@@ -2016,10 +2499,7 @@ void SV_MvdMapChanged(void)
         emit_gamestate();
 
         // send gamestate to all MVD clients
-        FOR_EACH_ACTIVE_GTV(client) {
-            write_message(client, GTS_STREAM_DATA);
-            NET_UpdateStream(&client->stream);
-        }
+        broadcast_message(GTS_STREAM_DATA, qfalse);
     }
 
     if (mvd.recording) {
@@ -2058,6 +2538,38 @@ void SV_MvdClientDropped(client_t *client)
     }
 }
 
+#if USE_ZLIB
+static void shared_init(void)
+{
+    mvd.z.zalloc = SV_zalloc;
+    mvd.z.zfree = SV_zfree;
+    if (deflateInit2(&mvd.z, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                     -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        Com_EPrintf("Couldn't initialize shared MVD compressor.\n");
+        return;
+    }
+
+    mvd.zsize = MAX_GTS_MSGLEN;
+    mvd.zdata = SV_Malloc(mvd.zsize);
+    mvd.zadler = adler32(0, NULL, 0);
+
+    // empty chunk clients are attached to until the first flush
+    mvd.ztail = SV_Mallocz(sizeof(*mvd.ztail));
+    mvd.ztail->refcount = 1;
+}
+
+static void shared_shutdown(void)
+{
+    if (!mvd.ztail) {
+        return;
+    }
+
+    chunk_unref(mvd.ztail);
+    deflateEnd(&mvd.z);
+    Z_Free(mvd.zdata);
+}
+#endif
+
 /*
 ==================
 SV_MvdInit
@@ -2093,6 +2605,11 @@ void SV_MvdInit(void)
         ret = NET_Listen(qtrue);
         if (ret == NET_OK) {
             mvd.clients = SV_Mallocz(sizeof(gtv_client_t) * sv_mvd_maxclients->integer);
+#if USE_ZLIB
+            if (sv_mvd_shared->integer) {
+                shared_init();
+            }
+#endif
         } else {
             if (ret == NET_ERROR)
                 Com_EPrintf("%s while opening server TCP port.\n", NET_ErrorString());
@@ -2131,6 +2648,10 @@ void SV_MvdShutdown(error_type_t type)
     // drop all clients
     mvd_drop(type == ERR_RECONNECT ? GTS_RECONNECT : GTS_DISCONNECT);
 
+#if USE_ZLIB
+    shared_shutdown();
+#endif
+
     // free static data
     Z_Free(mvd.message.data);
     Z_Free(mvd.clients);
@@ -2150,20 +2671,135 @@ LOCAL MVD RECORDER
 ==============================================================================
 */
 
+/*
+The writer thread drains a single producer, single consumer ring filled by
+the game thread, so that disk stalls and gzip compression don't delay server
+frames. FS_Write only touches the file_t of the handle it is given, and the
+game thread doesn't use the handle until the writer is joined.
+*/
+static void rec_writer_thread(void *arg)
+{
+    rec_writer_t *w = arg;
+    size_t head, pos, len;
+    ssize_t ret;
+
+    while (1) {
+        head = w->head;
+        __sync_synchronize();
+
+        if (head == w->tail) {
+            if (w->stop) {
+                // stop is set after the last head update
+                __sync_synchronize();
+                if (w->head == w->tail)
+                    break;
+                continue;
+            }
+            Sys_Sleep(10);
+            continue;
+        }
+
+        pos = w->tail & (REC_RING_SIZE - 1);
+        len = min(head - w->tail, REC_RING_SIZE - pos);
+
+        // keep draining after error so that game thread never blocks
+        if (!w->error) {
+            ret = FS_Write(w->data + pos, len, w->file);
+            if (ret != len)
+                w->error = ret < 0 ? ret : Q_ERR_FAILURE;
+        }
+
+        __sync_synchronize();
+        w->tail += len;
+    }
+}
+
+static void rec_writer_start(qhandle_t demofile)
+{
+    rec_writer_t *w = &rec_writer;
+
+    memset(w, 0, sizeof(*w));
+    w->file = demofile;
+    w->data = SV_Malloc(REC_RING_SIZE);
+    w->thread = Sys_CreateThread(rec_writer_thread, w);
+    if (!w->thread) {
+        Com_WPrintf("Couldn't create MVD writer thread, writing synchronously.\n");
+        Z_Free(w->data);
+        w->data = NULL;
+    }
+}
+
+static void rec_writer_stop(void)
+{
+    rec_writer_t *w = &rec_writer;
+
+    if (!w->thread)
+        return;
+
+    __sync_synchronize();
+    w->stop = 1;
+    Sys_JoinThread(w->thread);
+    Z_Free(w->data);
+    memset(w, 0, sizeof(*w));
+}
+
+// queues data for the writer thread, or writes it directly if not running
+static qerror_t rec_put(const void *data, size_t len)
+{
+    rec_writer_t *w = &rec_writer;
+    size_t pos, used, n;
+    ssize_t ret;
+
+    if (!len)
+        return Q_ERR_SUCCESS;
+
+    mvd.recsize += len;
+
+    if (!w->thread) {
+        ret = FS_Write(data, len, mvd.recording);
+        if (ret != len)
+            return ret < 0 ? ret : Q_ERR_FAILURE;
+        return Q_ERR_SUCCESS;
+    }
+
+    if (w->error)
+        return w->error;
+
+    // wait for writer to catch up if ring is full
+    while (1) {
+        used = w->head - w->tail;
+        if (REC_RING_SIZE - used >= len)
+            break;
+        w->stalls++;
+        Sys_Sleep(1);
+    }
+
+    pos = w->head & (REC_RING_SIZE - 1);
+    n = min(len, REC_RING_SIZE - pos);
+    memcpy(w->data + pos, data, n);
+    memcpy(w->data, (const byte *)data + n, len - n);
+
+    __sync_synchronize();
+    w->head += len;
+
+    w->peak = max(w->peak, used + len);
+    return Q_ERR_SUCCESS;
+}
+
 static void rec_write(void)
 {
     uint16_t msglen;
-    ssize_t ret;
+    qerror_t ret;
 
     if (!msg_write.cursize)
         return;
 
     msglen = LittleShort(msg_write.cursize);
-    ret = FS_Write(&msglen, 2, mvd.recording);
-    if (ret != 2)
+    ret = rec_put(&msglen, 2);
+    if (ret)
         goto fail;
-    ret = FS_Write(msg_write.data, msg_write.cursize, mvd.recording);
-    if (ret == msg_write.cursize)
+    ret = rec_put(msg_write.data, msg_write.cursize);
+    if (!ret)
         return;
 
 fail:
@@ -2182,7 +2818,10 @@ static void rec_stop(void)
 
     // write demo EOF marker
     msglen = 0;
-    FS_Write(&msglen, 2, mvd.recording);
+    rec_put(&msglen, 2);
+
+    // flush pending data
+    rec_writer_stop();
 
     FS_FCloseFile(mvd.recording);
     mvd.recording = 0;
@@ -2210,10 +2849,14 @@ static void rec_start(qhandle_t demofile)
     mvd.recording = demofile;
     mvd.numlevels = 0;
     mvd.numframes = 0;
+    mvd.recsize = 0;
     mvd.clients_active = svs.realtime;
 
+    if (sv_mvd_async->integer)
+        rec_writer_start(demofile);
+
     magic = MVD_MAGIC;
-    FS_Write(&magic, 4, demofile);
+    rec_put(&magic, 4);
 
     if (mvd.active) {
         emit_gamestate();
@@ -2383,6 +3026,10 @@ void SV_MvdRegister(void)
     sv_mvd_suspend_time = Cvar_Get("sv_mvd_suspend_time", "5", 0);
     sv_mvd_allow_stufftext = Cvar_Get("sv_mvd_allow_stufftext", "0", CVAR_LATCH);
     sv_mvd_spawn_dummy = Cvar_Get("sv_mvd_spawn_dummy", "1", 0);
+    sv_mvd_async = Cvar_Get("sv_mvd_async", "1", 0);
+#if USE_ZLIB
+    sv_mvd_shared = Cvar_Get("sv_mvd_shared", "0", CVAR_LATCH);
+#endif
 
     Cmd_Register(c_svmvd);
 }
@@ -0,0 +1,330 @@
+/*
+Copyright (C) 2003-2008 Andrey Nazarov
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+//
+// sv_perf.c - per-frame server telemetry
+//
+// Phase timers are accumulated in microseconds from the end of the previous
+// game frame, so time spent reading packets between frames is attributed
+// to the frame that follows it.
+//
+
+#include "server.h"
+
+#define PERF_HISTORY    64
+
+static const char *const perf_timer_names[PERF_TIMERS] = {
+    "packets", "game", "build", "write", "compress", "mvd", "total"
+};
+
+static const char *const perf_counter_names[PERF_COUNTERS] = {
+    "traces", "multicasts", "bytes"
+};
+
+perfframe_t         sv_perf;
+qboolean            sv_perf_active;
+
+static perfframe_t  perf_history[PERF_HISTORY];
+static unsigned     perf_numframes;
+static unsigned     perf_slowframes;
+
+// per-client build and write times of the current frame
+static unsigned     perf_clients[MAX_CLIENTS][2];
+
+static qhandle_t    perf_logfile;
+static char         perf_logpath[MAX_OSPATH];
+
+static cvar_t       *sv_perf_enable;
+static cvar_t       *sv_perf_log;
+static cvar_t       *sv_perf_log_size;
+static cvar_t       *sv_perf_slowdump;
+
+/*
+===============================================================================
+
+CSV LOG
+
+===============================================================================
+*/
+
+static void perf_log_close(void)
+{
+    if (!perf_logfile)
+        return;
+
+    FS_FCloseFile(perf_logfile);
+    perf_logfile = 0;
+}
+
+static void perf_log_header(void)
+{
+    int i;
+
+    FS_FPrintf(perf_logfile, "frame,realtime,clients");
+    for (i = 0; i < PERF_TIMERS; i++)
+        FS_FPrintf(perf_logfile, ",%s_us", perf_timer_names[i]);
+    for (i = 0; i < PERF_COUNTERS; i++)
+        FS_FPrintf(perf_logfile, ",%s", perf_counter_names[i]);
+    FS_FPrintf(perf_logfile, "\n");
+}
+
+static void perf_log_open(unsigned mode)
+{
+    qhandle_t f;
+
+    f = FS_EasyOpenFile(perf_logpath, sizeof(perf_logpath), mode | FS_FLAG_TEXT,
+                        "logs/", sv_perf_log->string, ".csv");
+    if (!f) {
+        Cvar_Set("sv_perf_log", "");
+        return;
+    }
+
+    perf_logfile = f;
+    if (!FS_Tell(f))
+        perf_log_header();
+
+    Com_Printf("Logging server telemetry to %s\n", perf_logpath);
+}
+
+// moves full log aside and starts a new one
+static void perf_log_roll(void)
+{
+    char buffer[MAX_OSPATH];
+    qerror_t ret;
+
+    perf_log_close();
+
+    Q_concat(buffer, sizeof(buffer), perf_logpath, ".old", NULL);
+    ret = FS_RenameFile(perf_logpath, buffer);
+    if (ret) {
+        Com_WPrintf("Couldn't rename %s: %s\n", perf_logpath, Q_ErrorString(ret));
+        perf_log_open(FS_MODE_WRITE);
+        return;
+    }
+
+    perf_log_open(FS_MODE_APPEND);
+}
+
+static void perf_log_write(const perfframe_t *frame, int clients)
+{
+    ssize_t limit;
+    int     i;
+
+    if (!perf_logfile) {
+        if (!sv_perf_log->string[0])
+            return;
+        perf_log_open(FS_MODE_APPEND);
+        if (!perf_logfile)
+            return;
+    }
+
+    FS_FPrintf(perf_logfile, "%u,%u,%d", frame->framenum, svs.realtime, clients);
+    for (i = 0; i < PERF_TIMERS; i++)
+        FS_FPrintf(perf_logfile, ",%u", frame->timers[i]);
+    for (i = 0; i < PERF_COUNTERS; i++)
+        FS_FPrintf(perf_logfile, ",%u", frame->counters[i]);
+    FS_FPrintf(perf_logfile, "\n");
+
+    limit = Cvar_ClampInteger(sv_perf_log_size, 0, 1024 * 1024) * 1024;
+    if (limit && FS_Tell(perf_logfile) >= limit)
+        perf_log_roll();
+}
+
+static void sv_perf_log_changed(cvar_t *self)
+{
+    perf_log_close();
+}
+
+/*
+===============================================================================
+
+FRAME ACCOUNTING
+
+===============================================================================
+*/
+
+void SV_PerfEndClient(client_t *client, perftimer_t timer, unsigned start)
+{
+    unsigned    time;
+
+    if (!sv_perf_active)
+        return;
+
+    time = Sys_Microseconds() - start;
+    sv_perf.timers[timer] += time;
+    perf_clients[client->number][timer == PERF_WRITE] += time;
+}
+
+static void perf_dump_frame(const perfframe_t *frame)
+{
+    client_t    *client;
+    int         i;
+
+    Com_WPrintf("Slow frame %u: %.1f ms (limit %d ms)\n", frame->framenum,
+                frame->timers[PERF_TOTAL] * 0.001f, SV_FRAMETIME);
+
+    for (i = 0; i < PERF_TOTAL; i++) {
+        Com_Printf("  %-10s %8.2f ms\n", perf_timer_names[i],
+                   frame->timers[i] * 0.001f);
+    }
+    for (i = 0; i < PERF_COUNTERS; i++) {
+        Com_Printf("  %-10s %8u\n", perf_counter_names[i], frame->counters[i]);
+    }
+
+    Com_Printf("  num name            build ms write ms\n"
+               "  --- --------------- -------- --------\n");
+    FOR_EACH_CLIENT(client) {
+        if (client->state != cs_spawned)
+            continue;
+        Com_Printf("  %3d %-15.15s %8.2f %8.2f\n", client->number, client->name,
+                   perf_clients[client->number][0] * 0.001f,
+                   perf_clients[client->number][1] * 0.001f);
+    }
+}
+
+/*
+==================
+SV_PerfEndFrame
+
+Called by SV_Frame after a game frame has been run and sent out.
+==================
+*/
+void SV_PerfEndFrame(unsigned start)
+{
+    client_t    *client;
+    perfframe_t *frame;
+    int         clients;
+
+    if (sv_perf_active) {
+        sv_perf.timers[PERF_TOTAL] += Sys_Microseconds() - start;
+        sv_perf.framenum = sv.framenum;
+
+        frame = &perf_history[perf_numframes++ % PERF_HISTORY];
+        *frame = sv_perf;
+
+        clients = 0;
+        FOR_EACH_CLIENT(client) {
+            if (client->state == cs_spawned)
+                clients++;
+        }
+
+        perf_log_write(frame, clients);
+
+        if (frame->timers[PERF_TOTAL] > SV_FRAMETIME * 1000) {
+            perf_slowframes++;
+            if (sv_perf_slowdump->integer)
+                perf_dump_frame(frame);
+        }
+    }
+
+    SV_PerfResetFrame();
+}
+
+/*
+==================
+SV_PerfResetFrame
+
+Discards counters accumulated since the last frame. Called by SV_Frame
+when no game frame is run (server paused), so that the time spent in
+paused frames is not charged to the first frame after unpausing.
+==================
+*/
+void SV_PerfResetFrame(void)
+{
+    memset(&sv_perf, 0, sizeof(sv_perf));
+    memset(perf_clients, 0, sizeof(perf_clients));
+
+    // only toggle between frames so that timers stay balanced
+    sv_perf_active = sv_perf_enable->integer > 0;
+    if (!sv_perf_active)
+        perf_log_close();
+}
+
+/*
+==================
+SV_PerfStats_f
+==================
+*/
+void SV_PerfStats_f(void)
+{
+    const perfframe_t   *frame;
+    unsigned    count, i, j;
+    unsigned    total[PERF_TIMERS + PERF_COUNTERS];
+    unsigned    peak[PERF_TIMERS + PERF_COUNTERS];
+    unsigned    value;
+
+    if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset")) {
+        memset(perf_history, 0, sizeof(perf_history));
+        perf_numframes = perf_slowframes = 0;
+        Com_Printf("Server telemetry reset.\n");
+        return;
+    }
+
+    if (!sv_perf_active) {
+        Com_Printf("Server telemetry is disabled (set sv_perf 1).\n");
+    }
+
+    count = min(perf_numframes, PERF_HISTORY);
+    if (!count) {
+        Com_Printf("No frames recorded.\n");
+        return;
+    }
+
+    memset(total, 0, sizeof(total));
+    memset(peak, 0, sizeof(peak));
+    for (i = 0; i < count; i++) {
+        frame = &perf_history[i];
+        for (j = 0; j < PERF_TIMERS + PERF_COUNTERS; j++) {
+            if (j < PERF_TIMERS)
+                value = frame->timers[j];
+            else
+                value = frame->counters[j - PERF_TIMERS];
+            total[j] += value;
+            peak[j] = max(peak[j], value);
+        }
+    }
+
+    Com_Printf("Last %u frames, %u slow since reset:\n"
+               "phase         avg ms   max ms\n"
+               "---------- -------- --------\n", count, perf_slowframes);
+    for (j = 0; j < PERF_TIMERS; j++) {
+        Com_Printf("%-10s %8.2f %8.2f\n", perf_timer_names[j],
+                   total[j] * 0.001f / count, peak[j] * 0.001f);
+    }
+
+    Com_Printf("\ncounter         avg      max\n"
+               "---------- -------- --------\n");
+    for (j = 0; j < PERF_COUNTERS; j++) {
+        Com_Printf("%-10s %8u %8u\n", perf_counter_names[j],
+                   total[PERF_TIMERS + j] / count, peak[PERF_TIMERS + j]);
+    }
+}
+
+void SV_PerfRegister(void)
+{
+    sv_perf_enable = Cvar_Get("sv_perf", "0", 0);
+    sv_perf_log = Cvar_Get("sv_perf_log", "", 0);
+    sv_perf_log->changed = sv_perf_log_changed;
+    sv_perf_log_size = Cvar_Get("sv_perf_log_size", "1024", 0);
+    sv_perf_slowdump = Cvar_Get("sv_perf_slowdump", "1", 0);
+}
+
+void SV_PerfShutdown(void)
+{
+    perf_log_close();
+}
@@ -171,6 +171,7 @@ static int copy_file(const char *src, const char *dst, const char *name)
     if (ferror(ofp))
         goto fail2;
 
+    FS_IndexFile(path);
     ret = 0;
 fail2:
     fclose(ofp);
@@ -87,6 +87,8 @@ static qboolean SV_RateDrop(client_t *client)
 
 static void SV_CalcSendTime(client_t *client, size_t size)
 {
+    SV_PerfCount(PERF_BYTES, size);
+
     // never drop over the loopback
     if (!client->rate) {
         client->send_time = svs.realtime;
@@ -265,6 +267,8 @@ void SV_Multicast(vec3_t origin, multicast_t to)
         Com_Error(ERR_DROP, "%s: no map loaded", __func__);
     }
 
+    SV_PerfCount(PERF_MULTICASTS, 1);
+
     flags = 0;
 
     switch (to) {
@@ -279,7 +283,7 @@ void SV_Multicast(vec3_t origin, multicast_t to)
         flags |= MSG_RELIABLE;
         // intentional fallthrough
     case MULTICAST_PHS:
-        leaf1 = CM_PointLeaf(&sv.cm, origin);
+        leaf1 = SV_PointLeaf(origin);
         leafnum = leaf1 - sv.cm.cache->leafs;
         BSP_ClusterVis(sv.cm.cache, mask, leaf1->cluster, DVIS_PHS);
         break;
@@ -287,7 +291,7 @@ void SV_Multicast(vec3_t origin, multicast_t to)
         flags |= MSG_RELIABLE;
         // intentional fallthrough
     case MULTICAST_PVS:
-        leaf1 = CM_PointLeaf(&sv.cm, origin);
+        leaf1 = SV_PointLeaf(origin);
         leafnum = leaf1 - sv.cm.cache->leafs;
         BSP_ClusterVis(sv.cm.cache, mask, leaf1->cluster, DVIS_PVS);
         break;
@@ -316,7 +320,7 @@ void SV_Multicast(vec3_t origin, multicast_t to)
             // uses entity origin for PVS/PHS culling, not the view origin
             VectorCopy(client->edict->s.origin, org);
 #endif
-            leaf2 = CM_PointLeaf(&sv.cm, org);
+            leaf2 = SV_PointLeaf(org);
             if (!CM_AreasConnected(&sv.cm, leaf1->area, leaf2->area))
                 continue;
             if (leaf2->cluster == -1)
@@ -398,6 +402,9 @@ unless told otherwise.
 */
 void SV_ClientAddMessage(client_t *client, int flags)
 {
+    unsigned    start;
+    qboolean    compressed;
+
     SV_DPrintf(1, "Added %sreliable message to %s: %"PRIz" bytes\n",
                (flags & MSG_RELIABLE) ? "" : "un", client->name, msg_write.cursize);
 
@@ -405,7 +412,10 @@ void SV_ClientAddMessage(client_t *client, int flags)
         return;
     }
 
-    if (compress_message(client, flags)) {
+    start = SV_PerfBegin();
+    compressed = compress_message(client, flags);
+    SV_PerfEnd(PERF_COMPRESS, start);
+    if (compressed) {
         goto clear;
     }
 
@@ -426,6 +436,16 @@ FRAME UPDATES - COMMON
 ===============================================================================
 */
 
+static inline zpool_t *msg_pool_for_size(size_t len)
+{
+    int i;
+
+    for (i = 0; (MSG_MINCLASS << i) < len; i++)
+        ;
+
+    return &svs.msg_pools[i];
+}
+
 static inline void free_msg_packet(client_t *client, message_packet_t *msg)
 {
     List_Remove(&msg->entry);
@@ -435,7 +455,7 @@ static inline void free_msg_packet(client_t *client, message_packet_t *msg)
             Com_Error(ERR_FATAL, "%s: bad packet size", __func__);
         }
         client->msg_dynamic_bytes -= msg->cursize;
-        Z_Free(msg);
+        Z_PoolFree(msg_pool_for_size(msg->cursize), msg);
     } else {
         List_Insert(&client->msg_free_list, &msg->entry);
     }
@@ -480,7 +500,7 @@ static void add_msg_packet(client_t    *client,
                         __func__, client->name);
             goto overflowed;
         }
-        msg = SV_Malloc(sizeof(*msg) + len - MSG_TRESHOLD);
+        msg = Z_PoolAlloc(msg_pool_for_size(len));
         client->msg_dynamic_bytes += len;
     } else {
         if (LIST_EMPTY(&client->msg_free_list)) {
@@ -881,6 +901,7 @@ void SV_SendClientMessages(void)
 {
     client_t    *client;
     size_t      cursize;
+    unsigned    start;
 
     // send a message to each connected client
     FOR_EACH_CLIENT(client) {
@@ -916,8 +937,13 @@ void SV_SendClientMessages(void)
         }
 
         // build the new frame and write it
+        start = SV_PerfBegin();
         SV_BuildClientFrame(client);
+        SV_PerfEndClient(client, PERF_BUILD, start);
+
+        start = SV_PerfBegin();
         client->WriteDatagram(client);
+        SV_PerfEndClient(client, PERF_WRITE, start);
 
 advance:
         // advance for next frame
@@ -1070,3 +1096,27 @@ void SV_ShutdownClientSend(client_t *client)
     List_Init(&client->msg_free_list);
 }
 
+void SV_InitMessagePools(void)
+{
+    static const char names[MSG_CLASSES][8] = {
+        "msg128", "msg256", "msg512", "msg1k", "msg2k",
+        "msg4k", "msg8k", "msg16k", "msg32k"
+    };
+    size_t len;
+    int i;
+
+    for (i = 0, len = MSG_MINCLASS; i < MSG_CLASSES; i++, len <<= 1) {
+        Z_PoolInit(&svs.msg_pools[i], names[i],
+                   sizeof(message_packet_t) + len - MSG_TRESHOLD, TAG_SERVER);
+    }
+}
+
+void SV_ShutdownMessagePools(void)
+{
+    int i;
+
+    for (i = 0; i < MSG_CLASSES; i++) {
+        Z_PoolShutdown(&svs.msg_pools[i]);
+    }
+}
+
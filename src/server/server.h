@@ -88,7 +88,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // game features this server supports
 #define SV_FEATURES (GMF_CLIENTNUM | GMF_PROPERINUSE | GMF_MVDSPEC | \
                      GMF_WANT_ALL_DISCONNECTS | GMF_ENHANCED_SAVEGAMES | \
-                     SV_GMF_VARIABLE_FPS | GMF_EXTRA_USERINFO)
+                     SV_GMF_VARIABLE_FPS | GMF_EXTRA_USERINFO | \
+                     GMF_TRACEBATCH | GMF_LAGCOMP)
 
 // ugly hack for SV_Shutdown
 #define MVD_SPAWN_DISABLED  0
@@ -211,6 +212,10 @@ typedef enum {
 #define MSG_POOLSIZE        1024
 #define MSG_TRESHOLD        (64 - 10)   // keep pmsg_s 64 bytes aligned
 
+// size classes for messages larger than MSG_TRESHOLD, up to MAX_MSGLEN
+#define MSG_MINCLASS        128
+#define MSG_CLASSES         9
+
 #define MSG_RELIABLE    1
 #define MSG_CLEAR       2
 #define MSG_COMPRESS    4
@@ -458,6 +463,8 @@ typedef struct server_static_s {
     unsigned        next_entity;    // next state to use
     entity_packed_t *entities;      // [num_entities]
 
+    zpool_t         msg_pools[MSG_CLASSES];    // for large client messages
+
 #if USE_ZLIB
     z_stream        z;  // for compressing messages at once
 #endif
@@ -504,6 +511,7 @@ extern cvar_t       *sv_debug;
 extern cvar_t       *sv_pad_packets;
 #endif
 extern cvar_t       *sv_novis;
+extern cvar_t       *sv_cull_nonvisible_entities;
 extern cvar_t       *sv_lan_force_rate;
 extern cvar_t       *sv_calcpings_method;
 extern cvar_t       *sv_changemapcmd;
@@ -526,6 +534,10 @@ extern cvar_t       *sv_uptime;
 
 extern cvar_t       *sv_allow_unconnected_cmds;
 
+extern cvar_t       *sv_trace_cache;
+extern cvar_t       *sv_delta_cache;
+extern cvar_t       *sv_lagcomp;
+
 extern cvar_t       *g_features;
 
 extern cvar_t       *map_override_path;
@@ -599,6 +611,8 @@ void SV_BroadcastCommand(const char *fmt, ...) q_printf(1, 2);
 void SV_ClientAddMessage(client_t *client, int flags);
 void SV_ShutdownClientSend(client_t *client);
 void SV_InitClientSend(client_t *newcl);
+void SV_InitMessagePools(void);
+void SV_ShutdownMessagePools(void);
 
 //
 // sv_mvd.c
@@ -647,6 +661,52 @@ void SV_MvdStop_f(void);
 #define SV_MvdStop_f()      (void)0
 #endif
 
+//
+// sv_perf.c
+//
+typedef enum {
+    PERF_PACKETS,   // NET_GetPackets
+    PERF_GAME,      // ge->RunFrame
+    PERF_BUILD,     // SV_BuildClientFrame, all clients
+    PERF_WRITE,     // WriteDatagram, all clients
+    PERF_COMPRESS,  // compress_message, nested in other phases
+    PERF_MVD,       // SV_MvdEndFrame
+    PERF_TOTAL,     // SV_Frame
+
+    PERF_TIMERS
+} perftimer_t;
+
+typedef enum {
+    PERF_TRACES,
+    PERF_MULTICASTS,
+    PERF_BYTES,     // sent to clients
+
+    PERF_COUNTERS
+} perfcounter_t;
+
+typedef struct {
+    unsigned    framenum;
+    unsigned    timers[PERF_TIMERS];    // microseconds
+    unsigned    counters[PERF_COUNTERS];
+} perfframe_t;
+
+extern perfframe_t  sv_perf;
+extern qboolean     sv_perf_active;
+
+#define SV_PerfBegin() \
+    (sv_perf_active ? Sys_Microseconds() : 0)
+#define SV_PerfEnd(timer, start) \
+    (sv_perf_active ? (void)(sv_perf.timers[timer] += Sys_Microseconds() - (start)) : (void)0)
+#define SV_PerfCount(counter, n) \
+    (sv_perf.counters[counter] += (n))
+
+void SV_PerfEndClient(client_t *client, perftimer_t timer, unsigned start);
+void SV_PerfEndFrame(unsigned start);
+void SV_PerfResetFrame(void);
+void SV_PerfStats_f(void);
+void SV_PerfRegister(void);
+void SV_PerfShutdown(void);
+
 //
 // sv_ac.c
 //
@@ -715,6 +775,10 @@ void SV_PrintMiscInfo(void);
 #define ES_INUSE(s) \
     ((s)->modelindex || (s)->effects || (s)->sound || (s)->event)
 
+void SV_DeltaStats_f(void);
+#if USE_TESTS
+void SV_DeltaTest_f(void);
+#endif
 void SV_BuildProxyClientFrame(client_t *client);
 void SV_BuildClientFrame(client_t *client);
 void SV_WriteFrameToClient_Default(client_t *client);
@@ -775,6 +839,18 @@ int SV_AreaEdicts(vec3_t mins, vec3_t maxs, edict_t **list, int maxcount, int ar
 // returns the number of pointers filled in
 // ??? does this always return the world?
 
+typedef qboolean (*areafunc_t)(edict_t *ent, void *arg);
+
+void SV_AreaEdictsFunc(vec3_t mins, vec3_t maxs, int areatype,
+                       areafunc_t func, void *arg);
+// calls func for each edict that has bounding box intersecting the given
+// area, without building the intermediate list. iteration stops when func
+// returns false. func must not link or unlink any edicts.
+
+#if USE_TESTS
+void SV_AreaTest_f(void);
+#endif
+
 qboolean SV_EdictIsVisible(cm_t *cm, edict_t *ent, byte *mask);
 
 //===================================================================
@@ -786,6 +862,13 @@ int SV_PointContents(vec3_t p);
 // returns the CONTENTS_* value from the world at the given point.
 // Quake 2 extends this to also check entities, to allow moving liquids
 
+mleaf_t *SV_PointLeaf(vec3_t p);
+// returns the world leaf containing the given point
+
+void SV_ClearTraceCache(void);
+void SV_TraceStats_f(void);
+// per-frame cache of world queries, enabled with sv_trace_cache
+
 trace_t q_gameabi SV_Trace(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end,
                            edict_t *passedict, int contentmask);
 // mins and maxs are relative
@@ -798,3 +881,17 @@ trace_t q_gameabi SV_Trace(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end,
 
 // passedict is explicitly excluded from clipping checks (normally NULL)
 
+void SV_TraceBatch(trace_t *traces, vec3_t *starts, vec3_t *ends, int count,
+                   vec3_t mins, vec3_t maxs, edict_t *passedict, int contentmask);
+// performs count traces of the same box at once, storing results in traces
+
+void SV_RecordLagFrame(void);
+void SV_ClearLagHistory(void);
+void SV_LagStats_f(void);
+// history of solid entity positions, enabled with sv_lagcomp
+
+trace_t q_gameabi SV_TraceLagged(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end,
+                                 edict_t *passedict, int contentmask, edict_t *shooter);
+// same as SV_Trace, but clips against entity positions as seen by the
+// shooting client
+
@@ -24,72 +24,355 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 ENTITY AREA CHECKING
 
+Entities are kept in a hierarchical loose grid covering the XY extents of the
+world. Level 0 has the finest cells, each next level doubles the cell size.
+Entity is linked into the single cell of the finest level whose cell size is
+not smaller than the entity size, selected by the center of its absolute
+bounding box. Cell bounds are thus loosened by half a cell in each direction,
+so that relinking is O(1) and queries only need to expand the area box by the
+same amount. Entities that don't fit anywhere (e.g. with center outside of
+the world) are kept in a separate list that is always checked.
+
 FIXME: this use of "area" is different from the bsp file use
 ===============================================================================
 */
 
-typedef struct areanode_s {
-    int     axis;       // -1 = leaf node
-    float   dist;
-    struct areanode_s   *children[2];
+typedef struct {
     list_t  trigger_edicts;
     list_t  solid_edicts;
-} areanode_t;
+} areacell_t;
+
+typedef struct {
+    areacell_t  *cells;
+    int         size[2];    // number of cells along each axis
+    float       cellsize;
+} arealevel_t;
+
+#define AREA_GRID_BITS      6
+#define AREA_GRID_SIZE      (1 << AREA_GRID_BITS)
+#define AREA_CELL_MINSIZE   128
+#define AREA_LEVELS         (AREA_GRID_BITS + 1)
+#define AREA_CELLS          ((AREA_GRID_SIZE * AREA_GRID_SIZE * 4 - 1) / 3)
+
+static areacell_t   sv_areacells[AREA_CELLS];
+static areacell_t   sv_areaoutside;
+static arealevel_t  sv_arealevels[AREA_LEVELS];
+static int          sv_numarealevels;
+static vec3_t       sv_areaorigin;
+
+typedef struct {
+    edict_t **list;
+    int     count, maxcount;
+} arealist_t;
+
+/*
+===============
+SV_CreateAreaGrid
+
+Builds grid levels for the given world size
+===============
+*/
+static void SV_CreateAreaGrid(vec3_t mins, vec3_t maxs)
+{
+    arealevel_t *level;
+    areacell_t  *cell;
+    float       extent, cellsize;
+    int         i, j;
 
-#define    AREA_DEPTH    4
-#define    AREA_NODES    32
+    VectorCopy(mins, sv_areaorigin);
+
+    extent = max(maxs[0] - mins[0], maxs[1] - mins[1]);
+    cellsize = max(extent / AREA_GRID_SIZE, AREA_CELL_MINSIZE);
+
+    cell = sv_areacells;
+    for (i = 0; i < AREA_LEVELS; i++) {
+        level = &sv_arealevels[i];
+        level->cells = cell;
+        level->cellsize = cellsize;
+        for (j = 0; j < 2; j++) {
+            level->size[j] = ceil((maxs[j] - mins[j]) / cellsize);
+            clamp(level->size[j], 1, AREA_GRID_SIZE >> i);
+        }
+        cell += level->size[0] * level->size[1];
+        cellsize *= 2;
+        if (level->size[0] == 1 && level->size[1] == 1) {
+            i++;
+            break;
+        }
+    }
 
-static areanode_t   sv_areanodes[AREA_NODES];
-static int          sv_numareanodes;
+    sv_numarealevels = i;
 
-static float    *area_mins, *area_maxs;
-static edict_t  **area_list;
-static int      area_count, area_maxcount;
-static int      area_type;
+    for (i = 0; i < cell - sv_areacells; i++) {
+        List_Init(&sv_areacells[i].trigger_edicts);
+        List_Init(&sv_areacells[i].solid_edicts);
+    }
+}
 
 /*
 ===============
-SV_CreateAreaNode
+SV_AreaCellForBox
 
-Builds a uniformly subdivided tree for the given world size
+Finds the cell to link the given box into
 ===============
 */
-static areanode_t *SV_CreateAreaNode(int depth, vec3_t mins, vec3_t maxs)
+static areacell_t *SV_AreaCellForBox(vec3_t mins, vec3_t maxs)
 {
-    areanode_t  *anode;
-    vec3_t      size;
-    vec3_t      mins1, maxs1, mins2, maxs2;
+    arealevel_t *level;
+    float       size, x, y;
+    int         i;
+
+    size = max(maxs[0] - mins[0], maxs[1] - mins[1]);
 
-    anode = &sv_areanodes[sv_numareanodes];
-    sv_numareanodes++;
+    for (i = 0, level = sv_arealevels; i < sv_numarealevels; i++, level++) {
+        if (size > level->cellsize)
+            continue;
 
-    List_Init(&anode->trigger_edicts);
-    List_Init(&anode->solid_edicts);
+        x = (0.5f * (mins[0] + maxs[0]) - sv_areaorigin[0]) / level->cellsize;
+        y = (0.5f * (mins[1] + maxs[1]) - sv_areaorigin[1]) / level->cellsize;
+        if (x < 0 || x >= level->size[0] || y < 0 || y >= level->size[1])
+            break;
 
-    if (depth == AREA_DEPTH) {
-        anode->axis = -1;
-        anode->children[0] = anode->children[1] = NULL;
-        return anode;
+        return &level->cells[(int)y * level->size[0] + (int)x];
     }
 
-    VectorSubtract(maxs, mins, size);
-    if (size[0] > size[1])
-        anode->axis = 0;
-    else
-        anode->axis = 1;
+    return &sv_areaoutside;
+}
+
+/*
+===============================================================================
+
+TRACE CACHE
+
+Optional memoization of repeated world queries within a server frame. Results
+are keyed on exact query arguments and stay valid until the end of the frame,
+or until an edict is linked or unlinked in any region the query overlaps.
+Regions are columns of a coarse grid over the world XY extents.
+===============================================================================
+*/
+
+#define TC_HASH_SIZE    1024
+#define TC_HASH_MASK    (TC_HASH_SIZE - 1)
+#define TC_REGIONS      16
+
+typedef enum {
+    TC_TRACE,
+    TC_CONTENTS,
+    TC_LEAF,
+
+    TC_MAX
+} tctype_t;
+
+typedef struct {
+    tctype_t    type;
+    unsigned    generation;
+    unsigned    stamp;
+    int         regions[4];
+    vec3_t      start, end, mins, maxs;
+    edict_t     *passedict;
+    int         contentmask;
+    union {
+        trace_t trace;
+        int     contents;
+        mleaf_t *leaf;
+    } result;
+} tcentry_t;
+
+static tcentry_t    tc_entries[TC_HASH_SIZE];
+static unsigned     tc_regions[TC_REGIONS][TC_REGIONS];   // stamp of last change
+static float        tc_scale[2];
+static unsigned     tc_generation;
+static unsigned     tc_stamp;
+static qboolean     tc_enabled;
+
+static struct {
+    unsigned    lookups[TC_MAX];
+    unsigned    hits[TC_MAX];
+    unsigned    invalidations;
+} tc_stats;
+
+static const char *const tc_names[TC_MAX] = {
+    "trace", "contents", "leaf"
+};
+
+static void SV_TraceCacheRegions(vec3_t mins, vec3_t maxs, int *regions)
+{
+    float   f;
+    int     i;
+
+    for (i = 0; i < 4; i++) {
+        f = ((i < 2 ? mins : maxs)[i & 1] - sv_areaorigin[i & 1]) * tc_scale[i & 1];
+        if (f < 0)
+            regions[i] = 0;
+        else if (f >= TC_REGIONS)
+            regions[i] = TC_REGIONS - 1;
+        else
+            regions[i] = f;
+    }
+}
+
+static void SV_InvalidateTraceCache(edict_t *ent)
+{
+    int     r[4], x, y;
+
+    if (!tc_enabled)
+        return;
+
+    SV_TraceCacheRegions(ent->absmin, ent->absmax, r);
+
+    tc_stamp++;
+    for (y = r[1]; y <= r[3]; y++)
+        for (x = r[0]; x <= r[2]; x++)
+            tc_regions[y][x] = tc_stamp;
+
+    tc_stats.invalidations++;
+}
+
+/*
+===============
+SV_ClearTraceCache
+
+Called at the end of each server frame to drop all cached results.
+===============
+*/
+void SV_ClearTraceCache(void)
+{
+    tc_enabled = sv_trace_cache->integer > 0;
+    tc_generation++;
+}
+
+static void SV_ResetTraceCache(vec3_t mins, vec3_t maxs)
+{
+    int     i;
+
+    memset(tc_entries, 0, sizeof(tc_entries));
+    memset(tc_regions, 0, sizeof(tc_regions));
+    memset(&tc_stats, 0, sizeof(tc_stats));
+    tc_generation = 1;
+    tc_stamp = 0;
+    tc_enabled = sv_trace_cache->integer > 0;
+
+    for (i = 0; i < 2; i++) {
+        if (maxs[i] > mins[i])
+            tc_scale[i] = TC_REGIONS / (maxs[i] - mins[i]);
+        else
+            tc_scale[i] = 0;
+    }
+}
+
+static unsigned SV_TraceCacheHash(tctype_t type, vec3_t start, vec3_t end,
+                                  edict_t *passedict, int contentmask)
+{
+    unsigned    hash, bits;
+    int         i;
+
+    hash = type * 0x9e3779b9 ^ contentmask;
+    for (i = 0; i < 3; i++) {
+        memcpy(&bits, &start[i], sizeof(bits));
+        hash = hash * 31 + bits;
+        memcpy(&bits, &end[i], sizeof(bits));
+        hash = hash * 31 + bits;
+    }
+    hash ^= (unsigned)(((size_t)passedict) >> 4);
+    hash ^= hash >> 16;
+
+    return hash & TC_HASH_MASK;
+}
+
+/*
+===============
+SV_LookupTraceCache
+
+Returns the entry for the given query. If the entry doesn't contain a valid
+result, returns NULL and stores the slot for SV_StoreTraceCache.
+===============
+*/
+static tcentry_t *SV_LookupTraceCache(tctype_t type, vec3_t start, vec3_t end,
+                                      vec3_t mins, vec3_t maxs,
+                                      edict_t *passedict, int contentmask,
+                                      tcentry_t **slot)
+{
+    tcentry_t   *e;
+    int         x, y;
+
+    tc_stats.lookups[type]++;
+
+    e = &tc_entries[SV_TraceCacheHash(type, start, end, passedict, contentmask)];
+    *slot = e;
+
+    if (e->generation != tc_generation || e->type != type)
+        return NULL;
+    if (e->passedict != passedict || e->contentmask != contentmask)
+        return NULL;
+    if (!VectorCompare(e->start, start) || !VectorCompare(e->end, end))
+        return NULL;
+    if (!VectorCompare(e->mins, mins) || !VectorCompare(e->maxs, maxs))
+        return NULL;
+
+    // world leafs don't depend on entities
+    if (type != TC_LEAF) {
+        for (y = e->regions[1]; y <= e->regions[3]; y++)
+            for (x = e->regions[0]; x <= e->regions[2]; x++)
+                if (tc_regions[y][x] > e->stamp)
+                    return NULL;
+    }
+
+    tc_stats.hits[type]++;
+    return e;
+}
 
-    anode->dist = 0.5 * (maxs[anode->axis] + mins[anode->axis]);
-    VectorCopy(mins, mins1);
-    VectorCopy(mins, mins2);
-    VectorCopy(maxs, maxs1);
-    VectorCopy(maxs, maxs2);
+static void SV_StoreTraceCache(tcentry_t *e, tctype_t type, vec3_t start, vec3_t end,
+                               vec3_t mins, vec3_t maxs,
+                               edict_t *passedict, int contentmask)
+{
+    vec3_t  boxmins, boxmaxs;
+    int     i;
+
+    e->type = type;
+    e->generation = tc_generation;
+    e->stamp = tc_stamp;
+    VectorCopy(start, e->start);
+    VectorCopy(end, e->end);
+    VectorCopy(mins, e->mins);
+    VectorCopy(maxs, e->maxs);
+    e->passedict = passedict;
+    e->contentmask = contentmask;
+
+    // same box SV_ClipMoveToEntities checks
+    for (i = 0; i < 3; i++) {
+        boxmins[i] = min(start[i], end[i]) + mins[i] - 1;
+        boxmaxs[i] = max(start[i], end[i]) + maxs[i] + 1;
+    }
+
+    SV_TraceCacheRegions(boxmins, boxmaxs, e->regions);
+}
+
+/*
+===============
+SV_TraceStats_f
+===============
+*/
+void SV_TraceStats_f(void)
+{
+    int i;
 
-    maxs1[anode->axis] = mins2[anode->axis] = anode->dist;
+    if (!tc_enabled) {
+        Com_Printf("Trace cache is disabled.\n");
+    }
 
-    anode->children[0] = SV_CreateAreaNode(depth + 1, mins2, maxs2);
-    anode->children[1] = SV_CreateAreaNode(depth + 1, mins1, maxs1);
+    Com_Printf("type     lookups    hits   rate\n"
+               "-------- -------- -------- -----\n");
+    for (i = 0; i < TC_MAX; i++) {
+        Com_Printf("%-8s %8u %8u %4.1f%%\n", tc_names[i],
+                   tc_stats.lookups[i], tc_stats.hits[i],
+                   tc_stats.lookups[i] ?
+                   tc_stats.hits[i] * 100.0f / tc_stats.lookups[i] : 0.0f);
+    }
+    Com_Printf("%u invalidations\n", tc_stats.invalidations);
 
-    return anode;
+    if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset")) {
+        memset(&tc_stats, 0, sizeof(tc_stats));
+    }
 }
 
 /*
@@ -104,14 +387,20 @@ void SV_ClearWorld(void)
     edict_t *ent;
     int i;
 
-    memset(sv_areanodes, 0, sizeof(sv_areanodes));
-    sv_numareanodes = 0;
+    memset(sv_arealevels, 0, sizeof(sv_arealevels));
+    sv_numarealevels = 0;
+
+    List_Init(&sv_areaoutside.trigger_edicts);
+    List_Init(&sv_areaoutside.solid_edicts);
 
     if (sv.cm.cache) {
         cm = &sv.cm.cache->models[0];
-        SV_CreateAreaNode(0, cm->mins, cm->maxs);
+        SV_CreateAreaGrid(cm->mins, cm->maxs);
+        SV_ResetTraceCache(cm->mins, cm->maxs);
     }
 
+    SV_ClearLagHistory();
+
     // make sure all entities are unlinked
     for (i = 0; i < ge->max_edicts; i++) {
         ent = EDICT_NUM(i);
@@ -257,13 +546,14 @@ void PF_UnlinkEdict(edict_t *ent)
 {
     if (!ent->area.prev)
         return;        // not linked in anywhere
+    SV_InvalidateTraceCache(ent);
     List_Remove(&ent->area);
     ent->area.prev = ent->area.next = NULL;
 }
 
 void PF_LinkEdict(edict_t *ent)
 {
-    areanode_t *node;
+    areacell_t *cell;
     server_entity_t *sent;
     int entnum;
 #if USE_FPS
@@ -331,72 +621,108 @@ void PF_LinkEdict(edict_t *ent)
     if (ent->solid == SOLID_NOT)
         return;
 
-// find the first node that the ent's box crosses
-    node = sv_areanodes;
-    while (1) {
-        if (node->axis == -1)
-            break;
-        if (ent->absmin[node->axis] > node->dist)
-            node = node->children[0];
-        else if (ent->absmax[node->axis] < node->dist)
-            node = node->children[1];
-        else
-            break;        // crosses the node
-    }
+    SV_InvalidateTraceCache(ent);
+
+// find the grid cell that the ent's box fits in
+    cell = SV_AreaCellForBox(ent->absmin, ent->absmax);
 
     // link it in
     if (ent->solid == SOLID_TRIGGER)
-        List_Append(&node->trigger_edicts, &ent->area);
+        List_Append(&cell->trigger_edicts, &ent->area);
     else
-        List_Append(&node->solid_edicts, &ent->area);
+        List_Append(&cell->solid_edicts, &ent->area);
 }
 
 
 /*
 ====================
-SV_AreaEdicts_r
+SV_AreaCellEdicts
 
 ====================
 */
-static void SV_AreaEdicts_r(areanode_t *node)
+static qboolean SV_AreaCellEdicts(areacell_t *cell, vec3_t mins, vec3_t maxs,
+                                  int areatype, areafunc_t func, void *arg)
 {
     list_t      *start;
     edict_t     *check;
 
     // touch linked edicts
-    if (area_type == AREA_SOLID)
-        start = &node->solid_edicts;
+    if (areatype == AREA_SOLID)
+        start = &cell->solid_edicts;
     else
-        start = &node->trigger_edicts;
+        start = &cell->trigger_edicts;
 
     LIST_FOR_EACH(edict_t, check, start, area) {
         if (check->solid == SOLID_NOT)
             continue;        // deactivated
-        if (check->absmin[0] > area_maxs[0]
-            || check->absmin[1] > area_maxs[1]
-            || check->absmin[2] > area_maxs[2]
-            || check->absmax[0] < area_mins[0]
-            || check->absmax[1] < area_mins[1]
-            || check->absmax[2] < area_mins[2])
+        if (check->absmin[0] > maxs[0]
+            || check->absmin[1] > maxs[1]
+            || check->absmin[2] > maxs[2]
+            || check->absmax[0] < mins[0]
+            || check->absmax[1] < mins[1]
+            || check->absmax[2] < mins[2])
             continue;        // not touching
 
-        if (area_count == area_maxcount) {
-            Com_WPrintf("SV_AreaEdicts: MAXCOUNT\n");
-            return;
-        }
+        if (!func(check, arg))
+            return qfalse;
+    }
+
+    return qtrue;
+}
+
+/*
+====================
+SV_AreaEdictsFunc
+
+Calls func for each edict that has bounding box intersecting the given
+area, until func returns false. Func must not link or unlink edicts.
+====================
+*/
+void SV_AreaEdictsFunc(vec3_t mins, vec3_t maxs, int areatype,
+                       areafunc_t func, void *arg)
+{
+    arealevel_t *level;
+    int         i, x, y, x1, y1, x2, y2;
+    float       f[4];
+
+    for (i = 0, level = sv_arealevels; i < sv_numarealevels; i++, level++) {
+        // expand by half a cell to account for loose bounds
+        f[0] = (mins[0] - sv_areaorigin[0]) / level->cellsize - 0.5f;
+        f[1] = (mins[1] - sv_areaorigin[1]) / level->cellsize - 0.5f;
+        f[2] = (maxs[0] - sv_areaorigin[0]) / level->cellsize + 0.5f;
+        f[3] = (maxs[1] - sv_areaorigin[1]) / level->cellsize + 0.5f;
+
+        if (f[2] < 0 || f[3] < 0 || f[0] >= level->size[0] || f[1] >= level->size[1])
+            continue;
 
-        area_list[area_count] = check;
-        area_count++;
+        x1 = f[0] < 0 ? 0 : (int)f[0];
+        y1 = f[1] < 0 ? 0 : (int)f[1];
+        x2 = f[2] >= level->size[0] ? level->size[0] - 1 : (int)f[2];
+        y2 = f[3] >= level->size[1] ? level->size[1] - 1 : (int)f[3];
+
+        for (y = y1; y <= y2; y++) {
+            for (x = x1; x <= x2; x++) {
+                if (!SV_AreaCellEdicts(&level->cells[y * level->size[0] + x],
+                                       mins, maxs, areatype, func, arg))
+                    return;
+            }
+        }
     }
 
-    if (node->axis == -1)
-        return;        // terminal node
+    SV_AreaCellEdicts(&sv_areaoutside, mins, maxs, areatype, func, arg);
+}
+
+static qboolean SV_AreaListAdd(edict_t *ent, void *arg)
+{
+    arealist_t *area = arg;
 
-    // recurse down both sides
-    if (area_maxs[node->axis] > node->dist)
-        SV_AreaEdicts_r(node->children[0]);
-    if (area_mins[node->axis] < node->dist)
-        SV_AreaEdicts_r(node->children[1]);
+    if (area->count == area->maxcount) {
+        Com_WPrintf("SV_AreaEdicts: MAXCOUNT\n");
+        return qfalse;
+    }
+
+    area->list[area->count++] = ent;
+    return qtrue;
 }
 
 /*
@@ -407,18 +733,125 @@ SV_AreaEdicts
 int SV_AreaEdicts(vec3_t mins, vec3_t maxs, edict_t **list,
                   int maxcount, int areatype)
 {
-    area_mins = mins;
-    area_maxs = maxs;
-    area_list = list;
-    area_count = 0;
-    area_maxcount = maxcount;
-    area_type = areatype;
+    arealist_t area;
+
+    area.list = list;
+    area.count = 0;
+    area.maxcount = maxcount;
+
+    SV_AreaEdictsFunc(mins, maxs, areatype, SV_AreaListAdd, &area);
+
+    return area.count;
+}
+
+
+#if USE_TESTS
+
+static qboolean SV_AreaTestCheck(edict_t *check, vec3_t mins, vec3_t maxs, int areatype)
+{
+    if (!check->inuse || !check->area.prev || check->solid == SOLID_NOT)
+        return qfalse;
+    if ((check->solid == SOLID_TRIGGER) != (areatype == AREA_TRIGGERS))
+        return qfalse;
+    if (check->absmin[0] > maxs[0]
+        || check->absmin[1] > maxs[1]
+        || check->absmin[2] > maxs[2]
+        || check->absmax[0] < mins[0]
+        || check->absmax[1] < mins[1]
+        || check->absmax[2] < mins[2])
+        return qfalse;
+    return qtrue;
+}
+
+/*
+================
+SV_AreaTest_f
+
+Records bounding boxes of currently linked entities and replays area
+queries around them. Results are verified against brute force search.
+================
+*/
+void SV_AreaTest_f(void)
+{
+    edict_t     *list[MAX_EDICTS], *ent;
+    vec3_t      (*boxes)[2];
+    int         i, j, k, num, count, passes, errors, areatype;
+    size_t      total;
+    unsigned    start, end;
+
+    if (!sv.cm.cache || !ge) {
+        Com_Printf("No map loaded.\n");
+        return;
+    }
+
+    passes = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 100;
+    if (passes < 1) {
+        passes = 1;
+    }
+
+    boxes = SV_Malloc(sizeof(*boxes) * ge->num_edicts);
+
+    // record entity positions, expanded by typical movement distance
+    num = 0;
+    for (i = 1; i < ge->num_edicts; i++) {
+        ent = EDICT_NUM(i);
+        if (!ent->inuse || !ent->area.prev) {
+            continue;
+        }
+        for (j = 0; j < 3; j++) {
+            boxes[num][0][j] = ent->absmin[j] - 64;
+            boxes[num][1][j] = ent->absmax[j] + 64;
+        }
+        num++;
+    }
+
+    // verify
+    errors = 0;
+    for (i = 0; i < num; i++) {
+        for (areatype = AREA_SOLID; areatype <= AREA_TRIGGERS; areatype++) {
+            count = SV_AreaEdicts(boxes[i][0], boxes[i][1], list, MAX_EDICTS, areatype);
+            for (j = 0; j < count; j++) {
+                if (!SV_AreaTestCheck(list[j], boxes[i][0], boxes[i][1], areatype)) {
+                    break;
+                }
+            }
+            if (j < count) {
+                Com_EPrintf("Box %d: edict %d returned for type %d\n",
+                            i, NUM_FOR_EDICT(list[j]), areatype);
+                errors++;
+                continue;
+            }
+            for (k = 1; k < ge->num_edicts; k++) {
+                if (SV_AreaTestCheck(EDICT_NUM(k), boxes[i][0], boxes[i][1], areatype)) {
+                    count--;
+                }
+            }
+            if (count) {
+                Com_EPrintf("Box %d: edict count off by %d for type %d\n",
+                            i, count, areatype);
+                errors++;
+            }
+        }
+    }
+
+    // benchmark
+    total = 0;
+    start = Sys_Milliseconds();
+    for (i = 0; i < passes; i++) {
+        for (j = 0; j < num; j++) {
+            total += SV_AreaEdicts(boxes[j][0], boxes[j][1], list, MAX_EDICTS, AREA_SOLID);
+        }
+    }
+    end = Sys_Milliseconds();
 
-    SV_AreaEdicts_r(sv_areanodes);
+    Com_Printf("%u msec, %d queries, %.1f edicts per query, %d failures, %d edicts recorded\n",
+               end - start, passes * num, num ? (float)total / (passes * num) : 0.0f,
+               errors, num);
 
-    return area_count;
+    Z_Free(boxes);
 }
 
+#endif
 
 //===========================================================================
 
@@ -446,6 +879,21 @@ static mnode_t *SV_HullForEntity(edict_t *ent)
     return CM_HeadnodeForBox(ent->mins, ent->maxs);
 }
 
+typedef struct {
+    float   *point;
+    int     contents;
+} pointcontents_t;
+
+static qboolean SV_PointContentsFunc(edict_t *hit, void *arg)
+{
+    pointcontents_t *pc = arg;
+
+    // might intersect, so do an exact clip
+    pc->contents |= CM_TransformedPointContents(pc->point, SV_HullForEntity(hit),
+                                                hit->s.origin, hit->s.angles);
+    return qtrue;
+}
+
 /*
 =============
 SV_PointContents
@@ -453,29 +901,101 @@ SV_PointContents
 */
 int SV_PointContents(vec3_t p)
 {
-    edict_t     *touch[MAX_EDICTS], *hit;
-    int         i, num;
-    int         contents;
+    pointcontents_t pc;
+    tcentry_t       *e, *slot;
 
     if (!sv.cm.cache) {
         Com_Error(ERR_DROP, "%s: no map loaded", __func__);
     }
 
+    if (tc_enabled) {
+        e = SV_LookupTraceCache(TC_CONTENTS, p, p, vec3_origin, vec3_origin,
+                                NULL, 0, &slot);
+        if (e)
+            return e->result.contents;
+    }
+
     // get base contents from world
-    contents = CM_PointContents(p, sv.cm.cache->nodes);
+    pc.point = p;
+    pc.contents = CM_PointContents(p, sv.cm.cache->nodes);
 
     // or in contents from all the other entities
-    num = SV_AreaEdicts(p, p, touch, MAX_EDICTS, AREA_SOLID);
+    SV_AreaEdictsFunc(p, p, AREA_SOLID, SV_PointContentsFunc, &pc);
 
-    for (i = 0; i < num; i++) {
-        hit = touch[i];
+    if (tc_enabled) {
+        SV_StoreTraceCache(slot, TC_CONTENTS, p, p, vec3_origin, vec3_origin,
+                           NULL, 0);
+        slot->result.contents = pc.contents;
+    }
 
-        // might intersect, so do an exact clip
-        contents |= CM_TransformedPointContents(p, SV_HullForEntity(hit),
-                                                hit->s.origin, hit->s.angles);
+    return pc.contents;
+}
+
+/*
+=============
+SV_PointLeaf
+
+Same as CM_PointLeaf on the current map, but cached if enabled.
+=============
+*/
+mleaf_t *SV_PointLeaf(vec3_t p)
+{
+    mleaf_t     *leaf;
+    tcentry_t   *e, *slot;
+
+    if (!tc_enabled) {
+        return CM_PointLeaf(&sv.cm, p);
+    }
+
+    e = SV_LookupTraceCache(TC_LEAF, p, p, vec3_origin, vec3_origin,
+                            NULL, 0, &slot);
+    if (e)
+        return e->result.leaf;
+
+    leaf = CM_PointLeaf(&sv.cm, p);
+
+    SV_StoreTraceCache(slot, TC_LEAF, p, p, vec3_origin, vec3_origin,
+                       NULL, 0);
+    slot->result.leaf = leaf;
+
+    return leaf;
+}
+
+typedef struct {
+    float       *start, *mins, *maxs, *end;
+    edict_t     *passedict;
+    int         contentmask;
+    trace_t     *tr;
+} clipmove_t;
+
+static qboolean SV_ClipMoveFunc(edict_t *touch, void *arg)
+{
+    clipmove_t  *clip = arg;
+    edict_t     *passedict = clip->passedict;
+    trace_t     trace;
+
+    if (touch == passedict)
+        return qtrue;
+    if (clip->tr->allsolid)
+        return qfalse;
+    if (passedict) {
+        if (touch->owner == passedict)
+            return qtrue;   // don't clip against own missiles
+        if (passedict->owner == touch)
+            return qtrue;   // don't clip against owner
     }
 
-    return contents;
+    if (!(clip->contentmask & CONTENTS_DEADMONSTER)
+        && (touch->svflags & SVF_DEADMONSTER))
+        return qtrue;
+
+    // might intersect, so do an exact clip
+    CM_TransformedBoxTrace(&trace, clip->start, clip->end, clip->mins, clip->maxs,
+                           SV_HullForEntity(touch), clip->contentmask,
+                           touch->s.origin, touch->s.angles);
+
+    CM_ClipEntity(clip->tr, &trace, touch);
+    return qtrue;
 }
 
 /*
@@ -488,9 +1008,8 @@ static void SV_ClipMoveToEntities(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t
                                   edict_t *passedict, int contentmask, trace_t *tr)
 {
     vec3_t      boxmins, boxmaxs;
-    int         i, num;
-    edict_t     *touchlist[MAX_EDICTS], *touch;
-    trace_t     trace;
+    clipmove_t  clip;
+    int         i;
 
     // create the bounding box of the entire move
     for (i = 0; i < 3; i++) {
@@ -503,36 +1022,17 @@ static void SV_ClipMoveToEntities(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t
         }
     }
 
-    num = SV_AreaEdicts(boxmins, boxmaxs, touchlist, MAX_EDICTS, AREA_SOLID);
-
-    // be careful, it is possible to have an entity in this
-    // list removed before we get to it (killtriggered)
-    for (i = 0; i < num; i++) {
-        touch = touchlist[i];
-        if (touch->solid == SOLID_NOT)
-            continue;
-        if (touch == passedict)
-            continue;
-        if (tr->allsolid)
-            return;
-        if (passedict) {
-            if (touch->owner == passedict)
-                continue;    // don't clip against own missiles
-            if (passedict->owner == touch)
-                continue;    // don't clip against owner
-        }
-
-        if (!(contentmask & CONTENTS_DEADMONSTER)
-            && (touch->svflags & SVF_DEADMONSTER))
-            continue;
-
-        // might intersect, so do an exact clip
-        CM_TransformedBoxTrace(&trace, start, end, mins, maxs,
-                               SV_HullForEntity(touch), contentmask,
-                               touch->s.origin, touch->s.angles);
-
-        CM_ClipEntity(tr, &trace, touch);
-    }
+    clip.start = start;
+    clip.mins = mins;
+    clip.maxs = maxs;
+    clip.end = end;
+    clip.passedict = passedict;
+    clip.contentmask = contentmask;
+    clip.tr = tr;
+
+    // clipping doesn't call into the game, so entities can't be
+    // unlinked while walking the area cells
+    SV_AreaEdictsFunc(boxmins, boxmaxs, AREA_SOLID, SV_ClipMoveFunc, &clip);
 }
 
 /*
@@ -547,12 +1047,14 @@ trace_t q_gameabi SV_Trace(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end,
                            edict_t *passedict, int contentmask)
 {
     trace_t     trace;
+    tcentry_t   *e, *slot;
 
     if (!sv.cm.cache) {
         Com_Error(ERR_DROP, "%s: no map loaded", __func__);
     }
 
     // work around game bugs
+    SV_PerfCount(PERF_TRACES, 1);
     if (++sv.tracecount > 10000) {
         Com_EPrintf("%s: runaway loop avoided\n", __func__);
         memset(&trace, 0, sizeof(trace));
@@ -568,15 +1070,502 @@ trace_t q_gameabi SV_Trace(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end,
     if (!maxs)
         maxs = vec3_origin;
 
+    if (tc_enabled) {
+        e = SV_LookupTraceCache(TC_TRACE, start, end, mins, maxs,
+                                passedict, contentmask, &slot);
+        if (e)
+            return e->result.trace;
+    }
+
     // clip to world
     CM_BoxTrace(&trace, start, end, mins, maxs, sv.cm.cache->nodes, contentmask);
     trace.ent = ge->edicts;
-    if (trace.fraction == 0) {
-        return trace;   // blocked by the world
+    if (trace.fraction != 0) {
+        // clip to other solid entities
+        SV_ClipMoveToEntities(start, mins, maxs, end, passedict, contentmask, &trace);
+    }
+
+    if (tc_enabled) {
+        SV_StoreTraceCache(slot, TC_TRACE, start, end, mins, maxs,
+                           passedict, contentmask);
+        slot->result.trace = trace;
+    }
+
+    return trace;
+}
+
+
+/*
+==================
+SV_TraceBatch
+
+Performs multiple traces of the same box in one call. World clipping is done
+by CM_BoxTraceN, remaining moves are clipped to solid entities one by one.
+==================
+*/
+void SV_TraceBatch(trace_t *traces, vec3_t *starts, vec3_t *ends, int count,
+                   vec3_t mins, vec3_t maxs, edict_t *passedict, int contentmask)
+{
+    int         i;
+
+    if (!sv.cm.cache) {
+        Com_Error(ERR_DROP, "%s: no map loaded", __func__);
+    }
+
+    if (count <= 0) {
+        return;
+    }
+
+    // work around game bugs
+    SV_PerfCount(PERF_TRACES, count);
+    sv.tracecount += count;
+    if (sv.tracecount > 10000) {
+        Com_EPrintf("%s: runaway loop avoided\n", __func__);
+        for (i = 0; i < count; i++) {
+            memset(&traces[i], 0, sizeof(traces[i]));
+            traces[i].fraction = 1;
+            traces[i].ent = ge->edicts;
+            VectorCopy(ends[i], traces[i].endpos);
+        }
+        sv.tracecount = 0;
+        return;
     }
 
+    if (!mins)
+        mins = vec3_origin;
+    if (!maxs)
+        maxs = vec3_origin;
+
+    // clip to world
+    CM_BoxTraceN(traces, starts, ends, count, mins, maxs,
+                 sv.cm.cache->nodes, contentmask);
+
     // clip to other solid entities
-    SV_ClipMoveToEntities(start, mins, maxs, end, passedict, contentmask, &trace);
+    for (i = 0; i < count; i++) {
+        traces[i].ent = ge->edicts;
+        if (traces[i].fraction == 0) {
+            continue;   // blocked by the world
+        }
+        SV_ClipMoveToEntities(starts[i], mins, maxs, ends[i],
+                              passedict, contentmask, &traces[i]);
+    }
+}
+
+/*
+===============================================================================
+
+LAG COMPENSATION
+
+Bounding boxes of linked SOLID_BBOX entities are recorded at the end of each
+game frame into a ring of frames stored as arrays of components. Entity
+numbers in a frame are sorted, so that a single entity can be found by binary
+search. Each frame also keeps the largest distance along any axis moved by a
+face of an entity's box since it was previously recorded, which accounts for
+both movement and size changes, such as crouching. Summed over a range of
+frames this bounds how far any box could have changed since then, so rewound
+traces can query the current area grid with the move box expanded by that
+amount.
+
+Only entities that are linked both now and in the rewound frame are clipped
+against at their old positions. Brush models are always clipped at their
+current positions.
+===============================================================================
+*/
+
+#define LAG_MAX_FRAMES  64
+
+// clients draw entities interpolated between previous and current frame,
+// so what they see lags by another server frame on top of ping
+#define LAG_INTERP_FRAMES   1
+
+typedef struct {
+    int         framenum;
+    int         count;
+    float       move;
+    uint16_t    *numbers;
+    float       *origin[3];
+    float       *mins[3];
+    float       *maxs[3];
+} lagframe_t;
+
+static lagframe_t   lag_frames[LAG_MAX_FRAMES];
+static int          lag_numframes;
+static int          lag_capacity;
+static int          lag_first, lag_latest;
+static void         *lag_data;
+
+// box each entity was last recorded with
+static vec3_t       lag_lastmins[MAX_EDICTS];
+static vec3_t       lag_lastmaxs[MAX_EDICTS];
+static int          lag_lastframe[MAX_EDICTS];
+
+static struct {
+    unsigned    traces;
+    unsigned    rewound;
+    unsigned    frames;
+    unsigned    usec;
+} lag_stats;
+
+/*
+===============
+SV_ClearLagHistory
+
+Frees recorded frames. Called on level change and when the history size
+needs to be changed.
+===============
+*/
+void SV_ClearLagHistory(void)
+{
+    Z_Free(lag_data);
+    lag_data = NULL;
+    lag_numframes = 0;
+    lag_capacity = 0;
+    memset(lag_frames, 0, sizeof(lag_frames));
+}
+
+static void SV_AllocLagHistory(int numframes, int capacity)
+{
+    lagframe_t  *frame;
+    float       *f;
+    int         i, j;
+
+    SV_ClearLagHistory();
+
+    lag_data = SV_Malloc(numframes * capacity * (sizeof(uint16_t) + sizeof(float) * 9));
+    lag_numframes = numframes;
+    lag_capacity = capacity;
+
+    f = lag_data;
+    for (i = 0, frame = lag_frames; i < numframes; i++, frame++) {
+        for (j = 0; j < 3; j++) {
+            frame->origin[j] = f; f += capacity;
+            frame->mins[j] = f; f += capacity;
+            frame->maxs[j] = f; f += capacity;
+        }
+        frame->framenum = -1;
+    }
+    for (i = 0, frame = lag_frames; i < numframes; i++, frame++) {
+        frame->numbers = (uint16_t *)f + i * capacity;
+    }
+
+    for (i = 0; i < MAX_EDICTS; i++) {
+        lag_lastframe[i] = -1;
+    }
+    lag_first = sv.framenum;
+}
+
+static lagframe_t *SV_LagFrame(int framenum)
+{
+    lagframe_t  *frame;
+
+    if (framenum < lag_first || framenum > lag_latest)
+        return NULL;
+
+    frame = &lag_frames[framenum % lag_numframes];
+    if (frame->framenum != framenum)
+        return NULL;
+
+    return frame;
+}
+
+static int SV_LagFrameIndex(const lagframe_t *frame, int number)
+{
+    int     lo, hi, mid;
+
+    lo = 0;
+    hi = frame->count - 1;
+    while (lo <= hi) {
+        mid = (lo + hi) >> 1;
+        if (frame->numbers[mid] < number)
+            lo = mid + 1;
+        else if (frame->numbers[mid] > number)
+            hi = mid - 1;
+        else
+            return mid;
+    }
+
+    return -1;
+}
+
+/*
+===============
+SV_RecordLagFrame
+
+Called after each game frame to save positions of solid entities.
+===============
+*/
+void SV_RecordLagFrame(void)
+{
+    lagframe_t  *frame;
+    edict_t     *ent;
+    unsigned    start;
+    int         i, j, n, numframes;
+    vec3_t      absmin, absmax;
+    float       d;
+
+    if (sv_lagcomp->integer <= 0 || sv.state != ss_game) {
+        if (lag_data)
+            SV_ClearLagHistory();
+        return;
+    }
+
+    start = Sys_Microseconds();
+
+    // enough frames to rewind by sv_lagcomp milliseconds plus client
+    // interpolation delay, and interpolate between them
+    numframes = Cvar_ClampInteger(sv_lagcomp, 0, 1000) / SV_FRAMETIME + LAG_INTERP_FRAMES + 2;
+    if (numframes > LAG_MAX_FRAMES)
+        numframes = LAG_MAX_FRAMES;
+
+    if (numframes != lag_numframes || ge->max_edicts != lag_capacity)
+        SV_AllocLagHistory(numframes, ge->max_edicts);
+
+    frame = &lag_frames[sv.framenum % lag_numframes];
+    frame->framenum = sv.framenum;
+    frame->move = 0;
+
+    n = 0;
+    for (i = 1; i < ge->num_edicts; i++) {
+        ent = EDICT_NUM(i);
+        if (!ent->inuse || !ent->area.prev || ent->solid != SOLID_BBOX)
+            continue;
+
+        frame->numbers[n] = i;
+        for (j = 0; j < 3; j++) {
+            frame->origin[j][n] = ent->s.origin[j];
+            frame->mins[j][n] = ent->mins[j];
+            frame->maxs[j][n] = ent->maxs[j];
+        }
+        n++;
+
+        // account for movement and resizing since the entity was last
+        // seen, even if it wasn't recorded in the previous frame
+        VectorAdd(ent->s.origin, ent->mins, absmin);
+        VectorAdd(ent->s.origin, ent->maxs, absmax);
+        if (lag_lastframe[i] >= lag_first) {
+            for (j = 0; j < 3; j++) {
+                d = max(fabs(absmin[j] - lag_lastmins[i][j]),
+                        fabs(absmax[j] - lag_lastmaxs[i][j]));
+                if (d > frame->move)
+                    frame->move = d;
+            }
+        }
+        VectorCopy(absmin, lag_lastmins[i]);
+        VectorCopy(absmax, lag_lastmaxs[i]);
+        lag_lastframe[i] = sv.framenum;
+    }
+
+    frame->count = n;
+    lag_latest = sv.framenum;
+
+    lag_stats.frames++;
+    lag_stats.usec += Sys_Microseconds() - start;
+}
+
+typedef struct {
+    clipmove_t  clip;
+    vec3_t      boxmins, boxmaxs;
+    lagframe_t  *frames[2];
+    float       frac;
+    edict_t     *shooter;
+} lagclip_t;
+
+static qboolean SV_ClipLaggedFunc(edict_t *touch, void *arg)
+{
+    lagclip_t   *lag = arg;
+    clipmove_t  *clip = &lag->clip;
+    edict_t     *passedict = clip->passedict;
+    vec3_t      origin, mins, maxs;
+    trace_t     trace;
+    int         i, j;
+
+    if (touch->solid == SOLID_BSP || touch == lag->shooter)
+        return SV_ClipMoveFunc(touch, arg);
+
+    if (touch == passedict)
+        return qtrue;
+    if (clip->tr->allsolid)
+        return qfalse;
+    if (passedict) {
+        if (touch->owner == passedict)
+            return qtrue;
+        if (passedict->owner == touch)
+            return qtrue;
+    }
+
+    if (!(clip->contentmask & CONTENTS_DEADMONSTER)
+        && (touch->svflags & SVF_DEADMONSTER))
+        return qtrue;
+
+    // didn't exist back then
+    i = SV_LagFrameIndex(lag->frames[0], NUM_FOR_EDICT(touch));
+    if (i == -1)
+        return qtrue;
+
+    for (j = 0; j < 3; j++) {
+        origin[j] = lag->frames[0]->origin[j][i];
+        mins[j] = lag->frames[0]->mins[j][i];
+        maxs[j] = lag->frames[0]->maxs[j][i];
+    }
+
+    if (lag->frames[1]) {
+        i = SV_LagFrameIndex(lag->frames[1], NUM_FOR_EDICT(touch));
+        if (i != -1) {
+            for (j = 0; j < 3; j++) {
+                origin[j] += (lag->frames[1]->origin[j][i] - origin[j]) * lag->frac;
+            }
+        }
+    }
+
+    for (j = 0; j < 3; j++) {
+        if (origin[j] + mins[j] > lag->boxmaxs[j])
+            return qtrue;
+        if (origin[j] + maxs[j] < lag->boxmins[j])
+            return qtrue;
+    }
+
+    CM_TransformedBoxTrace(&trace, clip->start, clip->end, clip->mins, clip->maxs,
+                           CM_HeadnodeForBox(mins, maxs), clip->contentmask,
+                           origin, vec3_origin);
+
+    CM_ClipEntity(clip->tr, &trace, touch);
+    lag_stats.rewound++;
+    return qtrue;
+}
+
+/*
+==================
+SV_TraceLagged
+
+Same as SV_Trace, but clips against entity positions the shooting client
+has seen: ping milliseconds ago, limited by sv_lagcomp, plus one frame of
+client side interpolation.
+==================
+*/
+trace_t q_gameabi SV_TraceLagged(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end,
+                                 edict_t *passedict, int contentmask, edict_t *shooter)
+{
+    lagclip_t   lag;
+    trace_t     trace;
+    client_t    *cl;
+    lagframe_t  *frame;
+    vec3_t      boxmins, boxmaxs;
+    float       t, expand;
+    int         i, num, oldest;
+
+    if (!lag_data || !shooter)
+        return SV_Trace(start, mins, maxs, end, passedict, contentmask);
+
+    num = NUM_FOR_EDICT(shooter);
+    if (num < 1 || num > sv_maxclients->integer)
+        return SV_Trace(start, mins, maxs, end, passedict, contentmask);
+
+    cl = &svs.client_pool[num - 1];
+    if (cl->state != cs_spawned || cl->ping <= 0)
+        return SV_Trace(start, mins, maxs, end, passedict, contentmask);
+
+    // find the frames to interpolate between
+    t = lag_latest - (float)min(cl->ping, sv_lagcomp->integer) / SV_FRAMETIME - LAG_INTERP_FRAMES;
+    oldest = max(lag_first, lag_latest - lag_numframes + 1);
+    if (t < oldest)
+        t = oldest;
+
+    lag.frames[0] = SV_LagFrame((int)t);
+    if (!lag.frames[0] || (int)t == lag_latest)
+        return SV_Trace(start, mins, maxs, end, passedict, contentmask);
+
+    lag.frames[1] = SV_LagFrame((int)t + 1);
+    lag.frac = t - (int)t;
+
+    // how far any box could have moved or grown since then
+    expand = 0;
+    for (i = (int)t + 1; i <= lag_latest; i++) {
+        frame = SV_LagFrame(i);
+        if (!frame)
+            return SV_Trace(start, mins, maxs, end, passedict, contentmask);
+        expand += frame->move;
+    }
+
+    // work around game bugs
+    SV_PerfCount(PERF_TRACES, 1);
+    if (++sv.tracecount > 10000) {
+        Com_EPrintf("%s: runaway loop avoided\n", __func__);
+        memset(&trace, 0, sizeof(trace));
+        trace.fraction = 1;
+        trace.ent = ge->edicts;
+        VectorCopy(end, trace.endpos);
+        sv.tracecount = 0;
+        return trace;
+    }
+
+    if (!mins)
+        mins = vec3_origin;
+    if (!maxs)
+        maxs = vec3_origin;
+
+    lag_stats.traces++;
+
+    // clip to world
+    CM_BoxTrace(&trace, start, end, mins, maxs, sv.cm.cache->nodes, contentmask);
+    trace.ent = ge->edicts;
+    if (trace.fraction == 0)
+        return trace;
+
+    // create the bounding box of the entire move
+    for (i = 0; i < 3; i++) {
+        if (end[i] > start[i]) {
+            lag.boxmins[i] = start[i] + mins[i] - 1;
+            lag.boxmaxs[i] = end[i] + maxs[i] + 1;
+        } else {
+            lag.boxmins[i] = end[i] + mins[i] - 1;
+            lag.boxmaxs[i] = start[i] + maxs[i] + 1;
+        }
+    }
+
+    lag.clip.start = start;
+    lag.clip.mins = mins;
+    lag.clip.maxs = maxs;
+    lag.clip.end = end;
+    lag.clip.passedict = passedict;
+    lag.clip.contentmask = contentmask;
+    lag.clip.tr = &trace;
+    lag.shooter = shooter;
+
+    // find entities by their current positions
+    for (i = 0; i < 3; i++) {
+        boxmins[i] = lag.boxmins[i] - expand;
+        boxmaxs[i] = lag.boxmaxs[i] + expand;
+    }
+
+    SV_AreaEdictsFunc(boxmins, boxmaxs, AREA_SOLID, SV_ClipLaggedFunc, &lag);
+
     return trace;
 }
 
+/*
+===============
+SV_LagStats_f
+===============
+*/
+void SV_LagStats_f(void)
+{
+    lagframe_t  *frame;
+
+    if (!lag_data) {
+        Com_Printf("Lag compensation is disabled.\n");
+        return;
+    }
+
+    frame = SV_LagFrame(lag_latest);
+    Com_Printf("%d frames of history, %d entities in last frame\n",
+               min(lag_numframes, lag_latest - lag_first + 1),
+               frame ? frame->count : 0);
+    Com_Printf("%u frames recorded, %.1f usec per frame\n", lag_stats.frames,
+               lag_stats.frames ? (float)lag_stats.usec / lag_stats.frames : 0.0f);
+    Com_Printf("%u lagged traces, %u rewound entity clips\n",
+               lag_stats.traces, lag_stats.rewound);
+
+    if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset")) {
+        memset(&lag_stats, 0, sizeof(lag_stats));
+    }
+}
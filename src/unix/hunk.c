@@ -21,9 +21,43 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <sys/mman.h>
 #include <errno.h>
 
+#ifdef MADV_HUGEPAGE
+
+#define HUGEPAGE_SIZE   (2 << 20)
+
+// reserves memory aligned to huge page boundary and asks the kernel to back
+// it with transparent huge pages. level data is walked linearly every frame,
+// so this cuts down on TLB misses considerably.
+static void *reserve_huge(size_t size)
+{
+    size_t total = size + HUGEPAGE_SIZE;
+    byte *buf, *base;
+
+    if (size > SIZE_MAX - HUGEPAGE_SIZE)
+        return NULL;
+
+    buf = mmap(NULL, total, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (buf == NULL || buf == (void *)-1)
+        return NULL;
+
+    // trim unaligned head and tail
+    base = (byte *)(((uintptr_t)buf + HUGEPAGE_SIZE - 1) & ~(uintptr_t)(HUGEPAGE_SIZE - 1));
+    if (base > buf)
+        munmap(buf, base - buf);
+    if (buf + total > base + size)
+        munmap(base + size, buf + total - (base + size));
+
+    // failure is not fatal, we just get small pages
+    madvise(base, size, MADV_HUGEPAGE);
+    return base;
+}
+
+#endif
+
 void Hunk_Begin(memhunk_t *hunk, size_t maxsize)
 {
-    void *buf;
+    void *buf = NULL;
 
     if (maxsize > SIZE_MAX - 4095)
         Com_Error(ERR_FATAL, "%s: size > SIZE_MAX", __func__);
@@ -31,6 +65,11 @@ void Hunk_Begin(memhunk_t *hunk, size_t maxsize)
     // reserve a huge chunk of memory, but don't commit any yet
     hunk->cursize = 0;
     hunk->maxsize = (maxsize + 4095) & ~4095;
+#ifdef MADV_HUGEPAGE
+    if (hunk->maxsize >= HUGEPAGE_SIZE)
+        buf = reserve_huge(hunk->maxsize);
+    if (!buf)
+#endif
     buf = mmap(NULL, hunk->maxsize, PROT_READ | PROT_WRITE,
                MAP_PRIVATE | MAP_ANON, -1, 0);
     if (buf == NULL || buf == (void *)-1)
@@ -30,6 +30,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <time.h>
 #include <sys/mman.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -37,6 +38,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <dirent.h>
 #include <dlfcn.h>
 #include <errno.h>
+#include <pthread.h>
 
 #if USE_SDL
 #include <SDL_main.h>
@@ -72,6 +74,15 @@ unsigned Sys_Milliseconds(void)
     return time;
 }
 
+// monotonic, only useful for measuring intervals
+unsigned Sys_Microseconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 /*
 =================
 Sys_Quit
@@ -127,6 +138,47 @@ void Sys_Sleep(int msec)
     nanosleep(&req, NULL);
 }
 
+struct systhread_s {
+    pthread_t   thread;
+    void        (*func)(void *);
+    void        *arg;
+};
+
+static void *thread_func(void *arg)
+{
+    systhread_t *thread = arg;
+
+    thread->func(thread->arg);
+    return NULL;
+}
+
+systhread_t *Sys_CreateThread(void (*func)(void *), void *arg)
+{
+    systhread_t *thread = Z_Malloc(sizeof(*thread));
+
+    thread->func = func;
+    thread->arg = arg;
+    if (pthread_create(&thread->thread, NULL, thread_func, thread)) {
+        Z_Free(thread);
+        return NULL;
+    }
+
+    return thread;
+}
+
+void Sys_JoinThread(systhread_t *thread)
+{
+    pthread_join(thread->thread, NULL);
+    Z_Free(thread);
+}
+
+int Sys_NumProcessors(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return count > 0 ? count : 1;
+}
+
 #if USE_AC_CLIENT
 qboolean Sys_GetAntiCheatAPI(void)
 {
@@ -450,6 +502,78 @@ void Sys_ListFiles_r(const char  *path,
     closedir(dir);
 }
 
+qboolean Sys_WalkFiles_r(const char *path, size_t baselen,
+                         void (*func)(const char *, void *), void *arg, int depth)
+{
+    struct dirent *ent;
+    DIR *dir;
+    struct stat st;
+    char fullpath[MAX_OSPATH];
+    qboolean ret = qtrue;
+
+    if ((dir = opendir(path)) == NULL) {
+        // missing top level directory is just empty
+        return !depth && errno == ENOENT;
+    }
+
+    while ((ent = readdir(dir)) != NULL) {
+        if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, "..")) {
+            continue;
+        }
+
+        if (Q_concat(fullpath, sizeof(fullpath),
+                     path, "/", ent->d_name, NULL) >= sizeof(fullpath)) {
+            ret = qfalse;
+            continue;
+        }
+
+        st.st_mode = 0;
+
+#ifdef _DIRENT_HAVE_D_TYPE
+        if (ent->d_type != DT_UNKNOWN && ent->d_type != DT_LNK) {
+            st.st_mode = DTTOIF(ent->d_type);
+        }
+#endif
+
+        if (st.st_mode == 0 && stat(fullpath, &st) == -1) {
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode)) {
+            if (depth >= MAX_LISTED_DEPTH * 2 ||
+                !Sys_WalkFiles_r(fullpath, baselen, func, arg, depth + 1)) {
+                ret = qfalse;
+            }
+        } else if (S_ISREG(st.st_mode)) {
+            func(fullpath + baselen, arg);
+        }
+    }
+
+    closedir(dir);
+    return ret;
+}
+
+void *Sys_MapFile(FILE *fp, size_t size)
+{
+    void *base;
+
+    if (!size) {
+        return NULL;
+    }
+
+    base = mmap(NULL, size, PROT_READ, MAP_SHARED, fileno(fp), 0);
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+
+    return base;
+}
+
+void Sys_UnmapFile(void *base, size_t size)
+{
+    munmap(base, size);
+}
+
 /*
 =================
 main
@@ -324,8 +324,7 @@ static void DS_BeginPainting(void)
 
     // if the buffer was lost or stopped, restore it and/or restart it
     if (IDirectSoundBuffer_GetStatus(pDSBuf, &dwStatus) != DS_OK) {
-        Com_EPrintf("DS_BeginPainting: Couldn't get sound buffer status\n");
-        DS_Shutdown();
+        DMA_DeviceError("DS_BeginPainting: Couldn't get sound buffer status\n");
         return;
     }
 
@@ -343,8 +342,7 @@ static void DS_BeginPainting(void)
     while ((hresult = IDirectSoundBuffer_Lock(pDSBuf, 0, gSndBufSize, (void **)&pbuf, &locksize,
                       (void **)&pbuf2, &dwSize2, 0)) != DS_OK) {
         if (hresult != DSERR_BUFFERLOST) {
-            Com_EPrintf("DS_BeginPainting: Lock failed with error '%s'\n", DSoundError(hresult));
-            DS_Shutdown();
+            DMA_DeviceError("DS_BeginPainting: Lock failed with error '%s'\n", DSoundError(hresult));
             return;
         }
 
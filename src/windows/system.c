@@ -23,6 +23,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <mmsystem.h>
 #if USE_WINSVC
 #include <winsvc.h>
+#include <process.h>
+#include <io.h>
 #endif
 
 HINSTANCE                       hGlobalInstance;
@@ -641,6 +643,19 @@ unsigned Sys_Milliseconds(void)
     return timeGetTime();
 }
 
+unsigned Sys_Microseconds(void)
+{
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER count;
+
+    if (!freq.QuadPart)
+        QueryPerformanceFrequency(&freq);
+
+    QueryPerformanceCounter(&count);
+    return count.QuadPart / freq.QuadPart * 1000000 +
+           count.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart;
+}
+
 void Sys_AddDefaultConfig(void)
 {
 }
@@ -650,6 +665,50 @@ void Sys_Sleep(int msec)
     Sleep(msec);
 }
 
+struct systhread_s {
+    HANDLE      handle;
+    void        (*func)(void *);
+    void        *arg;
+};
+
+static unsigned __stdcall thread_func(void *arg)
+{
+    systhread_t *thread = arg;
+
+    thread->func(thread->arg);
+    return 0;
+}
+
+systhread_t *Sys_CreateThread(void (*func)(void *), void *arg)
+{
+    systhread_t *thread = Z_Malloc(sizeof(*thread));
+
+    thread->func = func;
+    thread->arg = arg;
+    thread->handle = (HANDLE)_beginthreadex(NULL, 0, thread_func, thread, 0, NULL);
+    if (!thread->handle) {
+        Z_Free(thread);
+        return NULL;
+    }
+
+    return thread;
+}
+
+void Sys_JoinThread(systhread_t *thread)
+{
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+    Z_Free(thread);
+}
+
+int Sys_NumProcessors(void)
+{
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+}
+
 /*
 ================
 Sys_Init
@@ -955,6 +1014,89 @@ void Sys_ListFiles_r(const char  *path,
     FindClose(handle);
 }
 
+qboolean Sys_WalkFiles_r(const char *path, size_t baselen,
+                         void (*func)(const char *, void *), void *arg, int depth)
+{
+    WIN32_FIND_DATAA    data;
+    HANDLE      handle;
+    char        fullpath[MAX_OSPATH];
+    size_t      pathlen, len;
+    qboolean    ret = qtrue;
+    DWORD       error;
+
+    if (Q_concat(fullpath, sizeof(fullpath), path, "/*", NULL) >= sizeof(fullpath)) {
+        return qfalse;
+    }
+
+    handle = FindFirstFileA(fullpath, &data);
+    if (handle == INVALID_HANDLE_VALUE) {
+        // missing top level directory is just empty
+        error = GetLastError();
+        return !depth && (error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND);
+    }
+
+    // make it point right after the slash
+    pathlen = strlen(path) + 1;
+
+    do {
+        if (!strcmp(data.cFileName, ".") ||
+            !strcmp(data.cFileName, "..")) {
+            continue; // ignore special entries
+        }
+
+        len = strlen(data.cFileName);
+        if (pathlen + len >= sizeof(fullpath)) {
+            ret = qfalse;
+            continue;
+        }
+
+        memcpy(fullpath + pathlen, data.cFileName, len + 1);
+
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            if (depth >= MAX_LISTED_DEPTH * 2 ||
+                !Sys_WalkFiles_r(fullpath, baselen, func, arg, depth + 1)) {
+                ret = qfalse;
+            }
+        } else {
+            func(fullpath + baselen, arg);
+        }
+    } while (FindNextFileA(handle, &data) != FALSE);
+
+    FindClose(handle);
+    return ret;
+}
+
+void *Sys_MapFile(FILE *fp, size_t size)
+{
+    HANDLE  handle, mapping;
+    void    *base;
+
+    if (!size) {
+        return NULL;
+    }
+
+    handle = (HANDLE)_get_osfhandle(_fileno(fp));
+    if (handle == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+
+    mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) {
+        return NULL;
+    }
+
+    base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size);
+
+    // view keeps the mapping object alive
+    CloseHandle(mapping);
+    return base;
+}
+
+void Sys_UnmapFile(void *base, size_t size)
+{
+    UnmapViewOfFile(base);
+}
+
 /*
 ========================================================================
 
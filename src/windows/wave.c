@@ -274,7 +274,7 @@ static void WAVE_Submit(void)
     //
     while (1) {
         if (snd_completed == snd_sent) {
-            Com_DPrintf("WAVE_Submit: Sound overrun\n");
+            DMA_Overrun("WAVE_Submit: Sound overrun");
             break;
         }
 
@@ -301,8 +301,7 @@ static void WAVE_Submit(void)
         wResult = waveOutWrite(hWaveOut, h, sizeof(WAVEHDR));
 
         if (wResult != MMSYSERR_NOERROR) {
-            Com_EPrintf("WAVE_Submit: Failed to write block to device\n");
-            WAVE_Shutdown();
+            DMA_DeviceError("WAVE_Submit: Failed to write block to device\n");
             return;
         }
     }